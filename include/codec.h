@@ -0,0 +1,186 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "message.h"
+
+// Compact wire codec for the cue messages (pure, no Arduino deps).
+//
+// Frame:  [0x80 | mode] [version] [ttl] [flags] [seq:varint] [t0_ms:u32] body
+// The first byte keeps legacy structs (mode < 0x80) and compact frames apart.
+// Everything up to seq is frozen across versions, so a node can relay (ttl
+// at TTL_AT) a frame it cannot decode. Within a version new fields are only
+// appended; decoders ignore trailing bytes. A new version number means an
+// incompatible body layout.
+//
+// One schema per message serves both directions: each field is written as
+//   m.x = io.op(m.x);
+// a Writer stores the value and returns it, a Reader ignores it and returns
+// what it read. Brightness travels as Q16 (0..1 -> 0..65535), durations and
+// counts as LEB128 varints. Breath cues decode to BreathCue, which keeps the
+// Q16 levels; the master's float BreathMsg is converted once on encode.
+namespace codec {
+
+static const uint8_t WIRE_COMPACT = 0x80;
+static const uint8_t WIRE_VERSION = 1;    // 0 = legacy structs only
+static const size_t  TTL_AT       = 2;
+static const size_t  MAX_FRAME    = 250;  // ESP-NOW payload limit
+
+static inline uint16_t to_q16(float x) {
+  if (!(x > 0)) return 0;
+  if (x >= 1)   return 0xFFFF;
+  return (uint16_t)(x * 65535.0f + 0.5f);
+}
+static inline float from_q16(uint16_t q) { return q * (1.0f / 65535.0f); }
+
+// BreathMsg (floats, legacy wire struct) <-> BreathCue (Q16)
+static inline BreathCue to_cue(const BreathMsg& m) {
+  BreathCue c{};
+  c.mode = m.mode; c.flags = m.flags; c.seq = m.seq; c.t0_ms = m.t0_ms; c.ttl = m.ttl;
+  c.r = m.r; c.g = m.g; c.b = m.b;
+  c.b_min = to_q16(m.b_min); c.b_max = to_q16(m.b_max);
+  c.up_ms = m.up_ms; c.down_ms = m.down_ms; c.cycles = m.cycles;
+  return c;
+}
+static inline BreathMsg to_msg(const BreathCue& c) {
+  BreathMsg m{};
+  m.mode = c.mode; m.flags = c.flags; m.version = 1; m.seq = c.seq; m.t0_ms = c.t0_ms; m.ttl = c.ttl;
+  m.r = c.r; m.g = c.g; m.b = c.b;
+  m.b_min = from_q16(c.b_min); m.b_max = from_q16(c.b_max);
+  m.up_ms = c.up_ms; m.down_ms = c.down_ms; m.cycles = c.cycles;
+  return m;
+}
+
+class Writer {
+public:
+  Writer(uint8_t* out, size_t cap) : p_(out), cap_(cap) {}
+
+  uint8_t u8(uint8_t v) { put(v); return v; }
+  uint32_t u32(uint32_t v) {
+    for (int i = 0; i < 4; ++i) put((uint8_t)(v >> (8 * i)));
+    return v;
+  }
+  template <class T> T var(T v) {
+    uint32_t x = v;
+    do { uint8_t b = x & 0x7F; x >>= 7; put(x ? (b | 0x80) : b); } while (x);
+    return v;
+  }
+  uint16_t u16(uint16_t v) { put((uint8_t)v); put((uint8_t)(v >> 8)); return v; }
+
+  bool   ok()   const { return ok_; }
+  size_t size() const { return len_; }
+
+private:
+  void put(uint8_t b) { if (len_ < cap_) p_[len_++] = b; else ok_ = false; }
+  uint8_t* p_;
+  size_t   cap_, len_ = 0;
+  bool     ok_ = true;
+};
+
+class Reader {
+public:
+  Reader(const uint8_t* in, size_t len) : p_(in), len_(len) {}
+
+  uint8_t u8(uint8_t) { return get(); }
+  uint32_t u32(uint32_t) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= (uint32_t)get() << (8 * i);
+    return v;
+  }
+  template <class T> T var(T) {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      const uint8_t b = get();
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) {
+        if (v > (uint32_t)(T)~(T)0) ok_ = false;   // does not fit the field
+        return (T)v;
+      }
+    }
+    ok_ = false;
+    return 0;
+  }
+  uint16_t u16(uint16_t) {
+    uint16_t v = get();
+    v |= (uint16_t)get() << 8;
+    return v;
+  }
+
+  bool   ok()   const { return ok_; }
+  size_t size() const { return pos_; }
+
+private:
+  uint8_t get() { if (pos_ < len_) return p_[pos_++]; ok_ = false; return 0; }
+  const uint8_t* p_;
+  size_t len_, pos_ = 0;
+  bool   ok_ = true;
+};
+
+// ---------- schemas ----------
+template <class IO> void body(IO& io, BreathCue& m) {
+  m.r       = io.u8(m.r);
+  m.g       = io.u8(m.g);
+  m.b       = io.u8(m.b);
+  m.b_min   = io.u16(m.b_min);   // Q16
+  m.b_max   = io.u16(m.b_max);
+  m.up_ms   = io.var(m.up_ms);
+  m.down_ms = io.var(m.down_ms);
+  m.cycles  = io.var(m.cycles);
+}
+
+template <class IO> void body(IO& io, FlickerMsg& m) {
+  m.on_ms  = io.var(m.on_ms);
+  m.off_ms = io.var(m.off_ms);
+  m.cycles = io.var(m.cycles);
+  m.invert = io.u8(m.invert);
+}
+
+template <class IO> void body(IO& io, TestMsg& m) {
+  m.r       = io.u8(m.r);
+  m.g       = io.u8(m.g);
+  m.b       = io.u8(m.b);
+  m.step_ms = io.var(m.step_ms);
+}
+
+// Common header after [tag][version]; shared by every cue type
+template <class IO, class M> void fields(IO& io, M& m) {
+  m.ttl   = io.u8(m.ttl);
+  m.flags = io.u8(m.flags);
+  m.seq   = io.var(m.seq);
+  m.t0_ms = io.u32(m.t0_ms);
+  body(io, m);
+}
+
+// Returns the frame length, 0 if it does not fit in cap.
+template <class M> size_t encode(const M& in, uint8_t* out, size_t cap) {
+  M m = in;
+  Writer w(out, cap);
+  w.u8(WIRE_COMPACT | m.mode);
+  w.u8(WIRE_VERSION);
+  fields(w, m);
+  return w.ok() ? w.size() : 0;
+}
+static inline size_t encode(const BreathMsg& in, uint8_t* out, size_t cap) {
+  return encode(to_cue(in), out, cap);
+}
+
+static inline bool is_compact(const uint8_t* frame, size_t len) {
+  return len > 0 && (frame[0] & WIRE_COMPACT);
+}
+static inline uint8_t version_of(const uint8_t* frame, size_t len) {
+  return len > 1 ? frame[1] : 0;
+}
+
+// Returns bytes consumed, 0 on a truncated / malformed / too new frame.
+template <class M> size_t decode(const uint8_t* in, size_t len, M& m) {
+  Reader r(in, len);
+  const uint8_t tag = r.u8(0);
+  const uint8_t ver = r.u8(0);
+  if (!(tag & WIRE_COMPACT) || ver == 0 || ver > WIRE_VERSION) return 0;
+  m = M{};
+  m.mode = tag & (uint8_t)~WIRE_COMPACT;
+  fields(r, m);
+  return r.ok() ? r.size() : 0;
+}
+
+} // namespace codec
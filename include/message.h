@@ -5,14 +5,24 @@ enum : uint8_t {
   MODE_NONE    = 0,
   MODE_BREATH  = 1,
   MODE_FLICKER = 2,
-  MODE_TEST = 3
+  MODE_TEST = 3,
+  MODE_SYNC    = 4,   // clock sync exchange (per hop, never forwarded)
+  MODE_SCENE   = 5,   // container: several cue records, one frame (see scene.h)
+  MODE_STATS   = 6,   // link telemetry sweep
+  MODE_ENROLL  = 7    // discovery / node table distribution
 };
 
 enum : uint8_t {
   F_NONE       = 0,
   F_INTERRUPT  = 1 << 0,  // force-interrupt running effect
+  F_CRITICAL   = 1 << 1,  // relays also send to the node after next (dual path)
+  F_SEG0       = 1 << 4,  // bits 4..7: LED segments 0..3 the cue is for
+  F_SEG_MASK   = 0xF0,    // none set = every segment (and single-strip nodes)
 };
 
+// Segment bitmask (bit n = segment n) of a cue's flags; 0 = all segments
+static inline uint8_t cue_segments(uint8_t flags) { return (flags & F_SEG_MASK) >> 4; }
+
 // Default fallback color for flicker if no breath is active
 #define DEFAULT_FLICKER_R 0
 #define DEFAULT_FLICKER_G 0
@@ -33,6 +43,24 @@ typedef struct __attribute__((packed)) {
   uint8_t  ttl;       // hop budget for daisy-chain (decrement on forward)
 } BreathMsg;
 
+// A breath cue as nodes hand it to the renderer: levels stay Q16
+// (0..65535 = 0..1) from the compact codec to the pixels. Not a wire
+// format; legacy BreathMsg frames are converted once on receive (codec.h).
+// Fields are ordered so the struct has no padding (it is hashed whole).
+struct BreathCue {
+  uint32_t seq;
+  uint32_t t0_ms;
+  uint32_t up_ms;
+  uint32_t down_ms;
+  uint16_t b_min;     // Q16
+  uint16_t b_max;     // Q16
+  uint16_t cycles;    // 0 = infinite
+  uint8_t  mode;
+  uint8_t  flags;
+  uint8_t  r, g, b;
+  uint8_t  ttl;
+};
+
 typedef struct __attribute__((packed)) {
   uint8_t  mode;        // = MODE_FLICKER
   uint8_t  ttl;
@@ -59,6 +87,116 @@ typedef struct __attribute__((packed)) {
   uint32_t t0_ms;     // near-future start on master’s millis
 } TestMsg;
 
+// Clock sync: a node sends SYNC_REQ to its upstream (parent, or the master
+// for idx 0); the upstream answers SYNC_RESP with t2/t3 on the *master*
+// timebase (esp_timer us). See lib/comms/clocksync.h.
+enum : uint8_t {
+  SYNC_REQ  = 0,
+  SYNC_RESP = 1
+};
+
+typedef struct __attribute__((packed)) {
+  uint8_t  mode;      // = MODE_SYNC
+  uint8_t  kind;      // SYNC_REQ / SYNC_RESP
+  uint8_t  synced;    // RESP: responder has a valid master-time estimate
+  uint8_t  wire_ver;  // REQ: lowest codec version (codec.h) this node and
+                      // everything below it decode; 0 = legacy structs only
+  uint32_t seq;       // echoed in RESP
+  int64_t  t1_us;     // REQ sent (requester local, echoed)
+  int64_t  t2_us;     // REQ received (responder, master time)
+  int64_t  t3_us;     // RESP sent (responder, master time)
+} SyncMsg;
+
+// Scene: header followed by `count` records, each [len:u8][len bytes of a
+// cue struct above or a compact codec frame (codec.h); first byte = its
+// mode]. All records start together at the header's t0_ms and travel with
+// its ttl; their own t0_ms/ttl are ignored. Header flags: F_CRITICAL sends
+// the scene on the dual path like a standalone cue; the records' own flags
+// (F_INTERRUPT, F_SEG*) apply per record.
+#define SCENE_MAX_BYTES 250   // ESP-NOW payload limit
+
+typedef struct __attribute__((packed)) {
+  uint8_t  mode;      // = MODE_SCENE
+  uint8_t  ttl;
+  uint8_t  flags;     // F_CRITICAL; other bits reserved (0)
+  uint8_t  count;     // number of records
+  uint32_t seq;       // monotonic from master (scene-level dedup)
+  uint32_t t0_ms;     // common start, master millis()
+} SceneHdr;
+
+// Link telemetry: the master sends STATS_REQ to slave 0; it travels down the
+// relay topology (budget_ms shrinks per hop). Each node waits for its
+// children's STATS_REPORTs (or the budget), merges them with its own entry
+// and sends them to its upstream: STATS_PER_FRAME entries per STATS_REPORT,
+// STATS_F_MORE on every frame but the last one. Each hop keeps
+// STATS_HOP_MARGIN_MS of the budget for itself, so the master sizes it by
+// the depth of the table.
+enum : uint8_t {
+  STATS_REQ    = 0,
+  STATS_REPORT = 1
+};
+
+enum : uint8_t {
+  STATS_F_TRUNCATED = 1 << 0,  // a node dropped entries (more than MAX_NODES)
+  STATS_F_MORE      = 1 << 1   // more REPORT frames of this sweep follow from the sender
+};
+
+#define STATS_HOP_MARGIN_MS 40
+
+typedef struct __attribute__((packed)) {
+  uint8_t  mode;       // = MODE_STATS
+  uint8_t  kind;       // STATS_REQ / STATS_REPORT
+  uint8_t  ttl;
+  uint8_t  count;      // REPORT: LinkEntry records that follow
+  uint32_t seq;        // sweep id from the master, echoed
+  uint16_t budget_ms;  // REQ: time left to answer upstream
+  uint8_t  flags;      // STATS_F_*
+  uint8_t  reserved;
+} StatsHdr;
+
+// One node's view, counters since its previous report
+typedef struct __attribute__((packed)) {
+  uint8_t  idx;        // reporting node
+  int8_t   rssi;       // dBm of frames from its upstream, 0 = unknown
+  uint8_t  loss_pct;   // unicast sends to its children not acked
+  uint8_t  gave_up;    // ARQ frames dropped (saturates at 255)
+  uint16_t srtt_10us;  // ARQ send->ack time, 10 us units
+  uint8_t  fwd_p50;    // relay delay, LatencyHist bucket (lib/comms/linkstats.h)
+  uint8_t  fwd_p99;
+} LinkEntry;
+
+#define STATS_PER_FRAME ((250 - sizeof(StatsHdr)) / sizeof(LinkEntry))
+
+// Enrollment: a node without a table (or not listed in it) broadcasts
+// ENROLL_ANNOUNCE; the master appends it and sends ENROLL_TABLE (the full
+// ordered MAC list) to it directly and down the relay topology. A table
+// longer than one frame goes out as several parts of ENROLL_PER_FRAME MACs
+// (offset = index of the first one). Nodes adopt a table with a newer epoch
+// once they hold every part, store it in NVS and relay it (ttl--).
+enum : uint8_t {
+  ENROLL_ANNOUNCE = 0,
+  ENROLL_TABLE    = 1
+};
+
+typedef struct __attribute__((packed)) {
+  uint8_t  mode;      // = MODE_ENROLL
+  uint8_t  kind;      // ENROLL_*
+  uint8_t  ttl;
+  uint8_t  count;     // TABLE: MACs in this frame (6 bytes each, index order)
+  uint32_t epoch;     // TABLE: master's table version; ANNOUNCE: sender's stored one
+  uint8_t  offset;    // TABLE: index of the first MAC in this frame
+  uint8_t  total;     // TABLE: MACs in the whole table
+} EnrollHdr;
+
+#define ENROLL_PER_FRAME ((250 - sizeof(EnrollHdr)) / 6)
+#define ENROLL_MAX_NODES 250   // node indices travel as uint8 (LinkEntry.idx)
+
 static_assert(sizeof(BreathMsg)  == 34, "BreathMsg size mismatch (packing/order)");
+static_assert(sizeof(BreathCue)  == 28, "BreathCue must not have padding (hashed as bytes)");
 static_assert(sizeof(FlickerMsg) == 19, "FlickerMsg size mismatch (packing/order)");
 static_assert(sizeof(TestMsg)    == 18, "TestMsg size mismatch (packing/order)");
+static_assert(sizeof(SyncMsg)    == 32, "SyncMsg size mismatch (packing/order)");
+static_assert(sizeof(SceneHdr)   == 12, "SceneHdr size mismatch (packing/order)");
+static_assert(sizeof(StatsHdr)   == 12, "StatsHdr size mismatch (packing/order)");
+static_assert(sizeof(LinkEntry)  == 8,  "LinkEntry size mismatch (packing/order)");
+static_assert(sizeof(EnrollHdr)  == 10, "EnrollHdr size mismatch (packing/order)");
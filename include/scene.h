@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "message.h"
+
+// Build / walk MODE_SCENE frames (layout in message.h). Pure, no Arduino deps.
+namespace scene {
+
+class Builder {
+public:
+  // flags: F_CRITICAL only (message.h)
+  void begin(uint32_t seq, uint32_t t0_ms, uint8_t ttl, uint8_t flags = 0) {
+    SceneHdr h{};
+    h.mode  = MODE_SCENE;
+    h.ttl   = ttl;
+    h.flags = flags & F_CRITICAL;
+    h.seq   = seq;
+    h.t0_ms = t0_ms;
+    memcpy(buf_, &h, sizeof(h));
+    len_ = sizeof(h);
+  }
+
+  // Append one cue struct or compact frame; false if it does not fit (frame
+  // left unchanged)
+  bool add(const void* rec, size_t n) {
+    if (n == 0 || n > 255 || len_ + 1 + n > SCENE_MAX_BYTES) return false;
+    buf_[len_++] = (uint8_t)n;
+    memcpy(buf_ + len_, rec, n);
+    len_ += n;
+    buf_[offsetof(SceneHdr, count)]++;
+    return true;
+  }
+  template <class M> bool add(const M& m) { return add(&m, sizeof(m)); }
+
+  const uint8_t* data() const { return buf_; }
+  size_t         size() const { return len_; }
+  uint8_t        count() const { return buf_[offsetof(SceneHdr, count)]; }
+
+private:
+  uint8_t buf_[SCENE_MAX_BYTES] = {};
+  size_t  len_ = 0;
+};
+
+// Record iterator: start with off = sizeof(SceneHdr). Returns false at the
+// end or on a record that would run past the frame.
+static inline bool next(const uint8_t* frame, size_t len, size_t& off,
+                        const uint8_t*& rec, uint8_t& rec_len) {
+  if (off >= len) return false;
+  rec_len = frame[off];
+  if (rec_len == 0 || off + 1 + rec_len > len) return false;
+  rec = frame + off + 1;
+  off += 1 + rec_len;
+  return true;
+}
+
+} // namespace scene
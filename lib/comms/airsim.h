@@ -0,0 +1,218 @@
+// lib/comms/airsim.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Simulated ESP-NOW medium on a virtual clock (pure, no Arduino deps), for
+// benchmarking the relay protocol on a host without a rack of boards.
+//
+// One shared channel: a frame occupies the air for airtime_us(len) after
+// the previous one, then reaches its receiver after the link latency (+
+// jitter) unless the link drops it. The sender gets a send-done event with
+// the MAC-ack outcome, like esp_now's send callback, the frame and the tag
+// it was sent with. Each node has a TX buffer of tx_slots frames awaiting
+// send-done; send() fails when it is full (ESP_ERR_ESPNOW_NO_MEM on the
+// radio). reorder_pct of frames get an extra delay, so they can overtake
+// each other.
+//
+// Time here is the medium's; every node also has its own Clock (boot
+// offset, crystal skew), which is what its firmware sees.
+//
+// simnet.h runs the firmware's relay, cue path and ARQ per node on top of
+// it. Nodes map to MACs by index (mac_of / index_of). Start times per cue go
+// into a StartSpread, channel use comes from stats().airtime_us.
+namespace comms {
+namespace airsim {
+
+// Frame on air: DIFS, the data frame and, unicast, SIFS + the MAC ack.
+// mbps 1 is 802.11b, long preamble (the ESP-NOW default rate); 6..54 are
+// 802.11g OFDM (esp_wifi_config_espnow_rate, COMMS_ESPNOW_RATE).
+static const uint32_t PREAMBLE_US  = 192;
+static const uint32_t FRAME_OVH    = 43;    // MAC header, vendor action + IE, FCS
+static const uint32_t ACK_LEN      = 14;
+static const uint32_t ACK_US       = PREAMBLE_US + ACK_LEN * 8;
+static const uint32_t SIFS_US      = 10;
+static const uint32_t DIFS_US      = 50;
+static const uint32_t OFDM_HDR_US  = 20;    // preamble + SIGNAL
+static const uint32_t OFDM_BITS    = 22;    // SERVICE + tail
+
+static inline uint32_t ofdm_us(uint32_t bytes, uint32_t mbps) {
+  const uint32_t per_sym = 4 * mbps;        // data bits per 4 us symbol
+  return OFDM_HDR_US + 4 * ((OFDM_BITS + bytes * 8 + per_sym - 1) / per_sym);
+}
+
+static inline uint32_t airtime_us(size_t len, bool unicast = true, uint32_t mbps = 1) {
+  if (mbps < 6) {
+    const uint32_t data = PREAMBLE_US + (uint32_t)(FRAME_OVH + len) * 8 / (mbps ? mbps : 1);
+    return DIFS_US + data + (unicast ? SIFS_US + ACK_US : 0);
+  }
+  const uint32_t data = ofdm_us(FRAME_OVH + (uint32_t)len, mbps);
+  return DIFS_US + data + (unicast ? SIFS_US + ofdm_us(ACK_LEN, mbps) : 0);
+}
+
+// A node's clock against the medium's: local = t + offset + skew * t
+struct Clock {
+  int64_t offset_us = 0;
+  int32_t skew_ppm  = 0;
+
+  int64_t local_us(int64_t sim_us) const { return sim_us + offset_us + sim_us * skew_ppm / 1000000; }
+  int64_t sim_us(int64_t local_us) const {
+    return (int64_t)((double)(local_us - offset_us) / (1.0 + skew_ppm * 1e-6));
+  }
+};
+
+struct LinkCfg {
+  uint32_t latency_us  = 300;   // receive-side processing on top of airtime
+  uint32_t jitter_us   = 100;   // uniform 0..jitter added per frame
+  uint8_t  loss_pct    = 0;
+  uint8_t  reorder_pct = 0;
+  uint32_t reorder_us  = 2000;  // extra delay of a reordered frame
+  bool     connected   = true;  // out of range: every frame lost
+};
+
+struct Stats {
+  uint32_t sent;
+  uint32_t delivered;
+  uint32_t lost;
+  uint32_t reordered;
+  uint32_t refused;      // TX buffer full
+  uint64_t airtime_us;   // channel time used, acks included
+};
+
+enum class EvKind : uint8_t { Deliver, SendDone };
+
+struct Event {
+  EvKind  kind;
+  uint8_t from, to;      // node indices; to == BCAST_NODE for broadcast
+  bool    ok;            // SendDone: acked
+  uint8_t len;
+  uint32_t tag;          // SendDone: as passed to send()
+  int64_t at_us;
+  uint8_t data[250];
+};
+
+static const uint8_t BCAST_NODE = 0xFF;
+
+template <size_t NODES, size_t QUEUE = 256>
+class Medium {
+public:
+  explicit Medium(uint32_t seed = 1) : rng_(seed ? seed : 1) {
+    for (size_t n = 0; n < NODES; ++n) {
+      for (size_t i = 0; i < 6; ++i) mac_[n][i] = (uint8_t)(i == 5 ? n : 0x5A);
+    }
+  }
+
+  void set_link(uint8_t from, uint8_t to, const LinkCfg& c) { link_[from][to] = c; }
+  void set_all_links(const LinkCfg& c) {
+    for (size_t a = 0; a < NODES; ++a) for (size_t b = 0; b < NODES; ++b) link_[a][b] = c;
+  }
+  void set_tx_slots(uint8_t n) { tx_slots_ = n; }
+  // PHY rate of every frame, as airtime_us()
+  void set_rate_mbps(uint32_t mbps) { mbps_ = mbps; }
+  uint32_t airtime(size_t len, bool unicast = true) const { return airtime_us(len, unicast, mbps_); }
+  const LinkCfg& link(uint8_t from, uint8_t to) const { return link_[from][to]; }
+
+  int64_t now_us() const { return now_us_; }
+  const uint8_t* mac_of(uint8_t node) const { return mac_[node]; }
+  int index_of(const uint8_t mac[6]) const {
+    for (size_t n = 0; n < NODES; ++n) if (memcmp(mac_[n], mac, 6) == 0) return (int)n;
+    return -1;
+  }
+
+  // to == BCAST_NODE reaches every other node, without acks
+  bool send(uint8_t from, uint8_t to, const uint8_t* data, size_t len, uint32_t tag = 0) {
+    if (from >= NODES || len > sizeof(Event{}.data)) return false;
+    if (tx_busy_[from] >= tx_slots_ || count_ + NODES + 1 > QUEUE) { stats_.refused++; return false; }
+    tx_busy_[from]++;
+    stats_.sent++;
+
+    const bool bcast = to == BCAST_NODE;
+    const uint32_t air = airtime(len, !bcast);
+    const int64_t start = busy_until_ > now_us_ ? busy_until_ : now_us_;
+    busy_until_ = start + air;
+    stats_.airtime_us += air;
+
+    bool acked = bcast;   // broadcast: send-done always reports success
+    for (size_t n = 0; n < NODES; ++n) {
+      if (n == from || (!bcast && n != to)) continue;
+      const LinkCfg& c = link_[from][n];
+      if (!c.connected || pct(c.loss_pct)) { stats_.lost++; continue; }
+      int64_t at = busy_until_ + c.latency_us + (c.jitter_us ? rnd() % (c.jitter_us + 1) : 0);
+      if (pct(c.reorder_pct)) { at += c.reorder_us; stats_.reordered++; }
+      push(EvKind::Deliver, from, (uint8_t)n, true, data, len, 0, at);
+      stats_.delivered++;
+      if (!bcast) acked = true;
+    }
+    push(EvKind::SendDone, from, to, acked, data, len, tag, busy_until_);
+    return true;
+  }
+
+  // Earliest event at or before until_us; advances the clock to it.
+  bool next(Event& ev, int64_t until_us) {
+    size_t best = count_;
+    for (size_t i = 0; i < count_; ++i) {
+      if (best == count_ || q_[i].at_us < q_[best].at_us ||
+          (q_[i].at_us == q_[best].at_us && order_[i] < order_[best])) best = i;
+    }
+    if (best == count_ || q_[best].at_us > until_us) {
+      if (until_us > now_us_) now_us_ = until_us;
+      return false;
+    }
+    ev = q_[best];
+    q_[best] = q_[--count_];
+    order_[best] = order_[count_];
+    if (ev.at_us > now_us_) now_us_ = ev.at_us;
+    if (ev.kind == EvKind::SendDone && tx_busy_[ev.from]) tx_busy_[ev.from]--;
+    return true;
+  }
+
+  size_t pending() const { return count_; }
+  Stats  stats()   const { return stats_; }
+
+private:
+  void push(EvKind k, uint8_t from, uint8_t to, bool ok, const uint8_t* d, size_t len, uint32_t tag,
+            int64_t at) {
+    Event& e = q_[count_];
+    e.kind = k; e.from = from; e.to = to; e.ok = ok; e.len = (uint8_t)len; e.tag = tag; e.at_us = at;
+    if (d) memcpy(e.data, d, len);
+    order_[count_++] = ++seq_;
+  }
+
+  uint32_t rnd() { rng_ ^= rng_ << 13; rng_ ^= rng_ >> 17; rng_ ^= rng_ << 5; return rng_; }
+  bool pct(uint8_t p) { return p && rnd() % 100 < p; }
+
+  LinkCfg  link_[NODES][NODES];
+  uint8_t  mac_[NODES][6];
+  uint8_t  tx_busy_[NODES] = {};
+  uint8_t  tx_slots_ = 8;
+  uint32_t mbps_ = 1;
+  Event    q_[QUEUE];
+  uint32_t order_[QUEUE];
+  size_t   count_ = 0;
+  uint32_t seq_ = 0;
+  int64_t  now_us_ = 0, busy_until_ = 0;
+  uint32_t rng_;
+  Stats    stats_ = {};
+};
+
+// Spread of effect start times for one cue across nodes, each node's start
+// mapped back from its own clock to the medium's
+class StartSpread {
+public:
+  void add(int64_t start_us) {
+    if (!n_ || start_us < min_) min_ = start_us;
+    if (!n_ || start_us > max_) max_ = start_us;
+    n_++;
+  }
+  uint32_t nodes()     const { return n_; }
+  int64_t  spread_us() const { return n_ ? max_ - min_ : 0; }
+  void reset() { n_ = 0; }
+
+private:
+  uint32_t n_ = 0;
+  int64_t  min_ = 0, max_ = 0;
+};
+
+} // namespace airsim
+} // namespace comms
@@ -0,0 +1,244 @@
+// lib/comms/arq.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <message.h>
+#include "linkstats.h"
+
+// Hop-by-hop ARQ for relayed frames (pure, no Arduino deps). A frame to a
+// child is kept in a slot until the radio reports its MAC ack; a failed (or
+// silent) send is repeated after an RTO derived from the measured
+// send->callback time (RFC 6298 style, with backoff), up to tries() sends,
+// then handed back through Radio::gave_up. A newer frame of the same type
+// (table frames: the same part) for the same child replaces the old one.
+//
+// enqueue(), service() and next_us() belong to one task (espnow.cpp:
+// rx_task). post() is the send callback's side: it must run between the
+// Radio's lock() and unlock(), which also guard the fields service() shares
+// with it. A host harness (simnet.h) runs one Arq per simulated node.
+namespace comms {
+namespace arq {
+
+static const size_t   MAX_LEN     = 250;      // ESP-NOW payload
+static const uint32_t RTO_INIT_US = 20000;
+static const uint32_t RTO_MIN_US  = 2000;
+static const uint32_t RTO_MAX_US  = 200000;   // also: no callback => failed
+
+struct Stats {
+  uint32_t sent;       // first sends
+  uint32_t retries;    // resends
+  uint32_t acked;
+  uint32_t failed;     // callback said not delivered
+  uint32_t timeouts;   // no callback in time
+  uint32_t gave_up;    // budget exhausted
+  uint32_t replaced;   // newer frame of the same type took over a slot
+  uint32_t overflow;   // no free slot: sent once without ARQ
+  uint32_t desync;     // send callbacks that did not match the tx order
+  uint32_t pending;    // slots in use now
+  int32_t  srtt_us;
+  uint32_t rto_us;
+};
+
+// send: start one send tagged (slot, gen); the tag comes back through
+// post(). false: refused, no callback will come. lock/unlock may be null
+// when everything runs on one task.
+struct Radio {
+  bool (*send)(void* ctx, const uint8_t* mac, const uint8_t* data, size_t len, int8_t slot, uint16_t gen);
+  void (*gave_up)(void* ctx, const uint8_t* mac, const uint8_t* frame, size_t len, uint8_t tries);
+  void (*lock)(void* ctx);
+  void (*unlock)(void* ctx);
+  void* ctx;
+};
+
+// Frame type byte; table parts also by offset
+static inline uint16_t key_of(const uint8_t* data, size_t len) {
+  if (data[0] == MODE_ENROLL && len >= sizeof(EnrollHdr)) {
+    return (uint16_t)(data[0] | (data[offsetof(EnrollHdr, offset)] + 1) << 8);
+  }
+  return data[0];
+}
+
+template <size_t SLOTS>
+class Arq {
+public:
+  void set_radio(const Radio& r) { radio_ = r; }
+  // Sends per frame before giving up; 0 disables ARQ (enqueue() refuses)
+  void set_tries(uint8_t n) { tries_ = n; }
+  uint8_t tries() const { return tries_; }
+  // Relay delay (reception -> first send) of every queued frame goes here
+  void set_fwd_hist(LatencyHist* h) { fwd_ = h; }
+
+  // Queue a frame for mac, received at rx_us (0: not relayed); false if ARQ
+  // is off or all slots are busy
+  bool enqueue(const uint8_t mac[6], const uint8_t* data, size_t len, int64_t rx_us) {
+    if (!tries_ || len == 0 || len > MAX_LEN) return false;
+    const uint16_t key = key_of(data, len);
+    Slot* s = nullptr;
+    for (size_t i = 0; i < SLOTS && !s; ++i) {
+      Slot& c = slot_[i];
+      if (c.used && c.key == key && memcmp(c.mac, mac, 6) == 0) s = &c;
+    }
+    if (s) st_.replaced++;
+    for (size_t i = 0; i < SLOTS && !s; ++i) if (!slot_[i].used) s = &slot_[i];
+    if (!s) { st_.overflow++; return false; }
+
+    memcpy(s->data, data, len);
+    s->rx_us = rx_us;
+    s->len   = (uint8_t)len;
+    s->key   = key;
+    s->tries = 0;
+    memcpy(s->mac, mac, 6);
+    if (s->used && s->in_flight) { s->replaced = true; return true; }
+    s->used     = true;
+    s->replaced = false;
+    s->due_us   = 0;   // send on the next service pass
+    return true;
+  }
+
+  // Send callback for tag (slot, gen), lock held. true: a frame in flight
+  // got its result (worth a service() pass).
+  bool post(int8_t slot, uint16_t gen, bool ok, int64_t now_us) {
+    if (slot < 0 || (size_t)slot >= SLOTS) return false;
+    Slot& s = slot_[slot];
+    if (!s.in_flight || s.gen != gen) return false;
+    s.result = ok ? OK : FAIL;
+    s.cb_us  = (int32_t)(now_us - s.sent_us);
+    return true;
+  }
+
+  // Collect callback results, retransmit what is due
+  void service(int64_t now_us) {
+    for (size_t i = 0; i < SLOTS; ++i) {
+      Slot& s = slot_[i];
+      if (!s.used) continue;
+
+      lock();
+      uint8_t result = s.result;
+      const int32_t cb_us = s.cb_us;
+      bool timeout = false;
+      if (s.in_flight && result == PENDING && now_us >= s.due_us) { result = FAIL; timeout = true; s.gen++; }
+      if (result != PENDING) { s.in_flight = false; s.result = PENDING; }
+      unlock();
+
+      if (result == OK) {
+        st_.acked++;
+        rtt_sample(cb_us);
+      } else if (result == FAIL) {
+        if (timeout) st_.timeouts++;
+        else         st_.failed++;
+      }
+      if (result != PENDING) {
+        if (s.replaced) {
+          s.replaced = false; s.tries = 0; s.due_us = now_us;
+        } else if (result == OK) {
+          s.used = false;
+          continue;
+        } else if (s.tries >= tries_) {
+          s.used = false;
+          st_.gave_up++;
+          uint8_t frame[MAX_LEN];   // the slot may be reused from the callback
+          uint8_t mac[6];
+          memcpy(frame, s.data, s.len);
+          memcpy(mac, s.mac, 6);
+          if (radio_.gave_up) radio_.gave_up(radio_.ctx, mac, frame, s.len, s.tries);
+          continue;
+        } else {
+          const uint32_t backoff = rto_us_ << (s.tries - 1);
+          s.due_us = now_us + (backoff > RTO_MAX_US ? RTO_MAX_US : backoff);
+        }
+      }
+      if (!s.in_flight && now_us >= s.due_us) send(i, now_us);
+    }
+  }
+
+  // Next deadline, INT64_MAX if idle
+  int64_t next_us() const {
+    int64_t next = INT64_MAX;
+    for (size_t i = 0; i < SLOTS; ++i) {
+      if (slot_[i].used && slot_[i].due_us < next) next = slot_[i].due_us;
+    }
+    return next;
+  }
+
+  void note_desync() { st_.desync++; }
+
+  int32_t srtt_us() const { return srtt_us_; }
+  Stats stats() const {
+    Stats st = st_;
+    st.pending = 0;
+    for (size_t i = 0; i < SLOTS; ++i) st.pending += slot_[i].used ? 1 : 0;
+    st.srtt_us = srtt_us_;
+    st.rto_us  = rto_us_;
+    return st;
+  }
+
+private:
+  enum : uint8_t { PENDING = 0, OK = 1, FAIL = 2 };
+
+  struct Slot {
+    bool     used;
+    bool     in_flight;
+    bool     replaced;     // new data while in flight: send again after the callback
+    uint8_t  result;       // PENDING / OK / FAIL, posted by post()
+    uint8_t  tries;
+    uint16_t key;          // key_of()
+    uint8_t  len;
+    uint16_t gen;          // bumped per send; stale callbacks are ignored
+    uint8_t  mac[6];
+    int32_t  cb_us;        // send -> callback
+    int64_t  sent_us;
+    int64_t  due_us;       // next send, or callback deadline while in flight
+    int64_t  rx_us;        // when the frame reached us (relay delay)
+    uint8_t  data[MAX_LEN];
+  };
+
+  void lock()   { if (radio_.lock)   radio_.lock(radio_.ctx); }
+  void unlock() { if (radio_.unlock) radio_.unlock(radio_.ctx); }
+
+  void rtt_sample(int32_t r) {
+    if (srtt_us_ == 0) { srtt_us_ = r; rttvar_us_ = r / 2; }
+    else {
+      const int32_t err = srtt_us_ > r ? srtt_us_ - r : r - srtt_us_;
+      rttvar_us_ += (err - rttvar_us_) / 4;
+      srtt_us_   += (r - srtt_us_) / 8;
+    }
+    const uint32_t rto = (uint32_t)(srtt_us_ + 4 * rttvar_us_);
+    rto_us_ = rto < RTO_MIN_US ? RTO_MIN_US : (rto > RTO_MAX_US ? RTO_MAX_US : rto);
+  }
+
+  void send(size_t i, int64_t now_us) {
+    Slot& s = slot_[i];
+    lock();
+    const uint16_t gen = ++s.gen;
+    s.in_flight = true;
+    s.result    = PENDING;
+    s.sent_us   = now_us;
+    s.due_us    = now_us + RTO_MAX_US;
+    unlock();
+
+    if (s.tries++) st_.retries++;
+    else {
+      st_.sent++;
+      if (s.rx_us && fwd_) fwd_->add((uint32_t)(now_us - s.rx_us));
+    }
+    if (!radio_.send || !radio_.send(radio_.ctx, s.mac, s.data, s.len, (int8_t)i, gen)) {
+      lock();
+      s.result = FAIL;   // handled like a nack on the next service pass
+      s.cb_us  = 0;
+      s.due_us = now_us;
+      unlock();
+    }
+  }
+
+  Radio       radio_ = {};
+  LatencyHist* fwd_  = nullptr;
+  Slot        slot_[SLOTS] = {};
+  uint8_t     tries_ = 4;
+  int32_t     srtt_us_ = 0, rttvar_us_ = 0;
+  uint32_t    rto_us_ = RTO_INIT_US;
+  Stats       st_ = {};
+};
+
+} // namespace arq
+} // namespace comms
@@ -0,0 +1,140 @@
+// lib/comms/clocksync.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+// Offset + skew estimator for one upstream link (pure, no Arduino deps).
+//
+// Each exchange gives four timestamps: t1 (request sent, local us), t2 / t3
+// (request received / response sent, upstream's *master* time in us) and t4
+// (response received, local us). Then
+//   offset = ((t2 - t1) + (t3 - t4)) / 2     master - local
+//   delay  = (t4 - t1) - (t3 - t2)           round trip on air
+// Samples far slower than the window's fastest one are queueing noise and
+// are skipped; the rest get a least-squares line offset(local) whose slope
+// is the skew, so the estimate stays valid between exchanges.
+namespace comms {
+
+class ClockSync {
+public:
+  static const size_t  WINDOW        = 16;
+  static const int32_t DELAY_SLACK   = 1500;    // us above min delay still accepted
+  static const int64_t STEP_RESET_US = 20000;   // jump => upstream rebooted, restart
+  static const size_t  MIN_SAMPLES   = 3;
+  static constexpr double MAX_SKEW   = 100e-6;  // steeper fits are noise, no crystal is that far off
+
+  void reset() { count_ = 0; head_ = 0; fitted_ = false; skew_ = 0; }
+
+  // Returns true if the sample was used for the fit.
+  bool add_sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+    const int64_t delay = (t4 - t1) - (t3 - t2);
+    if (delay < 0) return false;
+    const int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+
+    if (fitted_) {
+      int64_t jump = offset - offset_at(t4);
+      if (jump < 0) jump = -jump;
+      if (jump > STEP_RESET_US) reset();
+    }
+
+    Sample& s = buf_[head_];
+    s.local = t4; s.offset = offset; s.delay = (int32_t)delay;
+    head_ = (head_ + 1) % WINDOW;
+    if (count_ < WINDOW) count_++;
+    return fit();
+  }
+
+  bool synced() const { return fitted_; }
+
+  int64_t to_master(int64_t local_us)  const { return local_us + offset_at(local_us); }
+  int64_t to_local(int64_t master_us)  const { return master_us - offset_at(master_us - ref_offset_); }
+
+  int64_t offset_us()  const { return ref_offset_; }
+  int32_t skew_ppb()   const { return (int32_t)(skew_ * 1e9); }
+  int32_t rtt_us()     const { return min_delay_; }
+  // Bound on |local->master| error: path asymmetry (<= rtt/2) plus fit residual
+  int32_t error_us()   const { return min_delay_ / 2 + resid_; }
+
+private:
+  struct Sample { int64_t local; int64_t offset; int32_t delay; };
+
+  int64_t offset_at(int64_t local_us) const {
+    return ref_offset_ + (int64_t)(skew_ * (double)(local_us - ref_local_));
+  }
+
+  bool fit() {
+    int32_t dmin = INT32_MAX;
+    for (size_t i = 0; i < count_; ++i) if (buf_[i].delay < dmin) dmin = buf_[i].delay;
+
+    const Sample* last = &buf_[(head_ + WINDOW - 1) % WINDOW];
+    const bool last_used = last->delay <= dmin + DELAY_SLACK;
+
+    // Means relative to the newest sample keep the sums small
+    double sx = 0, sy = 0; size_t n = 0;
+    for (size_t i = 0; i < count_; ++i) {
+      if (buf_[i].delay > dmin + DELAY_SLACK) continue;
+      sx += (double)(buf_[i].local  - last->local);
+      sy += (double)(buf_[i].offset - last->offset);
+      n++;
+    }
+    if (n < MIN_SAMPLES) return last_used;
+    const double mx = sx / n, my = sy / n;
+
+    double sxx = 0, sxy = 0;
+    for (size_t i = 0; i < count_; ++i) {
+      if (buf_[i].delay > dmin + DELAY_SLACK) continue;
+      const double x = (double)(buf_[i].local  - last->local)  - mx;
+      const double y = (double)(buf_[i].offset - last->offset) - my;
+      sxx += x * x; sxy += x * y;
+    }
+    skew_       = (sxx > 1e12) ? sxy / sxx : 0.0;   // need ~1 s of spread for a slope
+    // Downstream of a relay the offsets carry the upstream's own estimate;
+    // an unbounded slope fitted to its refits grows with every hop.
+    if (skew_ >  MAX_SKEW) skew_ =  MAX_SKEW;
+    if (skew_ < -MAX_SKEW) skew_ = -MAX_SKEW;
+    ref_local_  = last->local  + (int64_t)mx;
+    ref_offset_ = last->offset + (int64_t)my;
+    min_delay_  = dmin;
+
+    double se = 0;
+    for (size_t i = 0; i < count_; ++i) {
+      if (buf_[i].delay > dmin + DELAY_SLACK) continue;
+      const double e = (double)(buf_[i].offset - offset_at(buf_[i].local));
+      se += e * e;
+    }
+    resid_  = (int32_t)sqrt(se / n);
+    fitted_ = true;
+    return last_used;
+  }
+
+  Sample  buf_[WINDOW];
+  size_t  count_ = 0, head_ = 0;
+  bool    fitted_ = false;
+  double  skew_ = 0;              // d(offset)/d(local)
+  int64_t ref_local_ = 0, ref_offset_ = 0;
+  int32_t min_delay_ = 0, resid_ = 0;
+};
+
+// Master t0_ms -> local ms, local_us being the local clock now. Synced:
+// exact conversion, and a t0 already in the past stays in the past so the
+// effect keeps the master's phase. Unsynced: treat it as local time clamped
+// to 5..2000 ms ahead.
+static const int32_t SYNC_MAX_LEAD_MS = 60000;   // larger t0 distance => not a cue time
+
+static inline uint32_t rebase_t0(const ClockSync& s, uint32_t master_t0_ms, int64_t local_us) {
+  if (s.synced()) {
+    const int64_t m_now  = s.to_master(local_us);
+    const int32_t rel_ms = (int32_t)(master_t0_ms - (uint32_t)(m_now / 1000));
+    if (rel_ms > -SYNC_MAX_LEAD_MS && rel_ms < SYNC_MAX_LEAD_MS) {
+      return (uint32_t)(s.to_local((m_now / 1000 + rel_ms) * 1000) / 1000);
+    }
+  }
+  const uint32_t now = (uint32_t)(local_us / 1000);
+  int32_t rel = (int32_t)master_t0_ms - (int32_t)now;
+  if (rel < 5)    rel = 5;
+  if (rel > 2000) rel = 50;
+  return now + (uint32_t)rel;
+}
+
+} // namespace comms
@@ -0,0 +1,264 @@
+// lib/comms/cuepath.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <message.h>
+#include <codec.h>
+#include <scene.h>
+#include "relay.h"
+
+// Per-frame cue path of one node (pure, no Arduino deps): decode a cue or
+// scene frame (legacy struct or compact codec), check it against the
+// node's cue cache, pass it on ttl-1 and hand a rebased copy to the app.
+// The node's clock, the relay send and the app callbacks come through a
+// Host. espnow.cpp runs one Path on rx_task; a host harness runs one per
+// simulated node (simnet.h).
+namespace comms {
+namespace cuepath {
+
+// A received frame as the radio callback hands it to the task that runs
+// the path (espnow.cpp: through an SpscRing)
+struct Frame {
+  uint8_t  mac[6];
+  uint8_t  len;
+  int64_t  t_us;                        // local clock at reception
+  uint8_t  data[codec::MAX_FRAME];
+};
+
+struct WireCount {
+  uint32_t legacy;       // cue frames as packed structs
+  uint32_t compact;      // cue frames decoded from the compact codec
+  uint32_t opaque;       // compact frames we cannot decode, relayed as is
+  uint32_t bad;          // truncated / malformed
+};
+
+// Debug trace points (Host::trace, optional)
+enum class Trace : uint8_t { Stale, Dispatch, NoCallback, Malformed, SceneShort, SceneSkipped };
+
+// now_ms: the local clock (cue cache ages). rebase_t0: master t0_ms -> local
+// ms (clocksync.h). relay: a ttl-decremented frame to pass on. breath /
+// flicker / test: a new cue, rebased; resync: a repeat of the cached cue,
+// only its new phase origin. Null callbacks are skipped.
+struct Host {
+  uint32_t (*now_ms)(void* ctx);
+  uint32_t (*rebase_t0)(void* ctx, uint32_t master_t0_ms);
+  void (*relay)(void* ctx, const char* tag, const uint8_t* frame, size_t len, uint8_t ttl, bool critical);
+  void (*breath)(void* ctx, const uint8_t* mac, const BreathCue& m);
+  void (*flicker)(void* ctx, const uint8_t* mac, const FlickerMsg& m);
+  void (*test)(void* ctx, const uint8_t* mac, const TestMsg& m);
+  void (*resync)(void* ctx, uint8_t mode, uint32_t t0_ms);
+  void (*trace)(void* ctx, Trace what, const char* tag, uint32_t v);
+  void* ctx;
+};
+
+static inline uint32_t fnv1a(const void* p, size_t n) {
+  const uint8_t* b = (const uint8_t*)p;
+  uint32_t h = 2166136261u;
+  while (n--) { h ^= *b++; h *= 16777619u; }
+  return h;
+}
+
+// Cue parameters only: seq, t0 and ttl change on every refresh
+template <class M>
+static inline uint32_t param_hash(const M& m) {
+  M c = m; c.seq = 0; c.t0_ms = 0; c.ttl = 0;
+  return fnv1a(&c, sizeof(c));
+}
+
+// Decoded cue type -> the packed struct the same cue travels as in legacy
+// frames (offsets and size for relaying them as they arrived)
+template <class M> struct Legacy {
+  typedef M type;
+  static void load(const type& w, M& m) { m = w; }
+};
+template <> struct Legacy<BreathCue> {
+  typedef BreathMsg type;
+  static void load(const type& w, BreathCue& m) { m = codec::to_cue(w); }
+};
+
+// Legacy struct or compact frame -> M
+template <class M>
+static inline bool decode_any(const uint8_t* data, size_t len, M& m) {
+  if (codec::is_compact(data, len)) return codec::decode(data, len, m) > 0;
+  typedef typename Legacy<M>::type W;
+  if (len < sizeof(W)) return false;
+  W w;
+  memcpy(&w, data, sizeof(w));
+  Legacy<M>::load(w, m);
+  return true;
+}
+
+// Compact frame of a newer codec version or unknown cue type: relayed
+// untouched, never decoded
+static inline bool is_opaque(const uint8_t* data, size_t len) {
+  if (!codec::is_compact(data, len)) return false;
+  const uint8_t mode = data[0] & (uint8_t)~codec::WIRE_COMPACT;
+  return codec::version_of(data, len) > codec::WIRE_VERSION || mode < MODE_BREATH || mode > MODE_TEST;
+}
+
+// Frames the path takes: cues, scenes and opaque compact frames
+static inline bool is_cue_frame(const uint8_t* data, size_t len) {
+  if (len == 0) return false;
+  const uint8_t mode = data[0] & (uint8_t)~codec::WIRE_COMPACT;
+  return is_opaque(data, len) || (mode >= MODE_BREATH && mode <= MODE_TEST) || mode == MODE_SCENE;
+}
+
+class Path {
+public:
+  void set_node(relay::Node* n) { node_ = n; }
+  void set_host(const Host& h)  { host_ = h; }
+
+  // One frame from mac: true if it was a cue frame (handled here), false if
+  // it belongs to the caller (sync, stats, enrollment ...)
+  bool handle(const uint8_t* mac, const uint8_t* data, size_t len) {
+    if (!is_cue_frame(data, len)) return false;
+    if (is_opaque(data, len)) {
+      wire_.opaque++;
+      relay_opaque(data, len);
+      return true;
+    }
+    switch (data[0] & (uint8_t)~codec::WIRE_COMPACT) {
+      case MODE_BREATH:  on_cue<BreathCue>("BREATH",    mac, data, len, true);  break;
+      case MODE_FLICKER: on_cue<FlickerMsg>("FLICKER", mac, data, len, true);  break;
+      // NOTE: TEST is forwarded by the app *after* completing its local test.
+      case MODE_TEST:    on_cue<TestMsg>("TEST",       mac, data, len, false); break;
+      case MODE_SCENE:   on_scene(mac, data, len); break;
+    }
+    return true;
+  }
+
+  WireCount wire() const { return wire_; }
+
+private:
+  uint32_t now_ms() const { return host_.now_ms ? host_.now_ms(host_.ctx) : 0; }
+
+  void trace(Trace what, const char* tag, uint32_t v = 0) {
+    if (host_.trace) host_.trace(host_.ctx, what, tag, v);
+  }
+
+  void relay(const char* tag, const uint8_t* frame, size_t len, uint8_t ttl, bool critical = false) {
+    if (host_.relay) host_.relay(host_.ctx, tag, frame, len, ttl, critical);
+  }
+
+  bool dispatch(const uint8_t* mac, const BreathCue& m) {
+    if (!host_.breath) return false;
+    host_.breath(host_.ctx, mac, m);
+    return true;
+  }
+  bool dispatch(const uint8_t* mac, const FlickerMsg& m) {
+    if (!host_.flicker) return false;
+    host_.flicker(host_.ctx, mac, m);
+    return true;
+  }
+  bool dispatch(const uint8_t* mac, const TestMsg& m) {
+    if (!host_.test) return false;
+    host_.test(host_.ctx, mac, m);
+    return true;
+  }
+
+  // A decoded cue: cache check, relay downstream, deliver a rebased copy. A
+  // standalone frame is relayed in the format it arrived in (data/len);
+  // scene records are relayed with their scene (relay_here false).
+  template <class M>
+  void deliver(const char* tag, const uint8_t* mac, M& m, bool compact,
+               const uint8_t* data, size_t len, bool relay_here) {
+    if (compact) wire_.compact++;
+    else         wire_.legacy++;
+
+    const uint8_t seg = cue_segments(m.flags);
+    const relay::Seen seen = node_->classify(m.mode, seg, m.seq, param_hash(m), now_ms());
+    if (seen == relay::Seen::Stale) { trace(Trace::Stale, tag, m.seq); return; }
+
+    // 1) Forward original, unrebased, downstream (ttl--); refreshes rate-limited
+    if (relay_here && m.ttl > 0 &&
+        (seen == relay::Seen::New || node_->refresh_forward_due(m.mode, seg, now_ms()))) {
+      typedef typename Legacy<M>::type W;
+      const size_t n = compact ? len : sizeof(W);
+      uint8_t fwd[codec::MAX_FRAME];
+      memcpy(fwd, data, n);
+      fwd[compact ? codec::TTL_AT : offsetof(W, ttl)] = m.ttl - 1;
+      relay(tag, fwd, n, m.ttl - 1, m.flags & F_CRITICAL);
+    }
+
+    // 2) Deliver local, rebased copy to the app
+    if (host_.rebase_t0) m.t0_ms = host_.rebase_t0(host_.ctx, m.t0_ms);
+    if (seen == relay::Seen::Refresh) {
+      // unchanged cue: keep the running effect, only offer the new phase origin
+      if (host_.resync) host_.resync(host_.ctx, m.mode, m.t0_ms);
+      return;
+    }
+    trace(Trace::Dispatch, tag, m.seq);
+    if (!dispatch(mac, m)) trace(Trace::NoCallback, tag);
+  }
+
+  template <class M>
+  void on_cue(const char* tag, const uint8_t* mac, const uint8_t* data, size_t len, bool relay_here) {
+    M m;
+    if (!decode_any(data, len, m)) { trace(Trace::Malformed, tag); wire_.bad++; return; }
+    deliver(tag, mac, m, codec::is_compact(data, len), data, len, relay_here);
+  }
+
+  // Compact frame we cannot decode: the header up to ttl is frozen, so
+  // still pass it on
+  void relay_opaque(const uint8_t* data, size_t len) {
+    if (len <= codec::TTL_AT || data[codec::TTL_AT] == 0) return;
+    uint8_t fwd[codec::MAX_FRAME];
+    memcpy(fwd, data, len);
+    fwd[codec::TTL_AT]--;
+    relay("OPAQUE", fwd, len, fwd[codec::TTL_AT]);
+  }
+
+  // One scene record (legacy or compact): patch in the common t0/ttl and
+  // dispatch it like a standalone cue (same cache), without relaying it on
+  // its own.
+  template <class M>
+  void on_scene_rec(const char* tag, const uint8_t* mac, const uint8_t* rec, uint8_t n,
+                    const SceneHdr& h) {
+    M m;
+    if (!decode_any(rec, n, m)) { trace(Trace::Malformed, tag); wire_.bad++; return; }
+    m.t0_ms = h.t0_ms;
+    m.ttl   = h.ttl;
+    deliver<M>(tag, mac, m, codec::is_compact(rec, n), nullptr, 0, false);
+  }
+
+  // Scene: cached and relayed as one frame, then every record is dispatched
+  // back to back with the same t0.
+  void on_scene(const uint8_t* mac, const uint8_t* data, size_t len) {
+    if (len < sizeof(SceneHdr) || len > codec::MAX_FRAME) { trace(Trace::SceneShort, "SCENE"); return; }
+    SceneHdr h; memcpy(&h, data, sizeof(h));
+
+    uint8_t buf[codec::MAX_FRAME];
+    memcpy(buf, data, len);
+    SceneHdr z = h; z.seq = 0; z.t0_ms = 0; z.ttl = 0;
+    memcpy(buf, &z, sizeof(z));
+    const relay::Seen seen = node_->classify(MODE_SCENE, 0, h.seq, fnv1a(buf, len), now_ms());
+    if (seen == relay::Seen::Stale) { trace(Trace::Stale, "SCENE", h.seq); return; }
+
+    if (h.ttl > 0 && (seen == relay::Seen::New || node_->refresh_forward_due(MODE_SCENE, 0, now_ms()))) {
+      SceneHdr f = h;
+      f.ttl--;
+      memcpy(buf, data, len);
+      memcpy(buf, &f, sizeof(f));
+      relay("SCENE", buf, len, f.ttl, f.flags & F_CRITICAL);
+    }
+
+    size_t off = sizeof(SceneHdr);
+    const uint8_t* rec; uint8_t n;
+    for (uint8_t i = 0; i < h.count && scene::next(data, len, off, rec, n); ++i) {
+      switch (rec[0] & (uint8_t)~codec::WIRE_COMPACT) {
+        case MODE_BREATH:  on_scene_rec<BreathCue>("BREATH",    mac, rec, n, h); break;
+        case MODE_FLICKER: on_scene_rec<FlickerMsg>("FLICKER", mac, rec, n, h); break;
+        case MODE_TEST:    on_scene_rec<TestMsg>("TEST",       mac, rec, n, h); break;
+        default: trace(Trace::SceneSkipped, "SCENE", rec[0]); break;
+      }
+    }
+  }
+
+  relay::Node* node_ = nullptr;
+  Host         host_ = {};
+  WireCount    wire_ = {};
+};
+
+} // namespace cuepath
+} // namespace comms
@@ -1,8 +1,23 @@
 #include <Arduino.h>
 #include <esp_now.h>
+#include <esp_timer.h>
 #include <WiFi.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 #include <message.h>
+#include <scene.h>
+#include <codec.h>
 #include <espnow.h>
+#include <logging.h>
+#include "topology.h"
+#include "spsc_ring.h"
+#include "clocksync.h"
+#include "linkstats.h"
+#include "registry.h"
+#include "peercache.h"
+#include "arq.h"
+#include "cuepath.h"
+#include <esp_wifi.h>
 
 namespace comms {
 namespace espnow {
@@ -13,50 +28,290 @@ static_assert(sizeof(FlickerMsg) == 19, "FlickerMsg size mismatch");
 static_assert(sizeof(TestMsg)    == 18, "TestMsg size mismatch");
 
 // ---------- module state ----------
-static const uint8_t (*s_peers)[6] = nullptr;
-static size_t   s_num  = 0;
-static size_t   s_idx  = 0;
+// Peer table, layout, cue cache and peer health (relay.h); sends come back
+// through relay_sink() below. rx_task owns s_node: it swaps the table
+// (adopt_table) and does all relaying. s_node_mux guards the swap against
+// the other tasks: on_send's health update (WiFi task) and the child MAC
+// copies loop() takes (child_macs()).
+static relay::Node  s_node;
+static portMUX_TYPE s_node_mux = portMUX_INITIALIZER_UNLOCKED;
 static bool     s_verbose = true;   // turn ON while debugging
 
-static bool     s_next_added = false;
+static bool     s_next_added = false;   // all children registered as peers
 static uint32_t s_last_try_ms = 0;
 
+// Broadcast delivery: one frame reaches every node in range; repeaters
+// rebroadcast for out-of-range segments, everyone drops repeated copies.
+static const uint8_t BCAST[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+static Delivery s_delivery = Delivery::Unicast;
+static bool     s_repeater = false;
+
+// Cue cache: relay::Node (s_node), run by s_path (cuepath.h). Its child
+// epoch is bumped on the WiFi task (a dead child revived) and on rx_task.
+
+// Receive path: on_recv (WiFi task) only copies the frame into s_rx_ring;
+// rx_task decodes, forwards and dispatches (cue frames through s_path,
+// cuepath.h). t_us: esp_timer_get_time() at reception.
+typedef cuepath::Frame RxFrame;
+static const size_t      RX_RING_SLOTS = 16;
+static const uint32_t    RX_TASK_STACK = 4096;
+static const UBaseType_t RX_TASK_PRIO  = 5;   // above loop() (1), below WiFi (23)
+static const BaseType_t  RX_TASK_CORE  = 0;   // radio core; loop() runs on 1
+
+static SpscRing<RxFrame, RX_RING_SLOTS> s_rx_ring;
+static TaskHandle_t s_rx_task = nullptr;
+static RxStats      s_rx_stats = {};
+static uint64_t     s_rx_cb_us_sum = 0;
+
+// Wire codec: counters, and the versions our children reported in their
+// SYNC_REQs (a child that has not reported lately counts as legacy).
+static const size_t   WIRE_TRACK_CHILDREN = 8;
+static const uint32_t WIRE_REPORT_MAX_AGE = 5000;
+struct ChildVer { uint8_t ver; uint32_t at_ms; uint32_t sync_seq; bool seen; };
+static ChildVer  s_child_ver[WIRE_TRACK_CHILDREN] = {};
+static cuepath::Path s_path;
+
 // App callbacks
 static breath_cb_t  s_breath_cb  = nullptr;
 static flicker_cb_t s_flicker_cb = nullptr;
 static test_cb_t    s_test_cb    = nullptr;
+static resync_cb_t  s_resync_cb  = nullptr;
+
+// Debug trace: compiled out below LOG_LEVEL_DEBUG, gated by set_verbose()
+#define vlog(fmt, ...) do { if (s_verbose) LOGD(fmt, ##__VA_ARGS__); } while (0)
+
+// ---------- clock sync (one exchange per period with our upstream) ----------
+static const uint32_t SYNC_PERIOD_MS      = 1000;
+static const uint32_t SYNC_FAST_PERIOD_MS = 250;    // until the first fit
 
-static inline void vlog(const char* fmt, ...) {
-  if (!s_verbose) return;
-  va_list ap; va_start(ap, fmt);
-  char buf[192];
-  vsnprintf(buf, sizeof(buf), fmt, ap);
-  va_end(ap);
-  Serial.println(buf);
+static ClockSync  s_sync;
+static uint8_t    s_master_mac[6] = {};
+static bool       s_have_master_mac = false;
+static uint32_t   s_sync_seq = 0;
+static uint32_t   s_last_sync_ms = 0;
+static uint32_t   s_sync_exchanges = 0;
+static uint32_t   s_sync_rejected = 0;
+
+
+// ---------- peer table ----------
+// The driver keeps ~20 peers; s_peer_cache holds the registered working set
+// (LRU, see peercache.h) so any number of MACs can be addressed and a
+// registered peer costs no driver call. rx_task and loop() both register.
+static PeerCache<COMMS_PEER_SLOTS> s_peer_cache;
+static SemaphoreHandle_t s_peer_lock = nullptr;
+static uint32_t s_peer_add_errors = 0;
+static uint32_t s_peer_cache_stale = 0;   // send found the peer unregistered
+
+static bool add_peer(const uint8_t mac[6]) {
+  if (s_peer_lock) xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+  const auto r = s_peer_cache.touch(mac, millis());
+  bool ok = true;
+  if (!r.hit) {
+    if (r.evicted) esp_now_del_peer(r.victim); // ignore result
+    esp_now_peer_info_t p{};
+    memcpy(p.peer_addr, mac, 6);
+    p.channel = 0;
+    p.encrypt = false;
+    const esp_err_t e = esp_now_add_peer(&p);
+    ok = (e == ESP_OK || e == ESP_ERR_ESPNOW_EXIST);
+    if (!ok) {
+      s_peer_cache.forget(mac);
+      s_peer_add_errors++;
+      vlog("[espnow] add peer failed (%d)", (int)e);
+    }
+  }
+  if (s_peer_lock) xSemaphoreGive(s_peer_lock);
+  return ok;
 }
 
-static inline uint32_t rebase_t0(uint32_t remote_t0) {
-  uint32_t now = millis();
-  int32_t rel = (int32_t)remote_t0 - (int32_t)now;
-  if (rel < 5)    rel = 5;
-  if (rel > 2000) rel = 50;
-  return now + (uint32_t)rel;
+static void drop_peer(const uint8_t mac[6]) {
+  if (s_peer_lock) xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+  s_peer_cache.forget(mac);
+  esp_now_del_peer(mac); // ignore result
+  if (s_peer_lock) xSemaphoreGive(s_peer_lock);
 }
 
+// This node's children, copied under s_node_mux (at most cap of them)
+static size_t child_macs(uint8_t (*out)[6], size_t cap) {
+  size_t n = 0;
+  portENTER_CRITICAL(&s_node_mux);
+  if (s_node.has_table()) {
+    const size_t first = s_node.first_child(s_node.idx());
+    n = s_node.child_count(s_node.idx());
+    if (n > cap) n = cap;
+    for (size_t i = 0; i < n; ++i) memcpy(out[i], s_node.peer(first + i), 6);
+  }
+  portEXIT_CRITICAL(&s_node_mux);
+  return n;
+}
+
+// More children than peer slots would only thrash the cache
+static const size_t MAX_CHILD_PEERS = COMMS_PEER_SLOTS;
+
 static void try_add_next_peer() {
-  if (s_idx + 1 >= s_num) return;
-  esp_now_peer_info_t p{};
-  memcpy(p.peer_addr, s_peers[s_idx + 1], 6);
-  p.channel = 0;
-  p.encrypt = false;
-  esp_err_t e = esp_now_add_peer(&p);
-  if (e == ESP_OK || e == ESP_ERR_ESPNOW_EXIST) {
-    s_next_added = true;
-    vlog("[espnow] next peer added");
-  } else {
-    s_next_added = false;
-    vlog("[espnow] add peer failed (%d)", (int)e);
+  uint8_t macs[MAX_CHILD_PEERS][6];
+  const size_t n = child_macs(macs, MAX_CHILD_PEERS);
+  bool ok = true;
+  for (size_t i = 0; i < n; ++i) ok &= add_peer(macs[i]);
+  s_next_added = ok;
+  if (ok && n) vlog("[espnow] %u child peer(s) added", (unsigned)n);
+}
+
+// ---------- enrollment (table from NVS / the master) ----------
+// s_table backs s_node's peer table when the node runs from the registry.
+// Without a usable table the node broadcasts ENROLL_ANNOUNCE, fast right
+// after boot.
+static const uint32_t ANNOUNCE_FAST_MS     = 200;
+static const uint32_t ANNOUNCE_SLOW_MS     = 1000;
+static const uint32_t ANNOUNCE_FAST_FOR_MS = 5000;
+
+static registry::Table s_table = {};
+static registry::Assembler s_table_in;   // parts of a newer table
+static bool     s_use_registry = false;
+static uint8_t  s_my_mac[6] = {};
+static uint32_t s_init_ms = 0;
+static uint32_t s_enrolled_ms = 0;       // init -> usable table
+static uint32_t s_next_announce_ms = 0;
+
+// ---------- link telemetry state (sweep logic further down) ----------
+// Counters since the previous report; all but the send callbacks are only
+// touched from rx_task.
+static volatile uint32_t s_link_tx_cb = 0, s_link_tx_fail = 0;   // on_send, unicast
+static uint32_t    s_link_prev_cb = 0, s_link_prev_fail = 0, s_link_prev_gave_up = 0;
+static LatencyHist s_fwd_hist;
+static int64_t     s_cur_rx_us = 0;       // reception time of the frame being handled
+static volatile int8_t s_up_rssi = 0;
+
+struct Sweep {
+  bool      active;
+  uint32_t  seq;
+  uint8_t   up_mac[6];
+  int64_t   deadline_us;
+  uint8_t   waiting;    // children that have not reported
+  uint8_t   count;
+  uint8_t   flags;
+  LinkEntry e[registry::MAX_NODES];   // this node and everything below it
+};
+static Sweep    s_sweep = {};
+static uint32_t s_last_sweep_seq = 0;
+
+static void note_fwd_delay() {
+  if (s_cur_rx_us) s_fwd_hist.add((uint32_t)(esp_timer_get_time() - s_cur_rx_us));
+}
+
+static void reroute_around(const uint8_t* mac, const uint8_t* frame, size_t len);
+
+// ---------- transmit path + hop-by-hop ARQ ----------
+// Every send goes through tx_send(): it pushes a tag on s_tx_fifo, and
+// on_send() pops one per callback (ESP-NOW reports completions in send
+// order), so a completion is never credited to the wrong frame.
+//
+// Relayed frames to a child go through s_arq (arq.h): rx_task queues and
+// services it, on_send posts results into it under s_tx_mux.
+static const size_t   TX_FIFO_SLOTS   = 32;
+static const size_t   ARQ_SLOTS       = 8;
+
+struct TxTag { uint8_t mac[6]; int8_t slot; uint16_t gen; };
+
+static SemaphoreHandle_t s_tx_lock = nullptr;   // keeps fifo order == send order
+static portMUX_TYPE      s_tx_mux  = portMUX_INITIALIZER_UNLOCKED;
+static TxTag    s_tx_fifo[TX_FIFO_SLOTS];
+static size_t   s_tx_head = 0, s_tx_count = 0;
+
+static arq::Arq<ARQ_SLOTS> s_arq;
+
+static esp_err_t tx_send(const uint8_t* mac, const uint8_t* data, size_t len,
+                         int8_t slot = -1, uint16_t gen = 0) {
+  if (s_tx_lock) xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+  portENTER_CRITICAL(&s_tx_mux);
+  if (s_tx_count == TX_FIFO_SLOTS) { s_tx_count = 0; s_arq.note_desync(); }
+  TxTag& t = s_tx_fifo[(s_tx_head + s_tx_count++) % TX_FIFO_SLOTS];
+  memcpy(t.mac, mac, 6); t.slot = slot; t.gen = gen;
+  portEXIT_CRITICAL(&s_tx_mux);
+
+  esp_err_t e = esp_now_send(mac, data, len);
+  if (e == ESP_ERR_ESPNOW_NOT_FOUND) {
+    // cache said registered but the driver lost it (evicted by another task
+    // between add_peer() and here): register again and retry once
+    s_peer_cache_stale++;
+    drop_peer(mac);
+    if (add_peer(mac)) e = esp_now_send(mac, data, len);
+  }
+  if (e != ESP_OK) {   // no callback will come: take the tag back
+    portENTER_CRITICAL(&s_tx_mux);
+    if (s_tx_count) s_tx_count--;
+    portEXIT_CRITICAL(&s_tx_mux);
+  }
+  if (s_tx_lock) xSemaphoreGive(s_tx_lock);
+  return e;
+}
+
+static bool arq_radio_send(void*, const uint8_t* mac, const uint8_t* data, size_t len,
+                           int8_t slot, uint16_t gen) {
+  return tx_send(mac, data, len, slot, gen) == ESP_OK;
+}
+
+static void arq_gave_up(void*, const uint8_t* mac, const uint8_t* frame, size_t len, uint8_t tries) {
+  s_next_added = false;   // let tick() re-register the peer
+  vlog("[espnow] ARQ gave up on %02X:%02X:%02X:%02X:%02X:%02X after %u sends",
+       mac[0],mac[1],mac[2],mac[3],mac[4],mac[5], (unsigned)tries);
+  reroute_around(mac, frame, len);
+}
+
+static void arq_lock(void*)   { portENTER_CRITICAL(&s_tx_mux); }
+static void arq_unlock(void*) { portEXIT_CRITICAL(&s_tx_mux); }
+
+// ---------- self-healing relay ----------
+// Health tracking and rerouting live in s_node (relay.h); this is its
+// radio side. Relay sends go through ARQ, probes are plain copies.
+
+static void send_one(const char* tag, size_t idx, const uint8_t* frame, size_t len) {
+  const uint8_t* mac = s_node.peer(idx);
+  add_peer(mac); // idempotent
+  if (s_arq.enqueue(mac, frame, len, s_cur_rx_us)) {
+    vlog("[espnow] %s queued -> idx %u", tag, (unsigned)idx);
+    return;
+  }
+  note_fwd_delay();
+  esp_err_t e = tx_send(mac, frame, len);
+  if (e != ESP_OK) vlog("[espnow] %s forward err=%d", tag, (int)e);
+  else             vlog("[espnow] %s forwarded -> idx %u", tag, (unsigned)idx);
+}
+
+static void relay_sink(void*, const char* tag, size_t idx, const uint8_t* frame, size_t len,
+                       relay::Send how) {
+  if (how == relay::Send::Relay) { send_one(tag, idx, frame, len); return; }
+  vlog("[espnow] %s probes dead idx %u", tag, (unsigned)idx);
+  add_peer(s_node.peer(idx));
+  tx_send(s_node.peer(idx), frame, len);
+}
+
+// ARQ gave up on mac: if that made it dead, hand the frame to its children
+static void reroute_around(const uint8_t* mac, const uint8_t* frame, size_t len) {
+  s_node.reroute_around(mac, frame, len, millis());
+}
+
+// Send an already ttl-decremented frame to every child of this node
+// (critical: grandchildren too, see relay.h)
+static void forward_to_children(const char* tag, const uint8_t* frame, size_t len, uint8_t ttl,
+                                bool critical = false) {
+  vlog("[espnow] %s relay ttl=%u%s", tag, ttl, critical ? " (critical)" : "");
+  s_node.forward_to_children(tag, frame, len, critical, millis());
+}
+
+// Pass a ttl-decremented frame on: children in Unicast, one rebroadcast
+// (repeaters only) in Broadcast.
+static void relay(const char* tag, const uint8_t* frame, size_t len, uint8_t ttl,
+                  bool critical = false) {
+  if (s_delivery == Delivery::Unicast) {
+    forward_to_children(tag, frame, len, ttl, critical);
+    return;
   }
+  if (!s_repeater) return;
+  note_fwd_delay();
+  esp_err_t e = tx_send(BCAST, frame, len);
+  if (e != ESP_OK) vlog("[espnow] %s rebroadcast err=%d", tag, (int)e);
+  else             vlog("[espnow] %s rebroadcast (ttl=%u)", tag, ttl);
 }
 
 // ---------- esp-now callbacks ----------
@@ -65,152 +320,668 @@ static void on_send(const uint8_t* mac, esp_now_send_status_t status) {
     // if a forward fails, we’ll try to re-add it in tick()
     s_next_added = false;
   }
+  if (memcmp(mac, BCAST, 6) != 0) {
+    s_link_tx_cb++;
+    if (status != ESP_NOW_SEND_SUCCESS) s_link_tx_fail++;
+    // scan the table outside the lock; a swap meanwhile voids the result
+    const uint32_t now_ms = millis();
+    portENTER_CRITICAL(&s_node_mux);
+    const relay::Mac* peers = s_node.peers();
+    const size_t   num = s_node.num() < relay::Node::HEALTH_TRACK ? s_node.num() : relay::Node::HEALTH_TRACK;
+    const uint32_t gen = s_node.table_gen();
+    portEXIT_CRITICAL(&s_node_mux);
+    const int i = relay::index_in(peers, num, mac);
+    if (i >= 0) {
+      portENTER_CRITICAL(&s_node_mux);
+      if (gen == s_node.table_gen()) s_node.health_note_at((size_t)i, status == ESP_NOW_SEND_SUCCESS, now_ms);
+      portEXIT_CRITICAL(&s_node_mux);
+    }
+  }
+  const int64_t now = esp_timer_get_time();
+  bool posted = false;
+  portENTER_CRITICAL(&s_tx_mux);
+  while (s_tx_count) {
+    const TxTag t = s_tx_fifo[s_tx_head];
+    s_tx_head = (s_tx_head + 1) % TX_FIFO_SLOTS;
+    s_tx_count--;
+    if (memcmp(t.mac, mac, 6) != 0) { s_arq.note_desync(); continue; }
+    posted = s_arq.post(t.slot, t.gen, status == ESP_NOW_SEND_SUCCESS, now);
+    break;
+  }
+  portEXIT_CRITICAL(&s_tx_mux);
+  if (posted && s_rx_task) xTaskNotifyGive(s_rx_task);
   vlog("[espnow] TX to %02X:%02X:%02X:%02X:%02X:%02X status=%d",
        mac[0],mac[1],mac[2],mac[3],mac[4],mac[5], (int)status);
 }
 
-static void on_recv(const uint8_t* mac, const uint8_t* data, int len) {
-  // Always print a one-line summary so you SEE traffic and size
-  Serial.printf("[espnow] RX len=%d (Breath=34 Flicker=19 Test=18) from %02X:%02X:%02X:%02X:%02X:%02X\n",
-                len, mac[0],mac[1],mac[2],mac[3],mac[4],mac[5]);
+// ---------- cue path host (cuepath.h, rx_task) ----------
+static uint32_t path_now_ms(void*) { return millis(); }
 
-  if (len <= 0 || data == nullptr) return;
+static uint32_t path_rebase_t0(void*, uint32_t t0_ms) {
+  return rebase_t0(s_sync, t0_ms, esp_timer_get_time());
+}
 
-  // decode by the first byte (mode)
-  uint8_t mode = data[0];
-
-  switch (mode) {
-    case MODE_BREATH: {
-      if (len < (int)sizeof(BreathMsg)) { vlog("[espnow] BREATH too short"); return; }
-
-      // 1) Forward original, unrebased, to NEXT peer (if any and ttl>0)
-      if (s_idx + 1 < s_num) {
-        BreathMsg fwd; memcpy(&fwd, data, sizeof(fwd));
-        if (fwd.ttl > 0) {
-          fwd.ttl--;
-          esp_now_peer_info_t p{}; memcpy(p.peer_addr, s_peers[s_idx + 1], 6);
-          p.channel = 0; p.encrypt = false; esp_now_add_peer(&p); // idempotent
-          esp_err_t e = esp_now_send(s_peers[s_idx + 1], (const uint8_t*)&fwd, sizeof(fwd));
-          if (e != ESP_OK) vlog("[espnow] BREATH forward err=%d", (int)e);
-          else             vlog("[espnow] BREATH forwarded -> idx %u (ttl=%u)", (unsigned)(s_idx+1), fwd.ttl);
-        }
-      }
+static void path_relay(void*, const char* tag, const uint8_t* frame, size_t len, uint8_t ttl,
+                       bool critical) {
+  relay(tag, frame, len, ttl, critical);
+}
 
-      // 2) Deliver local, rebased copy to the app
-      if (s_breath_cb) {
-        BreathMsg m; memcpy(&m, data, sizeof(m));
-        m.t0_ms = rebase_t0(m.t0_ms);
-        vlog("[espnow] dispatch BREATH seq=%lu", (unsigned long)m.seq);
-        s_breath_cb(mac, m);
-      } else {
-        vlog("[espnow] BREATH callback is NULL");
-      }
-    } break;
-
-    case MODE_FLICKER: {
-      if (len < (int)sizeof(FlickerMsg)) { vlog("[espnow] FLICKER too short"); return; }
-
-      // 1) Forward original to NEXT peer (ttl--)
-      if (s_idx + 1 < s_num) {
-        FlickerMsg fwd; memcpy(&fwd, data, sizeof(fwd));
-        if (fwd.ttl > 0) {
-          fwd.ttl--;
-          esp_now_peer_info_t p{}; memcpy(p.peer_addr, s_peers[s_idx + 1], 6);
-          p.channel = 0; p.encrypt = false; esp_now_add_peer(&p); // idempotent
-          esp_err_t e = esp_now_send(s_peers[s_idx + 1], (const uint8_t*)&fwd, sizeof(fwd));
-          if (e != ESP_OK) vlog("[espnow] FLICKER forward err=%d", (int)e);
-          else             vlog("[espnow] FLICKER forwarded -> idx %u (ttl=%u)", (unsigned)(s_idx+1), fwd.ttl);
-        }
-      }
+static void path_breath(void*, const uint8_t* mac, const BreathCue& m) {
+  if (s_breath_cb) s_breath_cb(mac, m);
+  else             vlog("[espnow] BREATH callback is NULL");
+}
 
-      // 2) Local, rebased copy
-      if (s_flicker_cb) {
-        FlickerMsg m; memcpy(&m, data, sizeof(m));
-        m.t0_ms = rebase_t0(m.t0_ms);
-        vlog("[espnow] dispatch FLICKER seq=%lu", (unsigned long)m.seq);
-        s_flicker_cb(mac, m);
-      } else {
-        vlog("[espnow] FLICKER callback is NULL");
-      }
-    } break;
-
-    case MODE_TEST: {
-      if (len < (int)sizeof(TestMsg)) { vlog("[espnow] TEST too short"); return; }
-      // NOTE: TEST is forwarded by the slave *after* completing its local test.
-      if (s_test_cb) {
-        TestMsg m; memcpy(&m, data, sizeof(m));
-        m.t0_ms = rebase_t0(m.t0_ms);
-        vlog("[espnow] dispatch TEST seq=%lu ttl=%u", (unsigned long)m.seq, m.ttl);
-        s_test_cb(mac, m);
-      } else {
-        vlog("[espnow] TEST callback is NULL");
+static void path_flicker(void*, const uint8_t* mac, const FlickerMsg& m) {
+  if (s_flicker_cb) s_flicker_cb(mac, m);
+  else              vlog("[espnow] FLICKER callback is NULL");
+}
+
+static void path_test(void*, const uint8_t* mac, const TestMsg& m) {
+  if (s_test_cb) s_test_cb(mac, m);
+  else           vlog("[espnow] TEST callback is NULL");
+}
+
+static void path_resync(void*, uint8_t mode, uint32_t t0_ms) {
+  if (s_resync_cb) s_resync_cb(mode, t0_ms);
+}
+
+static void path_trace(void*, cuepath::Trace what, const char* tag, uint32_t v) {
+  switch (what) {
+    case cuepath::Trace::Stale:        vlog("[espnow] %s stale seq=%lu dropped", tag, (unsigned long)v); break;
+    case cuepath::Trace::Dispatch:     vlog("[espnow] dispatch %s seq=%lu", tag, (unsigned long)v); break;
+    case cuepath::Trace::NoCallback:   break;   // path_breath() & co. say so
+    case cuepath::Trace::Malformed:    vlog("[espnow] %s too short / malformed", tag); break;
+    case cuepath::Trace::SceneShort:   vlog("[espnow] SCENE too short"); break;
+    case cuepath::Trace::SceneSkipped: vlog("[espnow] SCENE record type 0x%02X skipped", (unsigned)v); break;
+  }
+}
+
+// Upstream for clock sync: tree/chain parent, or the master for idx 0
+static const uint8_t* upstream_mac() {
+  if (!s_node.has_table()) return nullptr;
+  if (s_node.idx() == 0) return s_have_master_mac ? s_master_mac : nullptr;
+  return s_node.peer(topology::parent(s_node.layout(), s_node.idx()));
+}
+
+// Lowest codec version on our subtree: ours, and every child's fresh report
+static uint8_t subtree_wire_ver() {
+  uint8_t v = codec::WIRE_VERSION;
+  const size_t n = s_node.child_count(s_node.idx());
+  const uint32_t now = millis();
+  for (size_t i = 0; i < n && i < WIRE_TRACK_CHILDREN; ++i) {
+    const ChildVer& c = s_child_ver[i];
+    const uint8_t cv = (c.seen && now - c.at_ms < WIRE_REPORT_MAX_AGE) ? c.ver : 0;
+    if (cv < v) v = cv;
+  }
+  return v;
+}
+
+// Also spots a child that (re)joined: its first SYNC_REQ, or a sync seq
+// that went backwards (it rebooted)
+static void note_child_ver(const uint8_t* mac, uint8_t ver, uint32_t sync_seq) {
+  const size_t first = s_node.first_child(s_node.idx());
+  const size_t n     = s_node.child_count(s_node.idx());
+  for (size_t i = 0; i < n && i < WIRE_TRACK_CHILDREN; ++i) {
+    if (memcmp(s_node.peer(first + i), mac, 6) != 0) continue;
+    ChildVer& c = s_child_ver[i];
+    if (!c.seen || (int32_t)(sync_seq - c.sync_seq) < 0) s_node.child_joined();
+    c.ver      = ver;
+    c.at_ms    = millis();
+    c.sync_seq = sync_seq;
+    c.seen     = true;
+    return;
+  }
+}
+
+// ---------- link telemetry sweep ----------
+static LinkEntry own_entry() {
+  LinkEntry e{};
+  const uint32_t cb   = s_link_tx_cb   - s_link_prev_cb;
+  const uint32_t fail = s_link_tx_fail - s_link_prev_fail;
+  const uint32_t gave = s_arq.stats().gave_up - s_link_prev_gave_up;
+  s_link_prev_cb += cb; s_link_prev_fail += fail; s_link_prev_gave_up += gave;
+
+  e.idx       = (uint8_t)s_node.idx();
+  e.rssi      = s_up_rssi;
+  e.loss_pct  = cb ? (uint8_t)((fail * 100 + cb / 2) / cb) : 0;
+  e.gave_up   = gave > 255 ? 255 : (uint8_t)gave;
+  e.srtt_10us = s_arq.srtt_us() / 10 > 0xFFFF ? 0xFFFF : (uint16_t)(s_arq.srtt_us() / 10);
+  e.fwd_p50   = s_fwd_hist.percentile(50);
+  e.fwd_p99   = s_fwd_hist.percentile(99);
+  s_fwd_hist.reset();
+  return e;
+}
+
+static void sweep_add(const LinkEntry* e, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (s_sweep.count >= registry::MAX_NODES) { s_sweep.flags |= STATS_F_TRUNCATED; return; }
+    s_sweep.e[s_sweep.count++] = e[i];
+  }
+}
+
+// STATS_PER_FRAME entries per frame, STATS_F_MORE on all but the last
+static void sweep_finish() {
+  uint8_t buf[ESP_NOW_MAX_DATA_LEN];
+  add_peer(s_sweep.up_mac);
+  size_t off = 0;
+  do {
+    const size_t n = (s_sweep.count - off < STATS_PER_FRAME) ? s_sweep.count - off : STATS_PER_FRAME;
+    const bool more = off + n < s_sweep.count;
+    StatsHdr h{};
+    h.mode  = MODE_STATS;
+    h.kind  = STATS_REPORT;
+    h.count = (uint8_t)n;
+    h.seq   = s_sweep.seq;
+    h.flags = s_sweep.flags | (more ? STATS_F_MORE : 0);
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), &s_sweep.e[off], n * sizeof(LinkEntry));
+    tx_send(s_sweep.up_mac, buf, sizeof(h) + n * sizeof(LinkEntry));
+    off += n;
+  } while (off < s_sweep.count);
+  vlog("[espnow] STATS report seq=%lu entries=%u frames=%u%s", (unsigned long)s_sweep.seq,
+       (unsigned)s_sweep.count, (unsigned)((s_sweep.count + STATS_PER_FRAME - 1) / STATS_PER_FRAME),
+       s_sweep.waiting ? " (children missing)" : "");
+  s_sweep.active = false;
+}
+
+static void on_stats(const uint8_t* mac, const uint8_t* data, int len, int64_t t_rx) {
+  if (len < (int)sizeof(StatsHdr)) return;
+  StatsHdr h; memcpy(&h, data, sizeof(h));
+
+  if (h.kind == STATS_REQ) {
+    if (h.seq == s_last_sweep_seq) return;   // duplicate
+    if (s_sweep.active) sweep_finish();      // a new sweep overtakes the old one
+    s_last_sweep_seq = h.seq;
+
+    s_sweep.active = true;
+    s_sweep.seq    = h.seq;
+    s_sweep.count  = 0;
+    s_sweep.flags  = 0;
+    memcpy(s_sweep.up_mac, mac, 6);
+    s_sweep.deadline_us = t_rx + (int64_t)(h.budget_ms > STATS_HOP_MARGIN_MS / 2
+                                           ? h.budget_ms - STATS_HOP_MARGIN_MS / 2 : 0) * 1000;
+    const LinkEntry self = own_entry();
+    sweep_add(&self, 1);
+
+    const size_t first = s_node.first_child(s_node.idx());
+    const size_t n     = s_node.child_count(s_node.idx());
+    s_sweep.waiting = 0;
+    if (h.ttl > 0 && h.budget_ms > 2 * STATS_HOP_MARGIN_MS) {
+      StatsHdr q = h;
+      q.ttl--;
+      q.budget_ms = h.budget_ms - STATS_HOP_MARGIN_MS;
+      for (size_t i = 0; i < n; ++i) {
+        add_peer(s_node.peer(first + i));
+        if (tx_send(s_node.peer(first + i), (const uint8_t*)&q, sizeof(q)) == ESP_OK) s_sweep.waiting++;
       }
-    } break;
+    }
+    if (!s_sweep.waiting) sweep_finish();
+    return;
+  }
+
+  if (h.kind == STATS_REPORT && s_sweep.active && h.seq == s_sweep.seq) {
+    const size_t n = ((size_t)len - sizeof(h)) / sizeof(LinkEntry);
+    LinkEntry e[STATS_PER_FRAME];
+    const size_t take = h.count < n ? h.count : n;
+    memcpy(e, data + sizeof(h), take * sizeof(LinkEntry));
+    sweep_add(e, take);
+    s_sweep.flags |= h.flags & STATS_F_TRUNCATED;
+    if (h.flags & STATS_F_MORE) return;     // that child is not done yet
+    if (s_sweep.waiting) s_sweep.waiting--;
+    if (!s_sweep.waiting) sweep_finish();
+  }
+}
+
+// rx_task: report with what we have once the budget runs out
+static void sweep_service() {
+  if (s_sweep.active && esp_timer_get_time() >= s_sweep.deadline_us) sweep_finish();
+}
+
+#if COMMS_LINK_RSSI
+// ESP-NOW rides on 802.11 action frames; the receive callback has no RSSI,
+// so sniff management frames and keep the level of our upstream's.
+static void on_promisc(void* buf, wifi_promiscuous_pkt_type_t type) {
+  if (type != WIFI_PKT_MGMT) return;
+  const wifi_promiscuous_pkt_t* p = (const wifi_promiscuous_pkt_t*)buf;
+  const uint8_t* hdr = p->payload;
+  if ((hdr[0] & 0xFC) != 0xD0) return;   // action frame
+  const uint8_t* up = upstream_mac();
+  if (!up || memcmp(hdr + 10, up, 6) != 0) return;   // addr2 = transmitter
+  const int8_t r = (int8_t)p->rx_ctrl.rssi;
+  s_up_rssi = s_up_rssi ? (int8_t)((3 * s_up_rssi + r) / 4) : r;
+}
+#endif
+
+// ---------- enrollment ----------
+// Take over a table that lists us; false (and not enrolled) otherwise
+static bool adopt_table(const registry::Table& t) {
+  const int idx = registry::index_of(t, s_my_mac);
+  portENTER_CRITICAL(&s_node_mux);   // s_table backs the peers health_note() reads
+  if (idx < 0) {
+    s_node.set_table(nullptr, 0, 0);
+  } else {
+    s_table = t;
+    s_node.set_table(s_table.mac, s_table.count, (size_t)idx);   // new children
+  }
+  portEXIT_CRITICAL(&s_node_mux);
+  if (idx < 0) return false;
+  memset(s_child_ver, 0, sizeof(s_child_ver));
+  if (!s_enrolled_ms) s_enrolled_ms = millis() - s_init_ms;
+  try_add_next_peer();
+  LOGI("[espnow] node table epoch %lu: idx %u of %u (%lu ms after init)",
+       (unsigned long)t.epoch, (unsigned)s_node.idx(), (unsigned)s_node.num(), (unsigned long)s_enrolled_ms);
+  return true;
+}
+
+static void send_announce(uint32_t now) {
+  EnrollHdr a{};
+  a.mode  = MODE_ENROLL;
+  a.kind  = ENROLL_ANNOUNCE;
+  a.epoch = s_table.epoch;
+  add_peer(BCAST);
+  tx_send(BCAST, (const uint8_t*)&a, sizeof(a));
+  const uint32_t period = (now - s_init_ms < ANNOUNCE_FAST_FOR_MS) ? ANNOUNCE_FAST_MS : ANNOUNCE_SLOW_MS;
+  s_next_announce_ms = now + period + (esp_random() % 100);   // jitter: many nodes boot together
+}
+
+// Relay our table to the children, every part with the given ttl
+static void forward_table(uint8_t ttl) {
+  uint8_t fwd[ESP_NOW_MAX_DATA_LEN];
+  for (size_t p = 0; p < registry::parts(s_table); ++p) {
+    const size_t n = registry::encode(s_table, p, ttl, fwd, sizeof(fwd));
+    if (n) forward_to_children("TABLE", fwd, n, ttl);
+  }
+}
+
+// ENROLL_TABLE part: once all parts of a newer table (or any, if we have
+// none) are in, adopt it, store it and pass it on
+static void on_enroll(const uint8_t* data, int len) {
+  if (!s_use_registry || len < (int)sizeof(EnrollHdr)) return;
+  EnrollHdr h; memcpy(&h, data, sizeof(h));
+  if (s_node.has_table() && h.epoch <= s_table.epoch) return;   // have it (also stops loops)
+  if (s_table_in.add(data, len) != registry::Assembler::Complete) return;
+  const registry::Table& t = s_table_in.table();
+  if (adopt_table(t)) registry::save(t);
+  else                s_table.epoch = t.epoch;       // dropped from the table: announce again
+  if (h.ttl > 0 && s_node.has_table()) forward_table(h.ttl - 1);
+}
+
+static void send_sync_req() {
+  const uint8_t* up = upstream_mac();
+  if (!up) return;
+  add_peer(up);
+  SyncMsg q{};
+  q.mode  = MODE_SYNC;
+  q.kind  = SYNC_REQ;
+  q.wire_ver = subtree_wire_ver();
+  q.seq   = ++s_sync_seq;
+  q.t1_us = esp_timer_get_time();
+  tx_send(up, (const uint8_t*)&q, sizeof(q));
+}
+
+static void on_sync(const uint8_t* mac, const uint8_t* data, int len, int64_t t_rx) {
+  if (len < (int)sizeof(SyncMsg)) return;
+  SyncMsg m; memcpy(&m, data, sizeof(m));
+
+  if (m.kind == SYNC_REQ) {
+    note_child_ver(mac, m.wire_ver, m.seq);
+    // Answer a downstream node on our estimate of master time
+    m.kind   = SYNC_RESP;
+    m.synced = s_sync.synced() ? 1 : 0;
+    m.t2_us  = s_sync.to_master(t_rx);
+    add_peer(mac);
+    m.t3_us  = s_sync.to_master(esp_timer_get_time());
+    tx_send(mac, (const uint8_t*)&m, sizeof(m));
+    return;
+  }
+
+  const uint8_t* up = upstream_mac();
+  if (m.kind != SYNC_RESP || !m.synced || m.seq != s_sync_seq || !up || memcmp(mac, up, 6) != 0) return;
+  const bool was_synced = s_sync.synced();
+  s_sync_exchanges++;
+  if (!s_sync.add_sample(m.t1_us, m.t2_us, m.t3_us, t_rx)) s_sync_rejected++;
+  if (!was_synced && s_sync.synced()) {
+    LOGI("[espnow] clock synced: rtt=%ld us err=%ld us", (long)s_sync.rtt_us(), (long)s_sync.error_us());
+  }
+  vlog("[espnow] SYNC rtt=%ld err=%ld skew=%ld ppb", (long)s_sync.rtt_us(),
+       (long)s_sync.error_us(), (long)s_sync.skew_ppb());
+}
+
+// Decode + forward + dispatch one frame (rx_task context)
+static void handle_frame(const uint8_t* mac, const uint8_t* data, int len, int64_t t_rx) {
+  s_cur_rx_us = t_rx;
+  // One-line summary so you SEE traffic and size
+  vlog("[espnow] RX len=%d (Breath=34 Flicker=19 Test=18) from %02X:%02X:%02X:%02X:%02X:%02X",
+       len, mac[0],mac[1],mac[2],mac[3],mac[4],mac[5]);
+
+  if (len <= 0 || data == nullptr) return;
+
+  // idx 0 is fed by the master: remember it as our clock-sync upstream
+  if (s_node.has_table() && s_node.idx() == 0 && !s_have_master_mac &&
+      cuepath::is_cue_frame(data, len) && !cuepath::is_opaque(data, len)) {
+    memcpy(s_master_mac, mac, 6);
+    s_have_master_mac = true;
+  }
+
+  // cues, scenes and frames of newer codec versions (cuepath.h)
+  if (s_path.handle(mac, data, len)) return;
+
+  switch (data[0]) {
+    case MODE_SYNC:    on_sync(mac, data, len, t_rx); break;
+    case MODE_STATS:   on_stats(mac, data, len, t_rx); break;
+    case MODE_ENROLL:  if (data[1] == ENROLL_TABLE) on_enroll(data, len); break;
 
     default:
-      vlog("[espnow] Unknown mode byte: %u", (unsigned)mode);
+      vlog("[espnow] Unknown mode byte: %u", (unsigned)data[0]);
       break;
   }
 }
 
+// WiFi task: copy and hand off, nothing that can block
+static void on_recv(const uint8_t* mac, const uint8_t* data, int len) {
+  const int64_t t_in = esp_timer_get_time();
+  s_rx_stats.received++;
+
+  if (len <= 0 || data == nullptr || len > ESP_NOW_MAX_DATA_LEN) {
+    s_rx_stats.rejected++;
+    return;
+  }
+  RxFrame* f = s_rx_ring.claim();
+  if (!f) {
+    s_rx_stats.dropped++;
+  } else {
+    memcpy(f->mac, mac, 6);
+    f->len  = (uint8_t)len;
+    f->t_us = t_in;
+    memcpy(f->data, data, len);
+    s_rx_ring.publish();
+    const uint32_t depth = (uint32_t)s_rx_ring.size();
+    if (depth > s_rx_stats.depth_max) s_rx_stats.depth_max = depth;
+    if (s_rx_task) xTaskNotifyGive(s_rx_task);
+  }
+
+  const uint32_t dt = (uint32_t)(esp_timer_get_time() - t_in);
+  if (dt > s_rx_stats.cb_us_max) s_rx_stats.cb_us_max = dt;
+  s_rx_cb_us_sum += dt;
+}
+
+// forward() (loop()) hands unicast frames to rx_task, which owns s_node
+static const size_t APP_TX_SLOTS = 4;
+struct AppFrame { uint8_t len; uint8_t data[ESP_NOW_MAX_DATA_LEN]; };
+static AppFrame     s_app_tx[APP_TX_SLOTS];
+static size_t       s_app_head = 0, s_app_count = 0;
+static portMUX_TYPE s_app_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void app_tx_service() {
+  AppFrame f;
+  for (;;) {
+    portENTER_CRITICAL(&s_app_mux);
+    const bool have = s_app_count > 0;
+    if (have) {
+      f = s_app_tx[s_app_head];
+      s_app_head = (s_app_head + 1) % APP_TX_SLOTS;
+      s_app_count--;
+    }
+    portEXIT_CRITICAL(&s_app_mux);
+    if (!have) return;
+    s_cur_rx_us = 0;   // not relayed: no forwarding delay sample
+    s_node.forward_to_children("APP", f.data, f.len, false, millis());
+  }
+}
+
+// Sleep until notified, or until the next ARQ / sweep deadline
+static TickType_t rx_wait_ticks() {
+  int64_t next = s_arq.next_us();
+  if (s_sweep.active && s_sweep.deadline_us < next) next = s_sweep.deadline_us;
+  if (next == INT64_MAX) return portMAX_DELAY;
+  const int64_t dt = next - esp_timer_get_time();
+  return dt <= 0 ? 0 : pdMS_TO_TICKS(dt / 1000) + 1;
+}
+
+static void rx_task(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, rx_wait_ticks());
+    while (const RxFrame* f = s_rx_ring.front()) {
+      handle_frame(f->mac, f->data, f->len, f->t_us);
+      s_rx_ring.release();
+    }
+    app_tx_service();
+    s_arq.service(esp_timer_get_time());
+    sweep_service();
+  }
+}
+
 // ---------- public API ----------
+static bool start_radio() {
+  WiFi.mode(WIFI_STA);
+  WiFi.macAddress(s_my_mac);
+  s_init_ms = millis();
+  if (esp_now_init() != ESP_OK) {
+    LOGE("[espnow] init error");
+    return false;
+  }
+  if (esp_wifi_config_espnow_rate(WIFI_IF_STA, COMMS_ESPNOW_RATE) != ESP_OK) {
+    LOGW("[espnow] PHY rate %d refused, driver default", (int)COMMS_ESPNOW_RATE);
+  }
+  if (!s_tx_lock) s_tx_lock = xSemaphoreCreateMutex();
+  if (!s_peer_lock) s_peer_lock = xSemaphoreCreateMutex();
+  s_peer_cache.clear();   // fresh esp_now_init(): nothing registered
+  s_node.set_sink({ relay_sink, nullptr });
+  s_arq.set_radio({ arq_radio_send, arq_gave_up, arq_lock, arq_unlock, nullptr });
+  s_arq.set_fwd_hist(&s_fwd_hist);
+  s_path.set_node(&s_node);
+  s_path.set_host({ path_now_ms, path_rebase_t0, path_relay, path_breath, path_flicker, path_test,
+                    path_resync, path_trace, nullptr });
+  if (!s_rx_task) {
+    xTaskCreatePinnedToCore(rx_task, "espnow_rx", RX_TASK_STACK, nullptr,
+                            RX_TASK_PRIO, &s_rx_task, RX_TASK_CORE);
+  }
+  esp_now_register_send_cb(on_send);
+  esp_now_register_recv_cb(on_recv);
+  if (s_delivery == Delivery::Broadcast) add_peer(BCAST);
+
+#if COMMS_LINK_RSSI
+  wifi_promiscuous_filter_t filt{};
+  filt.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+  esp_wifi_set_promiscuous_filter(&filt);
+  esp_wifi_set_promiscuous_rx_cb(on_promisc);
+  esp_wifi_set_promiscuous(true);
+#endif
+  return true;
+}
+
+static void print_boot() {
+  if (s_node.has_table()) {
+    LOGI("[espnow] my idx: %u (hop depth %u, %s)", (unsigned)s_node.idx(),
+         (unsigned)topology::hop_depth(s_node.layout(), s_node.idx()),
+         s_node.layout().kind == topology::Kind::Tree ? "tree" : "chain");
+  } else {
+    LOGI("[espnow] not enrolled: announcing to the master");
+  }
+  LOGI("[espnow] my MAC: %02X:%02X:%02X:%02X:%02X:%02X",
+       s_my_mac[0], s_my_mac[1], s_my_mac[2], s_my_mac[3], s_my_mac[4], s_my_mac[5]);
+  LOGI("[espnow] callbacks: breath=%p flicker=%p test=%p",
+       (void*)s_breath_cb, (void*)s_flicker_cb, (void*)s_test_cb);
+}
+
 void init(const uint8_t (*peers)[6], size_t num_peers, size_t my_index,
           breath_cb_t bcb, flicker_cb_t fcb, test_cb_t tcb)
 {
-  s_peers = peers; s_num = num_peers; s_idx = my_index;
+  portENTER_CRITICAL(&s_node_mux);
+  s_node.set_table(peers, num_peers, my_index);
+  portEXIT_CRITICAL(&s_node_mux);
   s_breath_cb  = bcb;
   s_flicker_cb = fcb;
   s_test_cb    = tcb;
 
-  WiFi.mode(WIFI_STA);
-  if (esp_now_init() != ESP_OK) {
-    Serial.println("[espnow] init error");
-    return;
-  }
-  esp_now_register_send_cb(on_send);
-  esp_now_register_recv_cb(on_recv);
-
+  if (!start_radio()) return;
   try_add_next_peer();
+  s_enrolled_ms = millis() - s_init_ms;
+  print_boot();
+}
 
-  Serial.printf("[espnow] my idx: %u\n", (unsigned)s_idx);
-  Serial.printf("[espnow] my MAC: %s\n", WiFi.macAddress().c_str());
-  Serial.printf("[espnow] callbacks: breath=%p flicker=%p test=%p\n",
-                (void*)s_breath_cb, (void*)s_flicker_cb, (void*)s_test_cb);
+void init(const registry::Table& table,
+          breath_cb_t bcb, flicker_cb_t fcb, test_cb_t tcb)
+{
+  s_use_registry = true;
+  s_breath_cb  = bcb;
+  s_flicker_cb = fcb;
+  s_test_cb    = tcb;
+
+  if (!start_radio()) return;
+  adopt_table(table);
+  if (!s_node.has_table()) send_announce(millis());
+  print_boot();
 }
 
 void tick() {
   uint32_t now = millis();
+  if (s_use_registry && !s_node.has_table() && (int32_t)(now - s_next_announce_ms) >= 0) send_announce(now);
+
   if (!s_next_added && (now - s_last_try_ms) > 2000) {
     s_last_try_ms = now;
-    if (s_idx + 1 < s_num) {
-      esp_now_del_peer(s_peers[s_idx + 1]); // ignore result
-    }
+    uint8_t macs[MAX_CHILD_PEERS][6];
+    const size_t n = child_macs(macs, MAX_CHILD_PEERS);
+    for (size_t i = 0; i < n; ++i) drop_peer(macs[i]);
     try_add_next_peer();
   }
+
+  const uint32_t sync_period = s_sync.synced() ? SYNC_PERIOD_MS : SYNC_FAST_PERIOD_MS;
+  if (now - s_last_sync_ms >= sync_period) {
+    s_last_sync_ms = now;
+    send_sync_req();
+  }
 }
 
 bool send_to_index(size_t idx, const void* buf, size_t len) {
-  if (!s_peers || idx >= s_num) return false;
-  // Ensure peer exists (idempotent)
-  esp_now_peer_info_t p{};
-  memcpy(p.peer_addr, s_peers[idx], 6);
-  p.channel = 0;
-  p.encrypt = false;
-  esp_now_add_peer(&p); // OK if already present
-  esp_err_t e = esp_now_send(s_peers[idx], (const uint8_t*)buf, len);
+  uint8_t mac[6];
+  portENTER_CRITICAL(&s_node_mux);
+  const bool have = s_node.has_table() && idx < s_node.num();
+  if (have) memcpy(mac, s_node.peer(idx), 6);
+  portEXIT_CRITICAL(&s_node_mux);
+  if (!have || !add_peer(mac)) return false;
+  esp_err_t e = tx_send(mac, (const uint8_t*)buf, len);
   if (e != ESP_OK) {
     vlog("[espnow] send_to_index %u failed err=%d", (unsigned)idx, (int)e);
   }
   return e == ESP_OK;
 }
 
+bool forward(const void* buf, size_t len) {
+  if (!s_node.has_table() || len == 0 || len > ESP_NOW_MAX_DATA_LEN) return false;
+  if (s_delivery == Delivery::Broadcast) {
+    if (!s_repeater) return true;   // everyone in range already has it
+    return tx_send(BCAST, (const uint8_t*)buf, len) == ESP_OK;
+  }
+  // rx_task relays it like a cue (ARQ, dead children skipped up to the
+  // skip window), see app_tx_service()
+  bool queued = false;
+  portENTER_CRITICAL(&s_app_mux);
+  if (s_app_count < APP_TX_SLOTS) {
+    AppFrame& f = s_app_tx[(s_app_head + s_app_count++) % APP_TX_SLOTS];
+    f.len = (uint8_t)len;
+    memcpy(f.data, buf, len);
+    queued = true;
+  }
+  portEXIT_CRITICAL(&s_app_mux);
+  if (queued && s_rx_task) xTaskNotifyGive(s_rx_task);
+  return queued;
+}
+
+void set_topology(Topology t, uint8_t fanout) {
+  portENTER_CRITICAL(&s_node_mux);
+  s_node.set_layout(t, fanout);
+  portEXIT_CRITICAL(&s_node_mux);
+  if (s_node.has_table()) try_add_next_peer(); // already running: register the new children
+}
+
+void set_delivery(Delivery d) {
+  s_delivery = d;
+  if (s_node.has_table() && d == Delivery::Broadcast) add_peer(BCAST);
+}
+
+void set_repeater(bool on) { s_repeater = on; }
+
+void set_refresh_forward_ms(uint32_t ms) { s_node.set_refresh_forward_ms(ms); }
+void set_resync_cb(resync_cb_t cb) { s_resync_cb = cb; }
+DedupStats dedup_stats() { return s_node.dedup(); }
+
+size_t hop_depth() { return topology::hop_depth(s_node.layout(), s_node.idx()); }
+
+void set_master_mac(const uint8_t mac[6]) {
+  memcpy(s_master_mac, mac, 6);
+  s_have_master_mac = true;
+}
+
+SyncStatus sync_status() {
+  SyncStatus st{};
+  st.synced    = s_sync.synced();
+  st.offset_ms = (int32_t)(s_sync.offset_us() / 1000);
+  st.skew_ppb  = s_sync.skew_ppb();
+  st.rtt_us    = s_sync.rtt_us();
+  st.error_us  = s_sync.error_us();
+  st.exchanges = s_sync_exchanges;
+  st.rejected  = s_sync_rejected;
+  return st;
+}
+
+WireStats wire_stats() {
+  const cuepath::WireCount w = s_path.wire();
+  WireStats st{};
+  st.legacy      = w.legacy;
+  st.compact     = w.compact;
+  st.opaque      = w.opaque;
+  st.bad         = w.bad;
+  st.subtree_ver = subtree_wire_ver();
+  return st;
+}
+
+void set_arq_tries(uint8_t n) { s_arq.set_tries(n); }
+
+void set_skip_window(uint8_t levels) {
+  portENTER_CRITICAL(&s_node_mux);
+  s_node.set_skip_window(levels);
+  portEXIT_CRITICAL(&s_node_mux);
+}
+
+HealStats heal_stats() { return s_node.heal(); }
+
+ArqStats arq_stats() { return s_arq.stats(); }
+
+PeerStats peer_stats() {
+  if (s_peer_lock) xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+  const auto c = s_peer_cache.stats();
+  if (s_peer_lock) xSemaphoreGive(s_peer_lock);
+  PeerStats st{};
+  st.hits       = c.hits;
+  st.misses     = c.misses;
+  st.evictions  = c.evictions;
+  st.forced     = c.forced;
+  st.add_errors = s_peer_add_errors;
+  st.stale      = s_peer_cache_stale;
+  st.used       = c.used;
+  st.capacity   = (uint8_t)s_peer_cache.capacity();
+  return st;
+}
+
+RxStats rx_stats() {
+  RxStats st = s_rx_stats;
+  st.depth     = (uint32_t)s_rx_ring.size();
+  const uint32_t handled = st.received - st.rejected;
+  st.cb_us_avg = handled ? (uint32_t)(s_rx_cb_us_sum / handled) : 0;
+  return st;
+}
+
 void set_verbose(bool v) { s_verbose = v; }
 
-size_t my_index() { return s_idx; }
+size_t my_index() { return s_node.idx(); }
+
+bool enrolled() { return s_node.has_table(); }
+uint32_t enrolled_ms() { return s_enrolled_ms; }
 
 const uint8_t* mac_of(size_t idx) {
-  if (!s_peers || idx >= s_num) return nullptr;
-  return s_peers[idx];
+  if (!s_node.has_table() || idx >= s_node.num()) return nullptr;
+  return s_node.peer(idx);
 }
 
 } // namespace espnow
@@ -2,18 +2,130 @@
 #include <Arduino.h>
 #include <esp_now.h>
 #include <WiFi.h>
+#include <esp_wifi.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <message.h>   // lives in <project>/include
+#include "topology.h"
+#include "relay.h"
+#include "arq.h"
+#include "registry.h"
+
+// Link RSSI for the telemetry sweep comes from a promiscuous management-frame
+// sniffer. It runs for the whole uptime and costs WiFi-task time on every
+// management frame, so it is off by default (the sweep reports rssi 0 =
+// unknown); build with -D COMMS_LINK_RSSI=1 while surveying links.
+#ifndef COMMS_LINK_RSSI
+#define COMMS_LINK_RSSI 0
+#endif
+
+// Peers kept registered with the driver at once (its limit is 20, fewer with
+// encryption); more MACs are served by LRU eviction.
+#ifndef COMMS_PEER_SLOTS
+#define COMMS_PEER_SLOTS 16
+#endif
+
+// PHY rate of every ESP-NOW send (wifi_phy_rate_t). The driver default,
+// 1 Mbps long preamble, reaches furthest but takes ~1.2 ms of air per
+// relayed frame: a tree relay is then bound by the channel and its fanout
+// changes nothing (test_topology). Trees build with
+// -D COMMS_ESPNOW_RATE=WIFI_PHY_RATE_24M, the master as well.
+#ifndef COMMS_ESPNOW_RATE
+#define COMMS_ESPNOW_RATE WIFI_PHY_RATE_1M_L
+#endif
 
 namespace comms {
 namespace espnow {
 
-// App-level callbacks (called from WiFi task context, NOT an ISR)
-using breath_cb_t  = void (*)(const uint8_t from[6], const BreathMsg& rebased);
+// App-level callbacks (called from the espnow_rx task, NOT the WiFi task or
+// an ISR). They may block briefly but delay every frame queued behind them.
+// Breath cues arrive as BreathCue: brightness stays Q16 (message.h).
+using breath_cb_t  = void (*)(const uint8_t from[6], const BreathCue& rebased);
 using flicker_cb_t = void (*)(const uint8_t from[6], const FlickerMsg& rebased);
 using test_cb_t    = void (*)(const uint8_t from[6], const TestMsg&   rebased);
 
+// Called instead of the cue callback when a frame repeats the cached cue
+// (same seq and parameters, e.g. the master's periodic refresh). t0_ms is
+// the rebased start of the refresh; apps may realign the running effect's
+// phase to it but must not restart it.
+using resync_cb_t  = void (*)(uint8_t mode, uint32_t t0_ms);
+
+// Cue cache counters (relay.h)
+using DedupStats = relay::DedupStats;
+
+// Relay layout: Chain (idx -> idx+1) or Tree (k-ary, idx -> k*idx+1 .. k*idx+k).
+// All nodes must agree; the master always sends to idx 0.
+using Topology = topology::Kind;
+
+// Delivery: Unicast relays hop by hop along the topology. Broadcast expects
+// the master to send one frame to FF:FF:FF:FF:FF:FF; every node in range
+// applies it directly and only repeaters rebroadcast it (ttl--). Copies are
+// dropped by the per-mode cue cache (see DedupStats).
+enum class Delivery : uint8_t { Unicast, Broadcast };
+
+// MODE_SCENE frames are cached and relayed as one frame; each record then
+// reaches the matching callback above with the scene's common t0_ms.
+
+// Receive-path counters. The WiFi callback only copies frames into a
+// fixed ring; a dedicated task decodes, forwards and dispatches.
+struct RxStats {
+  uint32_t received;    // frames seen by the WiFi callback
+  uint32_t rejected;    // empty / oversize frames
+  uint32_t dropped;     // ring full
+  uint32_t depth;       // frames waiting now
+  uint32_t depth_max;   // high-water mark
+  uint32_t cb_us_max;   // WiFi callback execution time
+  uint32_t cb_us_avg;
+};
+
+// Clock sync with the upstream node (see clocksync.h). Once synced, cue
+// t0_ms values (master millis()) are converted exactly to local millis().
+struct SyncStatus {
+  bool     synced;
+  int32_t  offset_ms;   // master - local
+  int32_t  skew_ppb;    // drift of master vs local clock
+  int32_t  rtt_us;      // best round trip to upstream in the window
+  int32_t  error_us;    // estimated bound on master->local conversion error
+  uint32_t exchanges;   // responses received
+  uint32_t rejected;    // responses skipped by the delay filter
+};
+
+// Cue frames arrive as legacy structs or compact codec frames (codec.h) and
+// reach the same callbacks. Each node reports in its SYNC_REQ the lowest
+// codec version its subtree decodes; the master only sends compact frames
+// once slave 0 reports >= 1.
+struct WireStats {
+  uint32_t legacy;       // cue frames as packed structs
+  uint32_t compact;      // cue frames decoded from the compact codec
+  uint32_t opaque;       // compact frames we cannot decode, relayed as is
+  uint32_t bad;          // truncated / malformed
+  uint8_t  subtree_ver;  // version reported upstream right now
+};
+
+// Hop-by-hop ARQ for relayed cues (Unicast only; broadcast has no acks),
+// see arq.h
+using ArqStats = arq::Stats;
+
+// Self-healing relay counters (relay.h)
+using HealStats = relay::HealStats;
+
+// Peer registrations: send paths register a MAC on first use and keep the
+// COMMS_PEER_SLOTS most recently used ones; a hit makes no driver call.
+struct PeerStats {
+  uint32_t hits;
+  uint32_t misses;       // registered on demand
+  uint32_t evictions;    // least recently used peer removed to make room
+  uint32_t forced;       // ...although it had been used within 100 ms
+  uint32_t add_errors;   // esp_now_add_peer() refused
+  uint32_t stale;        // send found its peer gone, re-registered
+  uint8_t  used;
+  uint8_t  capacity;
+};
+
+// MODE_STATS sweeps (message.h) are answered automatically: each node adds a
+// LinkEntry (upstream RSSI, loss / ARQ drops / srtt towards its children,
+// relay delay percentiles) and merges its children's reports into one.
+
 // Initialize ESP-NOW for a daisy chain.
 // - peers: pointer to a [N][6] MAC table (not copied; must remain valid)
 // - num_peers: number of peers
@@ -22,17 +134,65 @@ using test_cb_t    = void (*)(const uint8_t from[6], const TestMsg&   rebased);
 void init(const uint8_t (*peers)[6], size_t num_peers, size_t my_index,
           breath_cb_t bcb, flicker_cb_t fcb, test_cb_t tcb);
 
-// Keep link healthy (re-add next peer if it drops)
+// Initialize from the node registry (registry::load()): this node's index is
+// found by its MAC. With an empty table, or one that does not list us, the
+// node announces itself until the master enrolls it. Newer tables from the
+// master are adopted, saved to NVS and relayed. The table is copied.
+void init(const registry::Table& table,
+          breath_cb_t bcb, flicker_cb_t fcb, test_cb_t tcb);
+
+// Keep link healthy (re-add next peer if it drops) and run clock sync
 void tick();
 
 // Send arbitrary payload to peer by index (0..num_peers-1)
 bool send_to_index(size_t idx, const void* buf, size_t len);
 
+// Send payload to this node's downstream peers (next node, or tree children).
+// Caller decrements ttl. Unicast: queued for the espnow_rx task, which relays
+// it like a cue (ARQ, dead children skipped); false if the queue is full.
+bool forward(const void* buf, size_t len);
+
+// Select relay layout (default Chain). Call before init(), or at runtime on
+// every node. fanout is clamped to >= 2 and ignored for Chain.
+void set_topology(Topology t, uint8_t fanout = 2);
+
+// Select delivery mode (default Unicast) and whether this node rebroadcasts
+// in Broadcast mode (default off). In Broadcast, forward() only sends on
+// repeaters.
+void set_delivery(Delivery d);
+void set_repeater(bool on);
+
+// Unchanged cue repeats are forwarded at most once per ms (default 10000),
+// and right away once a child joins, reboots or comes back from dead.
+void set_refresh_forward_ms(uint32_t ms);
+void set_resync_cb(resync_cb_t cb);
+DedupStats dedup_stats();
+
+RxStats rx_stats();
+WireStats wire_stats();
+
+// Sends per relayed frame before giving up (default 4); 0 disables ARQ.
+void set_arq_tries(uint8_t n);
+ArqStats arq_stats();
+
+// Levels a relay may skip over dead nodes (default 2); 0 disables.
+void set_skip_window(uint8_t levels);
+HealStats heal_stats();
+
+PeerStats peer_stats();
+
+// idx 0 learns the master MAC from the first cue; call this to pin it.
+void set_master_mac(const uint8_t mac[6]);
+SyncStatus sync_status();
+
 // Optional: verbose logs
 void set_verbose(bool v);
 
 // Info
 size_t my_index();
+bool   enrolled();      // has a table that lists this node
+uint32_t enrolled_ms(); // init() -> usable table (boot to working chain), 0 while waiting
+size_t hop_depth();   // radio hops from the master to this node
 const uint8_t* mac_of(size_t idx);
 
 } // namespace espnow
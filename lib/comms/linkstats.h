@@ -0,0 +1,47 @@
+// lib/comms/linkstats.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Per-link latency histogram for the telemetry sweep (pure, no Arduino deps).
+// Buckets double from 250 us; the last one is open ended. Reports carry
+// bucket indices, bucket_upper_us() turns them back into a bound.
+namespace comms {
+
+class LatencyHist {
+public:
+  static const size_t   BUCKETS  = 10;
+  static const uint32_t FIRST_US = 250;   // 250, 500, 1 ms ... 64 ms, more
+
+  static uint32_t bucket_upper_us(uint8_t b) {
+    return (size_t)b + 1 >= BUCKETS ? UINT32_MAX : FIRST_US << b;
+  }
+
+  void add(uint32_t us) {
+    uint8_t b = 0;
+    while ((size_t)b + 1 < BUCKETS && us > bucket_upper_us(b)) b++;
+    n_[b]++;
+    total_++;
+  }
+
+  // Smallest bucket holding at least pct % of the samples (0 if empty)
+  uint8_t percentile(uint8_t pct) const {
+    if (!total_) return 0;
+    const uint64_t want = ((uint64_t)total_ * pct + 99) / 100;
+    uint64_t acc = 0;
+    for (uint8_t b = 0; b < BUCKETS; ++b) {
+      acc += n_[b];
+      if (acc >= want) return b;
+    }
+    return BUCKETS - 1;
+  }
+
+  uint32_t total() const { return total_; }
+  void reset() { for (size_t b = 0; b < BUCKETS; ++b) n_[b] = 0; total_ = 0; }
+
+private:
+  uint32_t n_[BUCKETS] = {};
+  uint32_t total_ = 0;
+};
+
+} // namespace comms
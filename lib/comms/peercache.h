@@ -0,0 +1,114 @@
+// lib/comms/peercache.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Bounded working set of registered ESP-NOW peers (pure, no Arduino deps).
+//
+// The driver holds ~20 peers (fewer with encryption), so a node that talks
+// to more MACs than that keeps the recently used ones registered and evicts
+// the least recently used. A hit costs a table scan, no driver call. The
+// caller does the actual esp_now_add_peer / esp_now_del_peer:
+//   PeerCache::Lookup r = cache.touch(mac, now_ms);
+//   if (r.evicted) esp_now_del_peer(r.victim);
+//   if (!r.hit && esp_now_add_peer(...) fails) cache.forget(mac);
+// Entries used within HOLD_MS are only evicted when every slot is that
+// fresh, so a frame just handed to the radio keeps its peer.
+namespace comms {
+
+template <size_t N>
+class PeerCache {
+public:
+  static const uint32_t HOLD_MS = 100;
+
+  struct Lookup {
+    bool    hit;
+    bool    evicted;
+    uint8_t victim[6];   // valid if evicted
+  };
+
+  struct Stats {
+    uint32_t hits;
+    uint32_t misses;      // registrations (driver add)
+    uint32_t evictions;   // driver del to make room
+    uint32_t forced;      // evictions of an entry younger than HOLD_MS
+    uint8_t  used;
+  };
+
+  Lookup touch(const uint8_t mac[6], uint32_t now_ms) {
+    Lookup r{};
+    const int i = find(mac);
+    if (i >= 0) {
+      e_[i].used_ms = now_ms;
+      e_[i].tick    = ++tick_;
+      r.hit = true;
+      stats_.hits++;
+      return r;
+    }
+    stats_.misses++;
+    size_t slot = N;
+    for (size_t k = 0; k < N; ++k) if (!e_[k].valid) { slot = k; break; }
+    if (slot == N) {
+      slot = victim(now_ms);
+      r.evicted = true;
+      memcpy(r.victim, e_[slot].mac, 6);
+      stats_.evictions++;
+      if (now_ms - e_[slot].used_ms < HOLD_MS) stats_.forced++;
+    }
+    Entry& e = e_[slot];
+    memcpy(e.mac, mac, 6);
+    e.used_ms = now_ms;
+    e.tick    = ++tick_;
+    e.valid   = true;
+    return r;
+  }
+
+  // Drop an entry (driver refused it, or it was deleted behind our back)
+  bool forget(const uint8_t mac[6]) {
+    const int i = find(mac);
+    if (i < 0) return false;
+    e_[i].valid = false;
+    return true;
+  }
+
+  bool contains(const uint8_t mac[6]) const { return find(mac) >= 0; }
+
+  void clear() { for (size_t k = 0; k < N; ++k) e_[k].valid = false; }
+
+  Stats stats() const {
+    Stats st = stats_;
+    st.used = 0;
+    for (size_t k = 0; k < N; ++k) st.used += e_[k].valid ? 1 : 0;
+    return st;
+  }
+
+  static size_t capacity() { return N; }
+
+private:
+  struct Entry { uint8_t mac[6]; bool valid; uint32_t used_ms; uint32_t tick; };
+
+  int find(const uint8_t mac[6]) const {
+    for (size_t k = 0; k < N; ++k) {
+      if (e_[k].valid && memcmp(e_[k].mac, mac, 6) == 0) return (int)k;
+    }
+    return -1;
+  }
+
+  // LRU among entries past HOLD_MS; plain LRU if there are none
+  size_t victim(uint32_t now_ms) const {
+    size_t best = N, any = 0;
+    for (size_t k = 0; k < N; ++k) {
+      if ((int32_t)(e_[k].tick - e_[any].tick) < 0) any = k;
+      if (now_ms - e_[k].used_ms < HOLD_MS) continue;
+      if (best == N || (int32_t)(e_[k].tick - e_[best].tick) < 0) best = k;
+    }
+    return best == N ? any : best;
+  }
+
+  Entry    e_[N] = {};
+  uint32_t tick_ = 0;
+  Stats    stats_ = {};
+};
+
+} // namespace comms
@@ -0,0 +1,43 @@
+#include "registry.h"
+#include <Arduino.h>
+#include <Preferences.h>
+
+namespace comms {
+namespace registry {
+
+static const char* NVS_NS = "nodes";
+
+bool load(Table& t) {
+  Preferences p;
+  if (!p.begin(NVS_NS, true)) return false;
+  const uint8_t count = p.getUChar("count", 0);
+  const uint32_t epoch = p.getUInt("epoch", 0);
+  bool ok = count > 0 && count <= MAX_NODES &&
+            p.getBytesLength("macs") == (size_t)count * 6;
+  if (ok) ok = p.getBytes("macs", t.mac, (size_t)count * 6) == (size_t)count * 6;
+  p.end();
+  if (!ok) return false;
+  t.count = count;
+  t.epoch = epoch;
+  return true;
+}
+
+bool save(const Table& t) {
+  Preferences p;
+  if (!p.begin(NVS_NS, false)) return false;
+  bool ok = p.putBytes("macs", t.mac, (size_t)t.count * 6) == (size_t)t.count * 6;
+  ok &= p.putUChar("count", t.count) == 1;
+  ok &= p.putUInt("epoch", t.epoch) == 4;
+  p.end();
+  return ok;
+}
+
+void clear() {
+  Preferences p;
+  if (!p.begin(NVS_NS, false)) return;
+  p.clear();
+  p.end();
+}
+
+} // namespace registry
+} // namespace comms
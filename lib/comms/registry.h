@@ -0,0 +1,109 @@
+// lib/comms/registry.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <message.h>
+
+// Node table shared by master and slaves: the ordered MAC list that defines
+// every node's index, persisted in NVS and carried by ENROLL_TABLE frames.
+// Everything but the NVS calls is pure (no Arduino deps).
+namespace comms {
+namespace registry {
+
+static const size_t MAX_NODES = ENROLL_MAX_NODES;
+static const size_t PER_FRAME = ENROLL_PER_FRAME;
+static const size_t MAX_PARTS = (MAX_NODES + PER_FRAME - 1) / PER_FRAME;
+
+struct Table {
+  uint32_t epoch;              // bumped by the master on every change
+  uint8_t  count;
+  uint8_t  mac[MAX_NODES][6];
+};
+
+// NVS (namespace "nodes")
+bool load(Table& t);           // false if nothing valid is stored
+bool save(const Table& t);
+void clear();
+
+static inline int index_of(const Table& t, const uint8_t mac[6]) {
+  for (size_t i = 0; i < t.count; ++i) {
+    if (memcmp(t.mac[i], mac, 6) == 0) return (int)i;
+  }
+  return -1;   // absent
+}
+
+static inline bool append(Table& t, const uint8_t mac[6]) {
+  if (t.count >= MAX_NODES) return false;   // full
+  memcpy(t.mac[t.count++], mac, 6);
+  return true;
+}
+
+// ENROLL_TABLE frames: part p carries idx p*PER_FRAME onwards. An empty
+// table is still one (empty) part.
+static inline size_t parts(const Table& t) {
+  return t.count ? (t.count + PER_FRAME - 1) / PER_FRAME : 1;
+}
+
+// Returns the frame length, 0 if part is out of range or cap is too small
+static inline size_t encode(const Table& t, size_t part, uint8_t ttl, uint8_t* out, size_t cap) {
+  if (part >= parts(t)) return 0;
+  const size_t off = part * PER_FRAME;
+  const size_t n   = (t.count - off < PER_FRAME) ? t.count - off : PER_FRAME;
+  if (sizeof(EnrollHdr) + n * 6 > cap) return 0;
+  EnrollHdr h{};
+  h.mode   = MODE_ENROLL;
+  h.kind   = ENROLL_TABLE;
+  h.ttl    = ttl;
+  h.count  = (uint8_t)n;
+  h.epoch  = t.epoch;
+  h.offset = (uint8_t)off;
+  h.total  = t.count;
+  memcpy(out, &h, sizeof(h));
+  memcpy(out + sizeof(h), t.mac[off], n * 6);
+  return sizeof(h) + n * 6;
+}
+
+// Collects the parts of one epoch into a Table. Parts may arrive in any
+// order and more than once; a newer epoch starts over, older ones are
+// ignored. add() reports Complete once per epoch.
+class Assembler {
+public:
+  enum Result : uint8_t { Ignored, Partial, Complete };
+
+  Result add(const uint8_t* in, size_t len) {
+    if (len < sizeof(EnrollHdr)) return Ignored;
+    EnrollHdr h; memcpy(&h, in, sizeof(h));
+    if (h.mode != MODE_ENROLL || h.kind != ENROLL_TABLE || h.total > MAX_NODES) return Ignored;
+    if (h.offset % PER_FRAME || h.offset > h.total || (h.total && h.offset == h.total)) return Ignored;
+    const size_t part = h.offset / PER_FRAME;
+    const size_t want = ((size_t)h.total - h.offset < PER_FRAME) ? (size_t)h.total - h.offset : PER_FRAME;
+    if (h.count != want || len < sizeof(h) + (size_t)h.count * 6) return Ignored;
+
+    if (!active_ || h.epoch > t_.epoch || h.total != t_.count) {
+      if (active_ && h.epoch < t_.epoch) return Ignored;
+      active_ = true;
+      done_   = false;
+      have_   = 0;
+      t_.epoch = h.epoch;
+      t_.count = h.total;
+    }
+    if (done_ || (have_ & (1u << part))) return Ignored;
+    memcpy(t_.mac[h.offset], in + sizeof(h), (size_t)h.count * 6);
+    have_ |= 1u << part;
+    if (have_ != (1u << parts(t_)) - 1) return Partial;
+    done_ = true;
+    return Complete;
+  }
+
+  const Table& table() const { return t_; }   // valid after Complete
+
+private:
+  Table    t_ = {};
+  uint16_t have_ = 0;   // bit p: part p received
+  bool     active_ = false, done_ = false;
+};
+static_assert(MAX_PARTS <= 16, "Assembler tracks parts in a uint16_t");
+
+} // namespace registry
+} // namespace comms
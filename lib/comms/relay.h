@@ -0,0 +1,269 @@
+// lib/comms/relay.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <message.h>
+#include "topology.h"
+#include "registry.h"
+
+// Relay state of one node (pure, no Arduino deps): the peer table and its
+// layout, the per-mode cue cache and the per-peer health used to route
+// around dead nodes. The radio side (peer registration, ARQ, tasks) belongs
+// to the caller and gets every send through a Sink. espnow.cpp runs one
+// Node; a host harness runs one per simulated node over airsim.h.
+namespace comms {
+namespace relay {
+
+struct DedupStats {
+  uint32_t fresh;            // new cues dispatched
+  uint32_t refresh;          // unchanged repeats absorbed (not dispatched)
+  uint32_t refresh_fwd;      // of those, forwarded downstream (rate-limited)
+  uint32_t refresh_fwd_new;  // ...right away, for a child that joined or came back
+  uint32_t stale;            // older seq copies dropped
+};
+
+// Self-healing relay: a child with 3 failed sends in a row is treated as
+// dead and skipped (its children get the frame directly), up to the skip
+// window in levels; a periodic probe or any delivered send revives it.
+// Cues flagged F_CRITICAL are also sent straight to every grandchild.
+struct HealStats {
+  uint32_t dead_now;        // peers currently skipped
+  uint32_t marked_dead;
+  uint32_t revived;
+  uint32_t rerouted;        // frames sent around a dead peer
+  uint32_t dual_sent;       // extra F_CRITICAL copies
+  uint32_t probes;          // plain copies to dead peers
+  uint32_t last_detect_ms;  // first failure -> marked dead, last time
+};
+
+enum class Seen : uint8_t { New, Refresh, Stale };
+
+typedef uint8_t Mac[6];
+
+// Index of mac in peers[0..num), -1 if absent
+static inline int index_in(const Mac* peers, size_t num, const uint8_t* mac) {
+  for (size_t i = 0; peers && i < num; ++i) {
+    if (memcmp(peers[i], mac, 6) == 0) return (int)i;
+  }
+  return -1;
+}
+
+// Relay: a relayed frame (the caller may retry it). Probe: one plain copy
+// to a dead peer, its outcome only feeds health_note().
+enum class Send : uint8_t { Relay, Probe };
+
+struct Sink {
+  void (*send)(void* ctx, const char* tag, size_t idx, const uint8_t* frame, size_t len, Send how);
+  void* ctx;
+};
+
+class Node {
+public:
+  // Per-mode cue cache (seq + parameter hash). A frame with the cached seq
+  // and the same parameters (seq/t0/ttl excluded) is a master refresh or a
+  // broadcast copy: it is not re-dispatched and is forwarded at most every
+  // refresh_fwd_ms. An older seq inside DEDUP_HOLD_MS is a stale copy and is
+  // dropped; the hold lets a rebooted master (seq restarts at 1) back in.
+  // Entries are per mode byte and segment mask (F_SEG_*): cues for different
+  // LED segments are separate effects and must not shadow each other.
+  //
+  // A child that may not hold the cue yet (the table changed, it came back
+  // from dead, or child_joined()) bumps the child epoch; the next refresh of
+  // every cached cue is then forwarded right away.
+  static const uint32_t DEDUP_HOLD_MS = 3000;
+  static const size_t   SEG_KEYS      = 16;
+
+  // Send outcomes are tracked per peer index. After DEAD_AFTER failed sends
+  // in a row a peer counts as dead and frames for it go to its own children
+  // instead (chain: idx+2, idx+3 ... up to skip_window levels). A dead peer
+  // still gets a Probe every PROBE_MS; one delivered send revives it.
+  // Receivers drop the extra copies through the cue cache.
+  static const size_t   HEALTH_TRACK  = registry::MAX_NODES;   // every registry index
+  static const uint8_t  DEAD_AFTER    = 3;
+  static const uint32_t PROBE_MS      = 1000;
+
+  void set_sink(const Sink& s) { sink_ = s; }
+
+  // peers: [num][6] MAC table, not copied; nullptr = no table. A new table
+  // resets peer health and counts as new children.
+  void set_table(const uint8_t (*peers)[6], size_t num, size_t idx) {
+    peers_ = peers; num_ = peers ? num : 0; idx_ = peers ? idx : 0;
+    memset(health_, 0, sizeof(health_));
+    child_epoch_++;
+    table_gen_++;
+  }
+
+  // The table and its version (bumped by set_table()): a caller that scans
+  // the table outside its lock checks table_gen() under it before using
+  // the result. The arrays are never freed, only rewritten.
+  const Mac* peers()     const { return peers_; }
+  uint32_t   table_gen() const { return table_gen_; }
+
+  // fanout is clamped to >= 2 and ignored for Chain
+  void set_layout(topology::Kind k, uint8_t fanout) {
+    layout_.kind   = k;
+    layout_.fanout = fanout < 2 ? 2 : fanout;
+  }
+  void set_refresh_forward_ms(uint32_t ms) { refresh_fwd_ms_ = ms; }
+  void set_skip_window(uint8_t levels) {
+    skip_window_ = levels;
+    if (!levels) for (size_t i = 0; i < HEALTH_TRACK; ++i) health_[i].dead = false;
+  }
+
+  bool     has_table() const { return peers_ != nullptr; }
+  size_t   idx()       const { return idx_; }
+  size_t   num()       const { return num_; }
+  const uint8_t* peer(size_t i) const { return peers_[i]; }
+  const topology::Layout& layout() const { return layout_; }
+  size_t   first_child(size_t i) const { return topology::first_child(layout_, i); }
+  size_t   child_count(size_t i) const { return topology::child_count(layout_, i, num_); }
+  uint8_t  skip_window() const { return skip_window_; }
+
+  int peer_index(const uint8_t* mac) const {
+    return index_in(peers_, num_ < HEALTH_TRACK ? num_ : HEALTH_TRACK, mac);
+  }
+  bool dead(size_t i) const { return i < HEALTH_TRACK && health_[i].dead && skip_window_; }
+
+  // ---------- cue cache ----------
+  Seen classify(uint8_t mode, uint8_t seg, uint32_t seq, uint32_t hash, uint32_t now_ms) {
+    if (mode > MODE_SCENE) return Seen::New;
+    CueCache& e = cache_[mode][seg % SEG_KEYS];
+    if (e.valid && seq == e.seq && hash == e.hash) {
+      e.at_ms = now_ms;
+      dedup_.refresh++;
+      return Seen::Refresh;
+    }
+    if (e.valid && (int32_t)(seq - e.seq) < 0 && (now_ms - e.at_ms) < DEDUP_HOLD_MS) {
+      dedup_.stale++;
+      return Seen::Stale;
+    }
+    e.seq = seq; e.hash = hash; e.at_ms = now_ms; e.fwd_ms = now_ms; e.fwd_epoch = child_epoch_; e.valid = true;
+    dedup_.fresh++;
+    return Seen::New;
+  }
+
+  // For a Refresh: forward it now?
+  bool refresh_forward_due(uint8_t mode, uint8_t seg, uint32_t now_ms) {
+    if (mode > MODE_SCENE) return false;
+    CueCache& e = cache_[mode][seg % SEG_KEYS];
+    const uint32_t epoch = child_epoch_;
+    const bool new_child = e.fwd_epoch != epoch;
+    if (!new_child && now_ms - e.fwd_ms < refresh_fwd_ms_) return false;
+    e.fwd_ms = now_ms;
+    e.fwd_epoch = epoch;
+    dedup_.refresh_fwd++;
+    if (new_child) dedup_.refresh_fwd_new++;
+    return true;
+  }
+
+  // A child (re)joined: it may miss the cached cues
+  void child_joined() { child_epoch_++; }
+
+  // ---------- health ----------
+  // Send outcome for mac (a peer of this table or not)
+  void health_note(const uint8_t* mac, bool ok, uint32_t now_ms) {
+    const int i = peers_ ? peer_index(mac) : -1;
+    if (i >= 0) health_note_at((size_t)i, ok, now_ms);
+  }
+
+  // Send outcome for peer index i (see peers() / table_gen())
+  void health_note_at(size_t i, bool ok, uint32_t now_ms) {
+    if (i >= HEALTH_TRACK) return;
+    Health& h = health_[i];
+    if (ok) {
+      if (h.dead) { h.dead = false; heal_.revived++; child_epoch_++; }
+      h.fails = 0;
+      return;
+    }
+    if (h.fails == 0) h.first_fail_ms = now_ms;
+    if (h.fails < 255) h.fails++;
+    if (!h.dead && skip_window_ && h.fails >= DEAD_AFTER) {
+      h.dead = true;
+      heal_.marked_dead++;
+      heal_.last_detect_ms = now_ms - h.first_fail_ms;
+    }
+  }
+
+  // ---------- sends ----------
+  // A ttl-decremented frame to every child of this node. critical: also
+  // straight to every grandchild, so one dead node costs nothing even
+  // before it is detected.
+  void forward_to_children(const char* tag, const uint8_t* frame, size_t len, bool critical,
+                           uint32_t now_ms) {
+    const size_t first = first_child(idx_);
+    const size_t n     = child_count(idx_);
+    for (size_t i = 0; i < n; ++i) send_via(tag, first + i, frame, len, 0, now_ms);
+    if (!critical) return;
+    for (size_t i = 0; i < n; ++i) {
+      const size_t gfirst = first_child(first + i);
+      const size_t gn     = child_count(first + i);
+      for (size_t j = 0; j < gn; ++j) {
+        heal_.dual_sent++;
+        emit(tag, gfirst + j, frame, len, Send::Relay);
+      }
+    }
+  }
+
+  // To peer idx, or around it through its children while it is dead
+  void send_via(const char* tag, size_t idx, const uint8_t* frame, size_t len, uint8_t depth,
+                uint32_t now_ms) {
+    const size_t first = first_child(idx);
+    const size_t n     = child_count(idx);
+    if (!dead(idx) || depth >= skip_window_ || n == 0) {
+      emit(tag, idx, frame, len, Send::Relay);
+      return;
+    }
+    heal_.rerouted++;
+    for (size_t i = 0; i < n; ++i) send_via(tag, first + i, frame, len, depth + 1, now_ms);
+
+    Health& h = health_[idx];
+    if (now_ms - h.probe_ms >= PROBE_MS) {
+      h.probe_ms = now_ms;
+      heal_.probes++;
+      emit(tag, idx, frame, len, Send::Probe);
+    }
+  }
+
+  // The caller gave up on a relayed frame to mac: if that made it dead,
+  // hand the frame to its children
+  void reroute_around(const uint8_t* mac, const uint8_t* frame, size_t len, uint32_t now_ms) {
+    const int i = peers_ ? peer_index(mac) : -1;
+    if (i < 0 || !dead((size_t)i)) return;
+    send_via("REROUTE", (size_t)i, frame, len, 0, now_ms);
+  }
+
+  DedupStats dedup() const { return dedup_; }
+  HealStats  heal()  const {
+    HealStats st = heal_;
+    st.dead_now = 0;
+    for (size_t i = 0; i < HEALTH_TRACK; ++i) st.dead_now += health_[i].dead ? 1 : 0;
+    return st;
+  }
+
+private:
+  struct CueCache { uint32_t seq; uint32_t hash; uint32_t at_ms; uint32_t fwd_ms; uint32_t fwd_epoch; bool valid; };
+  struct Health   { uint8_t fails; bool dead; uint32_t first_fail_ms; uint32_t probe_ms; };
+
+  void emit(const char* tag, size_t idx, const uint8_t* frame, size_t len, Send how) {
+    if (sink_.send) sink_.send(sink_.ctx, tag, idx, frame, len, how);
+  }
+
+  const Mac* peers_ = nullptr;
+  size_t   num_ = 0, idx_ = 0;
+  uint32_t table_gen_ = 0;
+  topology::Layout layout_;   // Chain unless set_layout() says otherwise
+  Sink     sink_ = {};
+
+  CueCache cache_[MODE_SCENE + 1][SEG_KEYS] = {};
+  uint32_t refresh_fwd_ms_ = 10000;
+  volatile uint32_t child_epoch_ = 0;   // espnow.cpp: bumped on the WiFi and rx tasks
+  DedupStats dedup_ = {};
+
+  Health    health_[HEALTH_TRACK] = {};
+  uint8_t   skip_window_ = 2;
+  HealStats heal_ = {};
+};
+
+} // namespace relay
+} // namespace comms
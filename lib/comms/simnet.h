@@ -0,0 +1,261 @@
+// lib/comms/simnet.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <message.h>
+#include "airsim.h"
+#include "relay.h"
+#include "cuepath.h"
+#include "arq.h"
+#include "clocksync.h"
+#include "spsc_ring.h"
+
+// Relay network on the simulated medium (pure, no Arduino deps): N nodes
+// plus a master (medium node N). Every node runs what espnow.cpp runs on a
+// board: received frames go through an SpscRing into a cuepath::Path over
+// a relay::Node, relayed sends through an arq::Arq, and cue times through
+// its ClockSync with its upstream, all on the node's own airsim::Clock.
+// The harness only stands in for the radio glue: peer registration is
+// free, rx_task runs as soon as a frame is in, and sync exchanges take
+// their airtime and link delay but no turn on the channel.
+//
+// Per cue, got_us[i] is when node i first dispatched it and start_us[i]
+// when it starts it (its rebased t0, on its own clock), both in medium
+// time; -1 if it did not.
+namespace comms {
+namespace simnet {
+
+static const size_t   ARQ_SLOTS    = 8;     // as espnow.cpp
+static const size_t   RX_SLOTS     = 16;
+static const uint8_t  MASTER_SENDS = 4;     // the master's egress resends to idx 0
+static const uint32_t SYNC_TURN_US = 300;   // upstream: SYNC_REQ in -> SYNC_RESP out
+
+template <size_t N>
+class Net {
+public:
+  static const uint8_t MASTER = N;
+
+  airsim::Medium<N + 1, 512> air;
+  relay::Node node[N];
+  int64_t     got_us[N];
+  int64_t     start_us[N];
+  int64_t     dead_us = -1, alive_us = -1;   // last peer marked dead / revived
+
+  explicit Net(uint32_t seed) : air(seed), rng_(seed * 2654435761u | 1) {}
+
+  // Table and layout on every node. Each clock (master's too) boots up to
+  // max_offset_ms apart and runs up to max_skew_ppm off.
+  void setup(topology::Kind k, uint8_t fanout, uint32_t max_offset_ms = 5000,
+             int32_t max_skew_ppm = 40) {
+    for (size_t i = 0; i < N; ++i) memcpy(peers_[i], air.mac_of((uint8_t)i), 6);
+    for (size_t i = 0; i <= N; ++i) {
+      clock_[i].offset_us = max_offset_ms ? (int64_t)(rnd() % (max_offset_ms * 1000)) : 0;
+      clock_[i].skew_ppm  = max_skew_ppm ? (int32_t)(rnd() % (2 * max_skew_ppm + 1)) - max_skew_ppm : 0;
+    }
+    for (size_t i = 0; i < N; ++i) {
+      ctx_[i] = { this, (uint8_t)i };
+      node[i].set_layout(k, fanout);
+      node[i].set_table(peers_, N, i);
+      node[i].set_sink({ sink, &ctx_[i] });
+      path_[i].set_node(&node[i]);
+      path_[i].set_host({ now_ms, rebase, relay_cb, breath, flicker, nullptr, nullptr, nullptr, &ctx_[i] });
+      arq_[i].set_radio({ radio_send, gave_up, nullptr, nullptr, &ctx_[i] });
+      sync_[i].reset();
+    }
+    clear_cue();
+  }
+
+  int64_t  local_us(size_t i) const { return clock_[i].local_us(air.now_us()); }
+  uint32_t master_ms() const { return (uint32_t)(local_us(MASTER) / 1000); }
+  const airsim::Clock& clock(size_t i) const { return clock_[i]; }
+  const ClockSync& sync(size_t i) const { return sync_[i]; }
+  arq::Stats arq_stats(size_t i) const { return arq_[i].stats(); }
+  uint32_t rx_dropped() const { return rx_dropped_; }
+
+  // One SYNC_REQ/RESP exchange per node with its upstream, parents first.
+  // A node whose upstream is not synced gets no answer (as on the boards).
+  void sync_round() {
+    const int64_t t = air.now_us();
+    for (size_t i = 0; i < N; ++i) {
+      const uint8_t up = i == 0 ? MASTER : (uint8_t)topology::parent(node[i].layout(), i);
+      if (up != MASTER && !sync_[up].synced()) continue;
+      const int64_t d1   = hop_us((uint8_t)i, up);
+      const int64_t turn = SYNC_TURN_US + rnd() % (SYNC_TURN_US / 2 + 1);
+      const int64_t d2   = hop_us(up, (uint8_t)i);
+      sync_[i].add_sample(clock_[i].local_us(t), master_time(up, t + d1),
+                          master_time(up, t + d1 + turn), clock_[i].local_us(t + d1 + turn + d2));
+    }
+  }
+
+  // Rounds period_us of medium time apart until every node is synced (a
+  // node needs ClockSync::MIN_SAMPLES from a synced upstream, so a level
+  // takes a few rounds); rounds used, or 0 if max_rounds were not enough
+  size_t sync_all(size_t max_rounds, int64_t period_us) {
+    for (size_t r = 1; r <= max_rounds; ++r) {
+      sync_round();
+      run(air.now_us() + period_us);
+      bool all = true;
+      for (size_t i = 0; i < N && all; ++i) all = sync_[i].synced();
+      if (all) return r;
+    }
+    return 0;
+  }
+
+  void clear_cue() {
+    for (size_t i = 0; i < N; ++i) got_us[i] = start_us[i] = -1;
+  }
+
+  // A frame from the master to idx 0, resent on a missing ack
+  void master_send(const uint8_t* f, size_t len) {
+    master_sends_ = 1;
+    air.send(MASTER, 0, f, len);
+  }
+
+  void run(int64_t until_us) {
+    airsim::Event ev;
+    while (air.now_us() < until_us) {
+      int64_t stop = next_arq_us();
+      if (stop <= air.now_us()) stop = air.now_us() + 1;
+      if (stop > until_us) stop = until_us;
+      if (air.next(ev, stop)) {
+        if (ev.kind == airsim::EvKind::SendDone) on_done(ev);
+        else if (ev.to < N) on_deliver(ev);
+        continue;
+      }
+      for (size_t i = 0; i < N; ++i) arq_[i].service(local_us(i));
+    }
+  }
+
+private:
+  struct Ctx { Net* net; uint8_t self; };
+
+  static const uint32_t TAGGED = 1u << 31;   // SendDone tag: ARQ slot << 16 | gen
+
+  uint32_t rnd() { rng_ ^= rng_ << 13; rng_ ^= rng_ >> 17; rng_ ^= rng_ << 5; return rng_; }
+
+  int64_t hop_us(uint8_t from, uint8_t to) {
+    const airsim::LinkCfg& c = air.link(from, to);
+    return air.airtime(sizeof(SyncMsg)) + c.latency_us + (c.jitter_us ? rnd() % (c.jitter_us + 1) : 0);
+  }
+
+  // What upstream up answers as master time at medium time t
+  int64_t master_time(uint8_t up, int64_t t) const {
+    if (up == MASTER) return clock_[MASTER].local_us(t);
+    return sync_[up].to_master(clock_[up].local_us(t));
+  }
+
+  int64_t next_arq_us() const {
+    int64_t next = INT64_MAX;
+    for (size_t i = 0; i < N; ++i) {
+      const int64_t due = arq_[i].next_us();
+      if (due == INT64_MAX) continue;
+      const int64_t t = clock_[i].sim_us(due) + 1;
+      if (t < next) next = t;
+    }
+    return next;
+  }
+
+  // WiFi callback side: into the ring; then rx_task's pass
+  void on_deliver(const airsim::Event& ev) {
+    const uint8_t i = ev.to;
+    cuepath::Frame* f = rx_[i].claim();
+    if (!f) { rx_dropped_++; return; }
+    memcpy(f->mac, air.mac_of(ev.from), 6);
+    f->len  = ev.len;
+    f->t_us = local_us(i);
+    memcpy(f->data, ev.data, ev.len);
+    rx_[i].publish();
+
+    while (const cuepath::Frame* r = rx_[i].front()) {
+      cur_rx_us_ = r->t_us;
+      path_[i].handle(r->mac, r->data, r->len);
+      rx_[i].release();
+    }
+    cur_rx_us_ = 0;
+    arq_[i].service(local_us(i));
+  }
+
+  void on_done(const airsim::Event& ev) {
+    if (ev.from == MASTER) {
+      if (!ev.ok && master_sends_ < MASTER_SENDS) { master_sends_++; air.send(MASTER, ev.to, ev.data, ev.len); }
+      return;
+    }
+    const uint8_t i = ev.from;
+    const uint32_t now = (uint32_t)(local_us(i) / 1000);
+    if (ev.to < N) {
+      const bool was = node[i].dead(ev.to);
+      node[i].health_note(air.mac_of(ev.to), ev.ok, now);
+      if (!was && node[i].dead(ev.to))      dead_us  = air.now_us();
+      else if (was && !node[i].dead(ev.to)) alive_us = air.now_us();
+    }
+    if (ev.tag & TAGGED) {
+      arq_[i].post((int8_t)((ev.tag >> 16) & 0xFF), (uint16_t)ev.tag, ev.ok, local_us(i));
+      arq_[i].service(local_us(i));
+    }
+  }
+
+  // ---------- relay::Node sink, arq::Radio and cuepath::Host ----------
+  static void sink(void* c, const char*, size_t idx, const uint8_t* f, size_t len, relay::Send how) {
+    Ctx* x = (Ctx*)c;
+    Net* n = x->net;
+    if (how == relay::Send::Relay && n->arq_[x->self].enqueue(n->peers_[idx], f, len, n->cur_rx_us_)) return;
+    n->air.send(x->self, (uint8_t)idx, f, len);
+  }
+
+  static bool radio_send(void* c, const uint8_t* mac, const uint8_t* data, size_t len, int8_t slot,
+                         uint16_t gen) {
+    Ctx* x = (Ctx*)c;
+    const int to = x->net->air.index_of(mac);
+    if (to < 0) return false;
+    return x->net->air.send(x->self, (uint8_t)to, data, len, TAGGED | (uint32_t)(uint8_t)slot << 16 | gen);
+  }
+
+  static void gave_up(void* c, const uint8_t* mac, const uint8_t* frame, size_t len, uint8_t) {
+    Ctx* x = (Ctx*)c;
+    x->net->node[x->self].reroute_around(mac, frame, len, now_ms(c));
+  }
+
+  static uint32_t now_ms(void* c) {
+    Ctx* x = (Ctx*)c;
+    return (uint32_t)(x->net->local_us(x->self) / 1000);
+  }
+
+  static uint32_t rebase(void* c, uint32_t t0_ms) {
+    Ctx* x = (Ctx*)c;
+    return rebase_t0(x->net->sync_[x->self], t0_ms, x->net->local_us(x->self));
+  }
+
+  static void relay_cb(void* c, const char* tag, const uint8_t* frame, size_t len, uint8_t, bool critical) {
+    Ctx* x = (Ctx*)c;
+    x->net->node[x->self].forward_to_children(tag, frame, len, critical, now_ms(c));
+  }
+
+  void dispatched(uint8_t i, uint32_t t0_ms) {
+    if (got_us[i] < 0) got_us[i] = air.now_us();
+    start_us[i] = clock_[i].sim_us((int64_t)t0_ms * 1000);
+  }
+  static void breath(void* c, const uint8_t*, const BreathCue& m) {
+    Ctx* x = (Ctx*)c;
+    x->net->dispatched(x->self, m.t0_ms);
+  }
+  static void flicker(void* c, const uint8_t*, const FlickerMsg& m) {
+    Ctx* x = (Ctx*)c;
+    x->net->dispatched(x->self, m.t0_ms);
+  }
+
+  uint8_t       peers_[N][6];
+  Ctx           ctx_[N];
+  cuepath::Path path_[N];
+  arq::Arq<ARQ_SLOTS> arq_[N];
+  ClockSync     sync_[N];
+  SpscRing<cuepath::Frame, RX_SLOTS> rx_[N];
+  airsim::Clock clock_[N + 1];
+  int64_t       cur_rx_us_ = 0;
+  uint8_t       master_sends_ = 0;
+  uint32_t      rx_dropped_ = 0;
+  uint32_t      rng_;
+};
+
+} // namespace simnet
+} // namespace comms
@@ -0,0 +1,64 @@
+// lib/comms/spsc_ring.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Fixed-size lock-free single-producer / single-consumer ring.
+// N must be a power of two. One side may only call claim()/publish()/push(),
+// the other only front()/release()/pop(). No allocation, no locks, so the
+// producer side is safe to run inside a radio callback.
+namespace comms {
+
+template <class T, size_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+  // ----- producer -----
+  // Slot to fill in place, or nullptr if full. Call publish() when done.
+  T* claim() {
+    const uint32_t h = head_.load(std::memory_order_relaxed);
+    if (h - tail_.load(std::memory_order_acquire) >= N) return nullptr;
+    return &buf_[h & (N - 1)];
+  }
+  void publish() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  bool push(const T& v) {
+    T* slot = claim();
+    if (!slot) return false;
+    *slot = v;
+    publish();
+    return true;
+  }
+
+  // ----- consumer -----
+  // Oldest slot, or nullptr if empty. Call release() when done with it.
+  const T* front() const {
+    const uint32_t t = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == t) return nullptr;
+    return &buf_[t & (N - 1)];
+  }
+  void release() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  bool pop(T& out) {
+    const T* slot = front();
+    if (!slot) return false;
+    out = *slot;
+    release();
+    return true;
+  }
+
+  // ----- either side (snapshot) -----
+  size_t size() const {
+    return (size_t)(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire));
+  }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T buf_[N];
+  std::atomic<uint32_t> head_{0};   // written by producer only
+  std::atomic<uint32_t> tail_{0};   // written by consumer only
+};
+
+} // namespace comms
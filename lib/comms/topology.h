@@ -0,0 +1,86 @@
+// lib/comms/topology.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Relay layout over the peer table. Pure index math (no Arduino deps).
+//
+// Chain: master -> 0 -> 1 -> 2 ... (each node forwards to idx+1)
+// Tree : master -> 0, then a k-ary heap rooted at 0:
+//        children of i are k*i+1 .. k*i+k, parent of i is (i-1)/k
+// Layout the firmware runs: build the master and every node with the same
+// -D COMMS_TREE_FANOUT=k (0: chain).
+#ifndef COMMS_TREE_FANOUT
+#define COMMS_TREE_FANOUT 0
+#endif
+
+namespace comms {
+namespace topology {
+
+enum class Kind : uint8_t { Chain, Tree };
+
+struct Layout {
+  Kind    kind   = Kind::Chain;
+  uint8_t fanout = 2;   // k, only used by Tree (clamped to >= 2)
+};
+
+static inline size_t fanout_of(const Layout& l) {
+  if (l.kind == Kind::Chain) return 1;
+  return l.fanout < 2 ? 2 : l.fanout;
+}
+
+// First child index of idx (may be >= num when idx is a leaf)
+static inline size_t first_child(const Layout& l, size_t idx) {
+  return fanout_of(l) * idx + 1;
+}
+
+// Number of children of idx that exist in a table of num peers
+static inline size_t child_count(const Layout& l, size_t idx, size_t num) {
+  const size_t first = first_child(l, idx);
+  if (first >= num) return 0;
+  const size_t k = fanout_of(l);
+  return (num - first < k) ? (num - first) : k;
+}
+
+// Parent of idx; idx 0 hangs off the master (returns SIZE_MAX)
+static inline size_t parent(const Layout& l, size_t idx) {
+  if (idx == 0) return SIZE_MAX;
+  return (idx - 1) / fanout_of(l);
+}
+
+// Radio hops from the master to idx (idx 0 = 1 hop)
+static inline size_t hop_depth(const Layout& l, size_t idx) {
+  size_t hops = 1;
+  while (idx) { idx = parent(l, idx); ++hops; }
+  return hops;
+}
+
+// Worst-case hops over a table of num peers (deepest node is the last one)
+static inline size_t max_hop_depth(const Layout& l, size_t num) {
+  return num ? hop_depth(l, num - 1) : 0;
+}
+
+static inline Layout build_layout() {
+  Layout l;
+  l.kind   = COMMS_TREE_FANOUT ? Kind::Tree : Kind::Chain;
+  l.fanout = COMMS_TREE_FANOUT ? COMMS_TREE_FANOUT : 2;
+  return l;
+}
+
+// Cue lead (t0 - now at the master) that still reaches the deepest of num
+// nodes. A hop costs hop_us (send->ack plus relay delay), and every relayed
+// frame holds the one channel for about frame_us, so a wide tree is bound
+// by num * frame_us rather than its depth. Twice that for ARQ resends, plus
+// LEAD_SLACK_MS.
+static const uint32_t LEAD_SLACK_MS = 20;
+static const uint32_t LEAD_MAX_MS   = 1500;   // unsynced nodes clamp t0 at 2000 ms ahead
+
+static inline uint32_t lead_ms(const Layout& l, size_t num, uint32_t hop_us, uint32_t frame_us) {
+  const uint64_t path = (uint64_t)max_hop_depth(l, num) * hop_us;
+  const uint64_t air  = (uint64_t)num * frame_us;
+  const uint64_t ms   = 2 * (path > air ? path : air) / 1000 + LEAD_SLACK_MS;
+  return ms > LEAD_MAX_MS ? LEAD_MAX_MS : (uint32_t)ms;
+}
+
+} // namespace topology
+} // namespace comms
@@ -16,6 +16,10 @@
 #define MASTER_DATAPIN  13
 #define MASTER_CLOCKPIN 14
 
+// Node LED strip (DotStar): HSPI MOSI / SCK, so leds::setupDma() can use them
+#define NODE_DATAPIN  13
+#define NODE_CLOCKPIN 14
+
 // Actuator (DRV8833-style) pins
 #define AIN1 5
 #define AIN2 18
@@ -0,0 +1,98 @@
+#include "dotstar_dma.h"
+#include "frame.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <logging.h>
+
+namespace leds {
+namespace dma {
+
+void Port::flush() {
+  if (!in_flight_) return;
+  spi_transaction_t* done = nullptr;
+  spi_device_get_trans_result(dev_, &done, portMAX_DELAY);
+  in_flight_ = false;
+}
+
+void Port::end() {
+  if (dev_) {
+    flush();
+    spi_bus_remove_device(dev_);
+    spi_bus_free(host_);
+    dev_ = nullptr;
+  }
+  for (int i = 0; i < 2; ++i) { heap_caps_free(buf_[i]); buf_[i] = nullptr; }
+  count_ = 0;
+}
+
+bool Port::begin(spi_host_device_t host, uint16_t count, uint8_t dataPin, uint8_t clockPin, uint32_t clock_hz) {
+  end();
+  host_ = host;
+  cap_  = frame_bytes(count);
+
+  spi_bus_config_t bus{};
+  bus.mosi_io_num     = dataPin;
+  bus.miso_io_num     = -1;
+  bus.sclk_io_num     = clockPin;
+  bus.quadwp_io_num   = -1;
+  bus.quadhd_io_num   = -1;
+  bus.max_transfer_sz = (int)cap_;
+  if (spi_bus_initialize(host_, &bus, SPI_DMA_CH_AUTO) != ESP_OK) {
+    LOGE("LEDS dma: bus %d init failed", (int)host_);
+    return false;
+  }
+
+  spi_device_interface_config_t dev{};
+  dev.mode           = 0;
+  dev.clock_speed_hz = (int)clock_hz;
+  dev.spics_io_num   = -1;
+  dev.queue_size     = 2;
+  if (spi_bus_add_device(host_, &dev, &dev_) != ESP_OK) {
+    LOGE("LEDS dma: add device failed");
+    spi_bus_free(host_);
+    dev_ = nullptr;
+    return false;
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    buf_[i] = (uint8_t*)heap_caps_malloc(cap_, MALLOC_CAP_DMA);
+    if (!buf_[i]) { LOGE("LEDS dma: no DMA memory for %u bytes", (unsigned)cap_); end(); return false; }
+    // start frame and end frame never change
+    memset(buf_[i], 0x00, 4);
+    memset(buf_[i] + 4 + 4u * count, 0xFF, cap_ - 4 - 4u * count);
+  }
+  count_ = count;
+  cur_   = 0;
+  return true;
+}
+
+void Port::show(const uint8_t* pixels, uint16_t count, uint8_t brightness) {
+  if (!dev_) return;
+  if (count > count_) count = count_;
+
+  // encode while the other buffer may still be on the wire
+  frame::encode(buf_[cur_] + 4, pixels, count, brightness);
+
+  flush();   // at most one frame on the wire
+
+  spi_transaction_t& t = trans_[cur_];
+  memset(&t, 0, sizeof(t));
+  t.length    = cap_ * 8;   // bits
+  t.tx_buffer = buf_[cur_];
+  if (spi_device_queue_trans(dev_, &t, portMAX_DELAY) == ESP_OK) in_flight_ = true;
+  cur_ ^= 1;
+}
+
+// ---------- single-strip port ----------
+static Port s_port;
+
+bool begin(uint16_t count, uint8_t dataPin, uint8_t clockPin, uint32_t clock_hz) {
+  return s_port.begin(HSPI_HOST, count, dataPin, clockPin, clock_hz);
+}
+void end()     { s_port.end(); }
+bool active()  { return s_port.active(); }
+void flush()   { s_port.flush(); }
+void show(const uint8_t* pixels, uint16_t count, uint8_t brightness) { s_port.show(pixels, count, brightness); }
+
+} // namespace dma
+} // namespace leds
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <driver/spi_master.h>
+
+// DotStar (APA102) output over the ESP32 SPI peripheral with DMA.
+//
+// Two DMA buffers: show() encodes the new frame into the idle one and queues
+// it, so the CPU only pays for the encode while the previous frame is still
+// clocking out. It blocks only if that previous frame has not finished yet
+// (frames faster than the wire). Pins go through the GPIO matrix; 13/14
+// (HSPI's own pins) allow the highest clock.
+//
+// One Port per SPI host: HSPI and VSPI can clock two strips at once.
+namespace leds {
+namespace dma {
+
+// Start frame + 4 bytes per pixel + end frame (>= count/2 clock edges)
+static inline size_t frame_bytes(uint16_t count) { return 4 + 4u * count + (count + 15u) / 16u; }
+
+class Port {
+public:
+  bool begin(spi_host_device_t host, uint16_t count, uint8_t dataPin, uint8_t clockPin, uint32_t clock_hz);
+  void end();
+  bool active() const { return dev_ != nullptr; }
+
+  // pixels: 3 bytes per pixel in wire order (Adafruit_DotStar::getPixels()),
+  // scaled by brightness like Adafruit_DotStar::show() (255 = full)
+  void show(const uint8_t* pixels, uint16_t count, uint8_t brightness);
+
+  // wait for the frame on the wire to finish
+  void flush();
+
+private:
+  spi_host_device_t   host_ = HSPI_HOST;
+  spi_device_handle_t dev_  = nullptr;
+  uint8_t*            buf_[2] = { nullptr, nullptr };
+  spi_transaction_t   trans_[2];
+  size_t              cap_ = 0;
+  uint16_t            count_ = 0;
+  uint8_t             cur_ = 0;          // buffer the next frame goes into
+  bool                in_flight_ = false;
+};
+
+// The single-strip output of leds::setupDma() (HSPI)
+bool begin(uint16_t count, uint8_t dataPin, uint8_t clockPin, uint32_t clock_hz);
+void end();
+bool active();
+void show(const uint8_t* pixels, uint16_t count, uint8_t brightness);
+void flush();
+
+} // namespace dma
+} // namespace leds
@@ -0,0 +1,144 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <message.h>
+
+// Fixed-point breath / flicker math (pure, no Arduino deps).
+//
+// Brightness is Q16 (0..65535 = 0..1). The cosine ease and the gamma curve
+// are 257-entry tables built by the compiler (C++11 constexpr) and read with
+// linear interpolation. Prepared cues keep the divisions out of the frame
+// path: reciprocals of up_ms / down_ms are taken once per message, and the
+// current cycle start advances by whole periods instead of elapsed % period.
+namespace leds {
+namespace fx {
+
+// ---------- compile-time tables ----------
+namespace detail {
+template <size_t... I> struct Seq {};
+template <size_t N, size_t... I> struct Gen : Gen<N - 1, N - 1, I...> {};
+template <size_t... I> struct Gen<0, I...> { typedef Seq<I...> type; };
+
+// cos by its Taylor series; 20 terms are exact to double precision on [0, pi]
+constexpr double cos_s(double x2, int k, double term) {
+  return k >= 20 ? 0.0 : term + cos_s(x2, k + 1, -term * x2 / ((2.0 * k + 1) * (2.0 * k + 2)));
+}
+constexpr double ccos(double x) { return cos_s(x * x, 0, 1.0); }
+
+constexpr double sqrt_it(double x, double g, int n) { return n == 0 ? g : sqrt_it(x, 0.5 * (g + x / g), n - 1); }
+constexpr double csqrt(double x) { return x <= 0 ? 0.0 : sqrt_it(x, 1.0, 40); }
+
+constexpr uint16_t q16(double x) { return x <= 0 ? 0 : (x >= 1 ? 65535 : (uint16_t)(x * 65535.0 + 0.5)); }
+
+struct EaseF  { static constexpr uint16_t at(size_t i) { return q16(0.5 * (1.0 - ccos(3.14159265358979 * (double)i / 256.0))); } };
+// x^2.25 (x^2 * x^0.25): close to the usual 2.2 LED gamma, and constexpr-able
+struct GammaF { static constexpr uint16_t at(size_t i) {
+  return q16(((double)i / 256.0) * ((double)i / 256.0) * csqrt(csqrt((double)i / 256.0))); } };
+
+template <class F, class S> struct Table;
+template <class F, size_t... I> struct Table<F, Seq<I...>> {
+  static constexpr uint16_t v[sizeof...(I)] = { F::at(I)... };
+};
+template <class F, size_t... I> constexpr uint16_t Table<F, Seq<I...>>::v[sizeof...(I)];
+
+typedef Table<EaseF,  Gen<257>::type> Ease;
+typedef Table<GammaF, Gen<257>::type> Gamma;
+} // namespace detail
+
+static inline uint16_t lerp_lut(const uint16_t* t, uint16_t x) {
+  const uint16_t a = t[x >> 8], b = t[(x >> 8) + 1];
+  return (uint16_t)(a + (((int32_t)b - a) * (int32_t)(x & 0xFF) >> 8));
+}
+
+// 0.5 * (1 - cos(pi x)), x and result Q16
+static inline uint16_t ease_q16(uint16_t x)  { return lerp_lut(detail::Ease::v, x); }
+// perceived -> linear light
+static inline uint16_t gamma_q16(uint16_t x) { return lerp_lut(detail::Gamma::v, x); }
+// c * q / 65535, rounded
+static inline uint8_t  scale8(uint8_t c, uint16_t q) { return (uint8_t)(((uint32_t)c * q + 32767) / 65535); }
+
+static inline uint16_t unit_q16(float x) { return detail::q16(x); }
+
+// ---------- prepared cues ----------
+struct Breath {
+  BreathCue src;              // the cue this was prepared from
+  bool      valid = false;
+  uint32_t  period, total;    // total = 0: endless
+  uint64_t  inv_up, inv_down; // 2^32 / ms
+  uint32_t  cycle_at;         // start of the current cycle (local ms)
+  uint16_t  b_min;
+  int32_t   b_span;           // b_max - b_min, Q16
+
+  // Cheap to call every frame: only re-prepares when the message changed
+  void prepare(const BreathCue& p) {
+    if (valid && memcmp(&src, &p, sizeof(p)) == 0) return;
+    src      = p;
+    valid    = true;
+    period   = p.up_ms + p.down_ms;
+    total    = p.cycles ? (uint32_t)p.cycles * period : 0;
+    inv_up   = p.up_ms   ? (1ULL << 32) / p.up_ms   : 0;
+    inv_down = p.down_ms ? (1ULL << 32) / p.down_ms : 0;
+    cycle_at = p.t0_ms;
+    b_min    = p.b_min;
+    b_span   = (int32_t)p.b_max - p.b_min;
+  }
+
+  // Perceived brightness, Q16; same curve as leds::breathBrightness()
+  uint16_t level(uint32_t now) {
+    if (src.mode != MODE_BREATH) return 0;
+    if ((int32_t)(now - src.t0_ms) < 0 || !period) return b_min;
+    const uint32_t elapsed = now - src.t0_ms;
+    if (total && elapsed >= total) return b_min;
+
+    uint32_t t = now - cycle_at;
+    if ((int32_t)(now - cycle_at) < 0 || t >= 4 * period) {   // time jumped: resync once
+      cycle_at = src.t0_ms + elapsed - elapsed % period;
+      t = now - cycle_at;
+    }
+    while (t >= period) { cycle_at += period; t -= period; }
+
+    uint16_t x;
+    if (t < src.up_ms) x = (uint16_t)((t * inv_up) >> 16);
+    else               x = (uint16_t)(65535 - (uint16_t)(((t - src.up_ms) * inv_down) >> 16));
+    return (uint16_t)(b_min + ((b_span * (int32_t)(ease_q16(x) >> 1)) >> 15));
+  }
+};
+
+struct Flicker {
+  FlickerMsg src;
+  bool       valid = false;
+  uint32_t   period, total;
+  uint32_t   cycle_at;
+
+  void prepare(const FlickerMsg& f) {
+    if (valid && memcmp(&src, &f, sizeof(f)) == 0) return;
+    src      = f;
+    valid    = true;
+    period   = (uint32_t)f.on_ms + f.off_ms;
+    total    = f.cycles ? (uint32_t)f.cycles * period : 0;
+    cycle_at = f.t0_ms;
+  }
+
+  // same as leds::flickerGate()
+  uint8_t gate(uint32_t now) {
+    if (src.mode != MODE_FLICKER) return 1;
+    if ((int32_t)(now - src.t0_ms) < 0) return 0;
+    if (!period) return 1;
+    const uint32_t elapsed = now - src.t0_ms;
+    if (total && elapsed >= total) return 1;   // finished => open gate
+
+    uint32_t t = now - cycle_at;
+    if ((int32_t)(now - cycle_at) < 0 || t >= 4 * period) {
+      cycle_at = src.t0_ms + elapsed - elapsed % period;
+      t = now - cycle_at;
+    }
+    while (t >= period) { cycle_at += period; t -= period; }
+
+    const uint8_t g = (t < src.on_ms) ? 1 : 0;
+    return src.invert ? !g : g;
+  }
+};
+
+} // namespace fx
+} // namespace leds
@@ -0,0 +1,60 @@
+// lib/leds/frame.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "fixmath.h"
+
+// What the renderers put on a strip (pure, no Arduino deps): the colour of a
+// breath / flicker pair at `now`, the setGrouping() mask, and the APA102
+// wire encode. leds.cpp, segments.cpp and dotstar_dma.cpp build frames from
+// these; test/test_leds checks them against golden frames on the host.
+namespace leds {
+namespace frame {
+
+struct Rgb { uint8_t r, g, b; };
+
+// setGrouping(): the first onCount pixels of every spacing-pixel group are lit
+static inline bool lit(uint16_t i, uint8_t spacing, uint8_t onCount) { return (i % spacing) < onCount; }
+
+// Colour rules of renderBreath / renderFlickerOnly / renderCombined. Pass
+// nullptr for an effect that is not set: a breath alone is its colour at
+// the breath level, a flicker alone gates `def`, both: the flicker gates
+// the breath. gamma maps the breath level to linear light first.
+static inline Rgb colour(fx::Breath* breath, fx::Flicker* flicker, Rgb def, bool gamma, uint32_t now) {
+  const uint8_t gate = flicker ? flicker->gate(now) : 1;
+  if (!breath) {
+    const uint8_t on = flicker ? gate : 0;
+    return Rgb{ (uint8_t)(def.r * on), (uint8_t)(def.g * on), (uint8_t)(def.b * on) };
+  }
+  uint16_t q = gate ? breath->level(now) : 0;
+  if (gamma) q = fx::gamma_q16(q);
+  return Rgb{ fx::scale8(breath->src.r, q), fx::scale8(breath->src.g, q), fx::scale8(breath->src.b, q) };
+}
+
+// One colour through the grouping mask into count RGB triples
+static inline void paint(uint8_t* rgb, uint16_t count, Rgb c, uint8_t spacing, uint8_t onCount) {
+  for (uint16_t i = 0; i < count; ++i, rgb += 3) {
+    const bool on = lit(i, spacing, onCount);
+    rgb[0] = on ? c.r : 0; rgb[1] = on ? c.g : 0; rgb[2] = on ? c.b : 0;
+  }
+}
+
+// APA102 pixel words: 0xFF (5-bit global brightness at max) + the 3 pixel
+// bytes in wire order, scaled per channel like Adafruit_DotStar::show()
+// (brightness 255 = unscaled). Start / end frames are the caller's.
+static inline void encode(uint8_t* out, const uint8_t* pixels, uint16_t count, uint8_t brightness) {
+  const uint16_t scale = (uint16_t)brightness + 1;   // 256 = unscaled
+  for (uint16_t i = 0; i < count; ++i, pixels += 3, out += 4) {
+    out[0] = 0xFF;
+    if (scale == 256) {
+      out[1] = pixels[0]; out[2] = pixels[1]; out[3] = pixels[2];
+    } else {
+      out[1] = (uint8_t)((pixels[0] * scale) >> 8);
+      out[2] = (uint8_t)((pixels[1] * scale) >> 8);
+      out[3] = (uint8_t)((pixels[2] * scale) >> 8);
+    }
+  }
+}
+
+} // namespace frame
+} // namespace leds
@@ -0,0 +1,203 @@
+#include "layers.h"
+#include "leds.h"
+#include "fixmath.h"
+#include <string.h>
+#include <new>
+
+namespace leds {
+
+struct Frame {
+  uint8_t* r;
+  uint8_t* g;
+  uint8_t* b;
+  uint16_t n;
+};
+
+struct Slot {
+  Layer       l;
+  fx::Breath  breath;    // prepared cue state, per slot
+  fx::Flicker flicker;
+};
+
+static Slot     s_slot[MAX_LAYERS];
+static uint8_t* s_mem = nullptr;   // out + scratch, 6 bytes per pixel
+static uint16_t s_memPixels = 0;
+
+static bool allocFor(uint16_t n) {
+  if (n <= s_memPixels && s_mem) return true;
+  delete[] s_mem;
+  s_mem = new (std::nothrow) uint8_t[(size_t)n * 6];
+  s_memPixels = s_mem ? n : 0;
+  return s_mem != nullptr;
+}
+
+// ---------- layer evaluation (into the scratch frame) ----------
+static void fillConst(const Frame& f, uint8_t r, uint8_t g, uint8_t b) {
+  memset(f.r, r, f.n);
+  memset(f.g, g, f.n);
+  memset(f.b, b, f.n);
+}
+
+// One channel of a linear ramp a -> z across n pixels, Q16 steps
+static void ramp(uint8_t* __restrict out, uint16_t n, uint8_t a, uint8_t z) {
+  const int32_t step = n > 1 ? (((int32_t)z - a) << 16) / (n - 1) : 0;
+  int32_t acc = ((int32_t)a << 16) + 0x8000;
+  for (uint16_t i = 0; i < n; ++i) { out[i] = (uint8_t)(acc >> 16); acc += step; }
+}
+
+static void chase(const Frame& f, const Layer& l, uint32_t now) {
+  const uint16_t n = f.n;
+  const uint32_t period = l.period_ms ? l.period_ms : 1;
+  const uint16_t head = (uint16_t)(((uint64_t)(now % period) * n) / period);
+  const uint16_t w = l.width ? l.width : 1;
+  // tail intensity falls off linearly behind the head, wrapping around
+  for (uint16_t i = 0; i < n; ++i) {
+    int32_t d = (int32_t)head - i;
+    if (d < 0) d += n;
+    const uint16_t k = d < w ? (uint16_t)(((w - d) << 8) / w) : 0;   // 0..256
+    f.r[i] = (uint8_t)((l.r * k) >> 8);
+    f.g[i] = (uint8_t)((l.g * k) >> 8);
+    f.b[i] = (uint8_t)((l.b * k) >> 8);
+  }
+}
+
+static void evaluate(Slot& s, const Frame& f, uint32_t now, bool gamma) {
+  const Layer& l = s.l;
+  switch (l.kind) {
+    case LayerKind::Breath: {
+      s.breath.prepare(l.breath);
+      uint16_t q = s.breath.level(now);
+      if (gamma) q = fx::gamma_q16(q);
+      fillConst(f, fx::scale8(l.breath.r, q), fx::scale8(l.breath.g, q), fx::scale8(l.breath.b, q));
+      break;
+    }
+    case LayerKind::Flicker: {
+      s.flicker.prepare(l.flicker);
+      const uint8_t gate = s.flicker.gate(now);
+      fillConst(f, l.r * gate, l.g * gate, l.b * gate);
+      break;
+    }
+    case LayerKind::Gradient:
+      ramp(f.r, f.n, l.r, l.r2);
+      ramp(f.g, f.n, l.g, l.g2);
+      ramp(f.b, f.n, l.b, l.b2);
+      break;
+    case LayerKind::Chase:
+      chase(f, l, now);
+      break;
+    default:
+      break;
+  }
+}
+
+// ---------- blending (one channel per call; plain loops) ----------
+// a = opacity + 1 (1..256), so 255 is exact without a divide
+static void blendCh(Blend m, uint8_t* __restrict d, const uint8_t* __restrict s, uint16_t n, uint16_t a) {
+  switch (m) {
+    case Blend::Replace:
+      if (a == 256) { memcpy(d, s, n); break; }
+      for (uint16_t i = 0; i < n; ++i) d[i] = (uint8_t)(d[i] + ((((int16_t)s[i] - d[i]) * a) >> 8));
+      break;
+    case Blend::Add:
+      for (uint16_t i = 0; i < n; ++i) {
+        const uint16_t v = d[i] + ((s[i] * a) >> 8);
+        d[i] = v > 255 ? 255 : (uint8_t)v;
+      }
+      break;
+    case Blend::Multiply:
+      for (uint16_t i = 0; i < n; ++i) {
+        const uint16_t m = 255 - (((255 - s[i]) * a) >> 8);
+        d[i] = (uint8_t)((d[i] * (m + 1)) >> 8);
+      }
+      break;
+    case Blend::Max:
+      for (uint16_t i = 0; i < n; ++i) {
+        const uint8_t v = (uint8_t)((s[i] * a) >> 8);
+        d[i] = v > d[i] ? v : d[i];
+      }
+      break;
+  }
+}
+
+static void compose(uint32_t now, const Frame& out, const Frame& tmp, uint8_t layers, bool gamma) {
+  fillConst(out, 0, 0, 0);
+  for (uint8_t i = 0; i < layers; ++i) {
+    Slot& s = s_slot[i];
+    if (s.l.kind == LayerKind::None || s.l.opacity == 0) continue;
+    evaluate(s, tmp, now, gamma);
+    const uint16_t a = (uint16_t)s.l.opacity + 1;
+    blendCh(s.l.blend, out.r, tmp.r, out.n, a);
+    blendCh(s.l.blend, out.g, tmp.g, out.n, a);
+    blendCh(s.l.blend, out.b, tmp.b, out.n, a);
+  }
+}
+
+static void frames(uint8_t* mem, uint16_t n, Frame& out, Frame& tmp) {
+  out = Frame{ mem,         mem + n,     mem + 2 * n, n };
+  tmp = Frame{ mem + 3 * n, mem + 4 * n, mem + 5 * n, n };
+}
+
+// ---------- public ----------
+void setLayer(uint8_t slot, const Layer& l) {
+  if (slot >= MAX_LAYERS) return;
+  s_slot[slot].l = l;
+  s_slot[slot].breath.valid  = false;   // restart the cue's phase state
+  s_slot[slot].flicker.valid = false;
+}
+
+void clearLayer(uint8_t slot) { if (slot < MAX_LAYERS) s_slot[slot].l = Layer{}; }
+void clearLayers()            { for (uint8_t i = 0; i < MAX_LAYERS; ++i) clearLayer(i); }
+
+uint8_t activeLayers() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < MAX_LAYERS; ++i) n += s_slot[i].l.kind != LayerKind::None ? 1 : 0;
+  return n;
+}
+
+void renderLayers(uint32_t now) {
+  const uint16_t n = count();
+  if (!n || !allocFor(n)) return;
+  Frame out, tmp;
+  frames(s_mem, n, out, tmp);
+  compose(now, out, tmp, MAX_LAYERS, gammaEnabled());
+  showFrame(now, out.r, out.g, out.b);
+}
+
+void benchLayers(Print& out) {
+  static const uint16_t SIZES[] = { 30, 144, 300, 1000 };
+  static const uint32_t FRAMES = 200;
+
+  uint8_t* mem = new (std::nothrow) uint8_t[1000 * 6];
+  if (!mem) return;
+  Slot saved[MAX_LAYERS];
+  for (uint8_t i = 0; i < MAX_LAYERS; ++i) saved[i] = s_slot[i];
+
+  // a typical stack: breath, gradient tint, chase on top, flicker gate
+  Layer l[MAX_LAYERS];
+  l[0].kind = LayerKind::Breath;   l[0].breath.mode = MODE_BREATH;
+  l[0].breath.r = 255; l[0].breath.g = 80; l[0].breath.b = 20;
+  l[0].breath.b_min = fx::unit_q16(0.05f); l[0].breath.b_max = 0xFFFF; l[0].breath.up_ms = 1500; l[0].breath.down_ms = 1500;
+  l[1].kind = LayerKind::Gradient; l[1].blend = Blend::Multiply; l[1].r2 = 40; l[1].g2 = 40; l[1].b2 = 255;
+  l[2].kind = LayerKind::Chase;    l[2].blend = Blend::Add; l[2].width = 8;
+  l[3].kind = LayerKind::Flicker;  l[3].blend = Blend::Multiply; l[3].flicker.mode = MODE_FLICKER;
+  l[3].flicker.on_ms = 60; l[3].flicker.off_ms = 40;
+
+  out.println("LEDS layers: compose us per frame (no show)");
+  out.println("  pixels   1 layer  2 layers  3 layers  4 layers");
+  for (uint16_t n : SIZES) {
+    Frame o, t;
+    frames(mem, n, o, t);
+    out.printf("  %6u", n);
+    for (uint8_t k = 1; k <= MAX_LAYERS; ++k) {
+      for (uint8_t i = 0; i < MAX_LAYERS; ++i) setLayer(i, i < k ? l[i] : Layer{});
+      const uint32_t t0 = micros();
+      for (uint32_t f = 0; f < FRAMES; ++f) compose(f * 16, o, t, k, true);
+      out.printf("  %8lu", (unsigned long)((micros() - t0) / FRAMES));
+    }
+    out.println();
+  }
+  delete[] mem;
+  for (uint8_t i = 0; i < MAX_LAYERS; ++i) s_slot[i] = saved[i];
+}
+
+} // namespace leds
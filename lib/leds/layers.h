@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+#include <stdint.h>
+#include <message.h>
+
+// Layered per-pixel compositor on top of leds::showFrame().
+//
+// Up to MAX_LAYERS slots, composed bottom (0) to top each frame into
+// structure-of-arrays R/G/B buffers: a layer is evaluated into a scratch
+// frame, then blended channel by channel into the output, so every inner
+// loop is a plain pass over one uint8_t array. Breath and Flicker layers
+// reuse the fixed-point cue math of the renderers (fixmath.h).
+//
+// renderCombined(breath, flicker) is
+//   slot 0: Breath, Replace      slot 1: Flicker (white), Multiply
+namespace leds {
+
+enum class Blend : uint8_t {
+  Replace,    // src over dst by opacity
+  Add,        // saturating
+  Multiply,   // dst * src / 255: gates and masks
+  Max,        // lighten
+};
+
+enum class LayerKind : uint8_t {
+  None,
+  Breath,     // breath.r/g/b scaled by the breath level (gamma as setGamma)
+  Flicker,    // r/g/b while the flicker gate is open, else black
+  Gradient,   // r/g/b at pixel 0 to r2/g2/b2 at the last pixel
+  Chase,      // r/g/b dot with a `width`-pixel tail, one pass per period_ms
+};
+
+struct Layer {
+  LayerKind  kind    = LayerKind::None;
+  Blend      blend   = Blend::Replace;
+  uint8_t    opacity = 255;
+  uint8_t    r = 255, g = 255, b = 255;
+  uint8_t    r2 = 0, g2 = 0, b2 = 0;
+  uint16_t   period_ms = 2000;
+  uint8_t    width     = 4;
+  BreathCue  breath  = {};
+  FlickerMsg flicker = {};
+};
+
+static const uint8_t MAX_LAYERS = 4;
+
+void setLayer(uint8_t slot, const Layer& l);   // replaces the slot
+void clearLayer(uint8_t slot);
+void clearLayers();
+uint8_t activeLayers();
+
+// Compose all layers for `now` and hand the frame to showFrame()
+void renderLayers(uint32_t now);
+
+// Compose time per frame (no show) for 30/144/300/1000 pixels and 1..4 layers
+void benchLayers(Print& out);
+
+} // namespace leds
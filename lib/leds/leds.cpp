@@ -1,4 +1,7 @@
 #include "leds.h"
+#include "dotstar_dma.h"
+#include "fixmath.h"
+#include "frame.h"
 #include <Arduino.h>
 #include <math.h>
 
@@ -10,41 +13,149 @@ static uint8_t s_spacing = 1;     // group size
 static uint8_t s_onCount = 1;     // how many ON in each group
 static uint8_t s_defR = 0, s_defG = 0, s_defB = 127;
 
+// Frame governor: renderers show at most every s_frame_ms, and only when the
+// frame differs from the last one shown. Renderers paint one colour through
+// the grouping mask, so that colour identifies the frame; anything else that
+// touches the strip (setPixel, setGrouping, setBrightness) marks it dirty.
+static uint16_t    s_frame_ms = 1000 / 60;
+static uint32_t    s_last_show_ms = 0;
+static bool        s_dirty = true;
+static uint8_t     s_lastR = 0, s_lastG = 0, s_lastB = 0;
+static bool        s_perPixel = false;   // strip holds a showFrame() frame, not one colour
+static RenderStats s_stats = {};
+static uint64_t    s_show_us_sum = 0;
+
+// Fixed-point cue state for the renderers (fixmath.h): prepared once per
+// message, then integer-only per frame.
+static fx::Breath  s_fxBreath;
+static fx::Flicker s_fxFlicker;
+static bool        s_gamma = true;
+
+static void timedShow(){
+  const uint32_t t = micros();
+  if (dma::active()) dma::show(s_strip->getPixels(), s_count, s_strip->getBrightness());
+  else               s_strip->show();
+  const uint32_t us = micros() - t;
+  s_stats.shown++;
+  s_stats.show_us_last = us;
+  if (us > s_stats.show_us_max) s_stats.show_us_max = us;
+  s_show_us_sum += us;
+}
+
+// Paint one colour through the grouping mask, if due and changed
+static void present(uint32_t now, uint8_t r, uint8_t g, uint8_t b){
+  if (!s_dirty && !s_perPixel && r == s_lastR && g == s_lastG && b == s_lastB) { s_stats.skipped++; return; }
+  if (s_frame_ms && (now - s_last_show_ms) < s_frame_ms)      { s_stats.throttled++; return; }
+
+  for (int i=0;i<s_count;++i){
+    if (frame::lit(i, s_spacing, s_onCount)) s_strip->setPixelColor(i, r, g, b);
+    else                             s_strip->setPixelColor(i, 0, 0, 0);
+  }
+  timedShow();
+  s_last_show_ms = now;
+  s_lastR = r; s_lastG = g; s_lastB = b;
+  s_dirty = false;
+  s_perPixel = false;
+}
+
+// Per-pixel frame (compositor). The strip's pixel buffer holds what is on
+// the wire, so it doubles as the copy to compare against.
+void showFrame(uint32_t now, const uint8_t* r, const uint8_t* g, const uint8_t* b){
+  if (!s_strip) return;
+  bool changed = s_dirty;
+  for (int i=0; i<s_count && !changed; ++i){
+    const uint32_t c = frame::lit(i, s_spacing, s_onCount)
+                     ? ((uint32_t)r[i] << 16 | (uint32_t)g[i] << 8 | b[i]) : 0;
+    changed = s_strip->getPixelColor(i) != c;
+  }
+  if (!changed)                                          { s_stats.skipped++; return; }
+  if (s_frame_ms && (now - s_last_show_ms) < s_frame_ms) { s_stats.throttled++; return; }
+
+  for (int i=0;i<s_count;++i){
+    if (frame::lit(i, s_spacing, s_onCount)) s_strip->setPixelColor(i, r[i], g[i], b[i]);
+    else                             s_strip->setPixelColor(i, 0, 0, 0);
+  }
+  timedShow();
+  s_last_show_ms = now;
+  s_dirty = false;
+  s_perPixel = true;
+}
+
 void setup(uint16_t count, uint8_t dataPin, uint8_t clockPin, uint8_t order) {
   if (s_strip) { delete s_strip; s_strip = nullptr; }
+  dma::end();
   s_count  = count;
   s_strip  = new Adafruit_DotStar(count, dataPin, clockPin, order);
   s_strip->begin();
   s_strip->clear();
   s_strip->show();
+  s_lastR = s_lastG = s_lastB = 0;
+  s_dirty = false;
 }
 
-void setBrightness(uint8_t b){ if (s_strip) s_strip->setBrightness(b); }
+bool setupDma(uint16_t count, uint8_t dataPin, uint8_t clockPin, uint32_t clockHz, uint8_t order) {
+  if (s_strip) { delete s_strip; s_strip = nullptr; }
+  if (!dma::begin(count, dataPin, clockPin, clockHz)) {
+    setup(count, dataPin, clockPin, order);   // keep the strip working, bit-banged
+    return false;
+  }
+  s_count  = count;
+  s_strip  = new Adafruit_DotStar(count, order);   // pixel buffer only: no begin(), no show()
+  s_strip->clear();
+  timedShow();
+  s_lastR = s_lastG = s_lastB = 0;
+  s_dirty = false;
+  return true;
+}
+
+bool usingDma(){ return dma::active(); }
+
+void setBrightness(uint8_t b){ if (s_strip) { s_strip->setBrightness(b); s_dirty = true; } }
 
 void setGrouping(uint8_t spacing, uint8_t onCount){
   s_spacing = spacing ? spacing : 1;
   s_onCount = onCount ? onCount : 1;
   if (s_onCount > s_spacing) s_onCount = s_spacing;
+  s_dirty = true;
 }
 
+void setGamma(bool on){ s_gamma = on; s_dirty = true; }
+bool gammaEnabled(){ return s_gamma; }
+
+void setMaxFps(uint16_t fps){ s_frame_ms = fps ? (uint16_t)(1000 / fps) : 0; }
+
+RenderStats renderStats(){
+  RenderStats st = s_stats;
+  st.show_us_avg = st.shown ? (uint32_t)(s_show_us_sum / st.shown) : 0;
+  return st;
+}
+
+void resetRenderStats(){ s_stats = {}; s_show_us_sum = 0; }
+
 void setDefaultFlickerColor(uint8_t r,uint8_t g,uint8_t b){ s_defR=r; s_defG=g; s_defB=b; }
 
 void clear(){
   if (!s_strip) return;
   s_strip->clear();
-  s_strip->show();
+  timedShow();
+  s_lastR = s_lastG = s_lastB = 0;
+  s_dirty = false;
+  s_perPixel = false;
 }
 
 void fill(uint8_t r,uint8_t g,uint8_t b){
   if (!s_strip) return;
   for (int i=0;i<s_count;++i){
-    if ((i % s_spacing) < s_onCount) s_strip->setPixelColor(i, r, g, b);
+    if (frame::lit(i, s_spacing, s_onCount)) s_strip->setPixelColor(i, r, g, b);
     else                             s_strip->setPixelColor(i, 0, 0, 0);
   }
-  s_strip->show();
+  timedShow();
+  s_lastR = r; s_lastG = g; s_lastB = b;
+  s_dirty = false;
+  s_perPixel = false;
 }
 
-void show(){ if (s_strip) s_strip->show(); }
+void show(){ if (s_strip) timedShow(); }
 
 void selfTest(){
   if (!s_strip) return;
@@ -54,21 +165,54 @@ void selfTest(){
   fill(0,0,0);
 }
 
+// ---------- benchmark ----------
+void benchShow(Print& out, uint8_t dataPin, uint8_t clockPin, uint32_t clockHz){
+  static const uint16_t SIZES[] = { 30, 144, 300, 1000 };
+  static const int FRAMES = 50;
+  const uint16_t prevCount = s_count;
+  const bool     prevDma   = dma::active();
+  const uint16_t prevFrame = s_frame_ms;
+  s_frame_ms = 0;
+
+  out.printf("LEDS bench: CPU us per frame (dma clock %lu Hz)\n", (unsigned long)clockHz);
+  out.println("  pixels  bitbang    dma  (dma wire us)");
+  for (uint16_t n : SIZES) {
+    uint32_t us[2] = {0, 0};
+    for (int useDma = 0; useDma < 2; ++useDma) {
+      if (useDma) setupDma(n, dataPin, clockPin, clockHz);
+      else        setup(n, dataPin, clockPin);
+      resetRenderStats();
+      for (int f = 0; f < FRAMES; ++f) fill((uint8_t)(f * 5), 0, (uint8_t)(255 - f * 5));
+      us[useDma] = renderStats().show_us_avg;
+      dma::flush();
+    }
+    out.printf("  %6u  %7lu  %5lu  (%lu)\n", n, (unsigned long)us[0], (unsigned long)us[1],
+               (unsigned long)((uint64_t)dma::frame_bytes(n) * 8 * 1000000ULL / clockHz));
+  }
+
+  s_frame_ms = prevFrame;
+  if (prevDma) setupDma(prevCount, dataPin, clockPin, clockHz);
+  else         setup(prevCount, dataPin, clockPin);
+  fill(0, 0, 0);
+  resetRenderStats();
+}
+
 // ---------- math ----------
 float clamp01(float x){ return x<0?0:(x>1?1:x); }
 float easeCos(float x){ return 0.5f * (1.0f - cosf(3.1415926f * x)); }
 
-float breathBrightness(uint32_t now, const BreathMsg& p){
+float breathBrightness(uint32_t now, const BreathCue& p){
   if (p.mode != MODE_BREATH) return 0.0f;
-  if (now < p.t0_ms) return p.b_min;
+  const float b_min = p.b_min / 65535.0f, b_max = p.b_max / 65535.0f;
+  if ((int32_t)(now - p.t0_ms) < 0) return b_min;   // before start (wrap-safe)
 
   const uint32_t period = p.up_ms + p.down_ms;
-  if (!period) return p.b_min;
+  if (!period) return b_min;
 
   const uint32_t elapsed = now - p.t0_ms;
   if (p.cycles){
     const uint32_t total = (uint32_t)p.cycles * period;
-    if (elapsed >= total) return p.b_min;
+    if (elapsed >= total) return b_min;
   }
 
   const uint32_t t = elapsed % period;
@@ -76,22 +220,22 @@ float breathBrightness(uint32_t now, const BreathMsg& p){
             ? easeCos((float)t / (float)p.up_ms)
             : easeCos(1.0f - (float)(t - p.up_ms) / (float)p.down_ms);
 
-  return p.b_min + (p.b_max - p.b_min) * a;
+  return b_min + (b_max - b_min) * a;
 }
 
-bool breathFinished(uint32_t now, const BreathMsg& p){
+bool breathFinished(uint32_t now, const BreathCue& p){
   if (p.mode != MODE_BREATH) return true;
   const uint32_t period = p.up_ms + p.down_ms;
   if (!period) return true;
   if (p.cycles == 0) return false;
-  if (now < p.t0_ms) return false;
+  if ((int32_t)(now - p.t0_ms) < 0) return false;
   const uint32_t total = (uint32_t)p.cycles * period;
   return (now - p.t0_ms) >= total;
 }
 
 uint8_t flickerGate(uint32_t now, const FlickerMsg& f){
   if (f.mode != MODE_FLICKER) return 1;
-  if (now < f.t0_ms) return 0;
+  if ((int32_t)(now - f.t0_ms) < 0) return 0;
 
   const uint32_t period = (uint32_t)f.on_ms + f.off_ms;
   if (!period) return 1;
@@ -107,35 +251,21 @@ uint8_t flickerGate(uint32_t now, const FlickerMsg& f){
 }
 
 // ---------- render ----------
-void renderBreath(uint32_t now, const BreathMsg& p){
+void renderBreath(uint32_t now, const BreathCue& p){
   if (!s_strip) return;
-  const float b = clamp01(breathBrightness(now, p));
-  const uint8_t rr = (uint8_t)(p.r * b);
-  const uint8_t gg = (uint8_t)(p.g * b);
-  const uint8_t bb = (uint8_t)(p.b * b);
-
-  for (int i=0;i<s_count;++i){
-    if ((i % s_spacing) < s_onCount) s_strip->setPixelColor(i, rr, gg, bb);
-    else                             s_strip->setPixelColor(i, 0, 0, 0);
-  }
-  s_strip->show();
+  s_fxBreath.prepare(p);
+  const frame::Rgb c = frame::colour(&s_fxBreath, nullptr, frame::Rgb{ s_defR, s_defG, s_defB }, s_gamma, now);
+  present(now, c.r, c.g, c.b);
 }
 
 void renderFlickerOnly(uint32_t now, const FlickerMsg& f){
   if (!s_strip) return;
-  const uint8_t gate = flickerGate(now, f);
-  const uint8_t rr = s_defR * gate;
-  const uint8_t gg = s_defG * gate;
-  const uint8_t bb = s_defB * gate;
-
-  for (int i=0;i<s_count;++i){
-    if ((i % s_spacing) < s_onCount) s_strip->setPixelColor(i, rr, gg, bb);
-    else                             s_strip->setPixelColor(i, 0, 0, 0);
-  }
-  s_strip->show();
+  s_fxFlicker.prepare(f);
+  const frame::Rgb c = frame::colour(nullptr, &s_fxFlicker, frame::Rgb{ s_defR, s_defG, s_defB }, s_gamma, now);
+  present(now, c.r, c.g, c.b);
 }
 
-void renderCombined(uint32_t now, const BreathMsg& breath, const FlickerMsg& flicker){
+void renderCombined(uint32_t now, const BreathCue& breath, const FlickerMsg& flicker){
   if (!s_strip) return;
 
   if (breath.mode != MODE_BREATH && flicker.mode == MODE_FLICKER){
@@ -143,25 +273,19 @@ void renderCombined(uint32_t now, const BreathMsg& breath, const FlickerMsg& fli
     return;
   }
 
-  const float breathVal = clamp01(breathBrightness(now, breath));
-  const uint8_t gate    = flickerGate(now, flicker);
-  const float k         = breathVal * (gate ? 1.0f : 0.0f);
-
-  const uint8_t rr = (uint8_t)(breath.r * k);
-  const uint8_t gg = (uint8_t)(breath.g * k);
-  const uint8_t bb = (uint8_t)(breath.b * k);
-
-  for (int i=0;i<s_count;++i){
-    if ((i % s_spacing) < s_onCount) s_strip->setPixelColor(i, rr, gg, bb);
-    else                             s_strip->setPixelColor(i, 0, 0, 0);
-  }
-  s_strip->show();
+  s_fxBreath.prepare(breath);
+  s_fxFlicker.prepare(flicker);
+  const frame::Rgb c = frame::colour(&s_fxBreath, &s_fxFlicker, frame::Rgb{ s_defR, s_defG, s_defB }, s_gamma, now);
+  present(now, c.r, c.g, c.b);
 }
 
-void setPixel(uint16_t i, uint8_t r, uint8_t g, uint8_t b) {   // <-- implement this
+void setPixel(uint16_t i, uint8_t r, uint8_t g, uint8_t b) {
   if (!s_strip) return;
   if (i >= s_count) return;
   s_strip->setPixelColor(i, r, g, b);
+  s_dirty = true;   // next render repaints the whole strip
 }
 
+uint16_t count() { return s_count; }
+
 } // namespace leds
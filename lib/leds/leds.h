@@ -1,15 +1,40 @@
 #pragma once
+#include <Arduino.h>
 #include <stdint.h>
 #include <Adafruit_DotStar.h>
 #include <message.h>
 
 namespace leds {
 
+// Render-path counters (renderBreath / renderFlickerOnly / renderCombined)
+struct RenderStats {
+  uint32_t shown;         // strip updates (show() calls, any path)
+  uint32_t skipped;       // frame identical to the one on the strip
+  uint32_t throttled;     // changed, but the frame interval had not elapsed
+  uint32_t show_us_last;  // time spent clocking the strip out
+  uint32_t show_us_max;
+  uint32_t show_us_avg;
+};
+
 // ----- init / config -----
 void setup(uint16_t count, uint8_t dataPin, uint8_t clockPin, uint8_t order = DOTSTAR_BRG);
+// Same strip on the SPI peripheral with double-buffered DMA (dotstar_dma.h):
+// show() costs only the frame encode. Falls back to setup() and returns
+// false if the bus or DMA memory is unavailable.
+bool setupDma(uint16_t count, uint8_t dataPin, uint8_t clockPin,
+              uint32_t clockHz = 8000000, uint8_t order = DOTSTAR_BRG);
+bool usingDma();
 void setBrightness(uint8_t b);
 void setGrouping(uint8_t spacing, uint8_t onCount);
 void setDefaultFlickerColor(uint8_t r,uint8_t g,uint8_t b);
+// Renderers show at most fps frames/s (default 60; 0 = every changed frame)
+// and skip frames identical to the last one shown.
+void setMaxFps(uint16_t fps);
+// Renderers apply a gamma curve (x^2.25) to the breath level so dim
+// breaths step evenly (default on). Levels are perceptual: a linear level
+// L shows the same light at L^(1/2.25) (0.02 -> 0.18, 0.05 -> 0.26).
+void setGamma(bool on);
+bool gammaEnabled();
 
 // ----- simple helpers -----
 void clear();                        // clears and show()
@@ -17,21 +42,32 @@ void fill(uint8_t r,uint8_t g,uint8_t b);
 void show();
 void selfTest();                     // quick RGB flash
 
-// ----- math helpers (pure) -----
+// ----- math helpers (pure; the renderers use the fixed-point versions in fixmath.h) -----
 float clamp01(float x);
 float easeCos(float x);
-float breathBrightness(uint32_t now, const BreathMsg& p);
-bool  breathFinished(uint32_t now, const BreathMsg& p);
+float breathBrightness(uint32_t now, const BreathCue& p);
+bool  breathFinished(uint32_t now, const BreathCue& p);
 uint8_t flickerGate(uint32_t now, const FlickerMsg& f);
 
 // ----- renderers (write to the internal strip) -----
-void renderBreath(uint32_t now, const BreathMsg& p);
+void renderBreath(uint32_t now, const BreathCue& p);
 void renderFlickerOnly(uint32_t now, const FlickerMsg& f);
-void renderCombined(uint32_t now, const BreathMsg& breath, const FlickerMsg& flicker);
+void renderCombined(uint32_t now, const BreathCue& breath, const FlickerMsg& flicker);
+// Per-pixel frame, count() entries per channel (layers.h builds these);
+// same grouping mask, frame-rate limit and skip of unchanged frames
+void showFrame(uint32_t now, const uint8_t* r, const uint8_t* g, const uint8_t* b);
 
 
-void setPixel(uint16_t i, uint8_t r, uint8_t g, uint8_t b);
+void setPixel(uint16_t i, uint8_t r, uint8_t g, uint8_t b);   // no show(); next render repaints
 uint16_t count();  // returns number of pixels passed to setup()
 
+// ----- stats -----
+RenderStats renderStats();
+void resetRenderStats();
+
+// CPU time per show() for 30/144/300/1000 pixels, bit-banged vs DMA. Uses the
+// strip pins, then restores the previous setup with the strip cleared.
+void benchShow(Print& out, uint8_t dataPin, uint8_t clockPin, uint32_t clockHz = 8000000);
+
 } // namespace leds
 
@@ -0,0 +1,166 @@
+#include "render_task.h"
+#include "leds.h"
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <atomic>
+#include <string.h>
+#include <logging.h>
+
+namespace leds {
+namespace task {
+
+static const uint32_t   TASK_STACK = 4096;
+static const BaseType_t TASK_CORE  = 1;   // app core; the radio stack lives on 0
+
+// Snapshot hand-over, a triple buffer. Each slot is owned by one side at a
+// time: s_back by the writer (under s_write_lock), s_front by the task, the
+// third parked in s_mid. publish() fills s_back and exchanges it with s_mid,
+// marking it FRESH; the task exchanges s_front with s_mid only when FRESH is
+// set. s_newest is the slot last published (for published()).
+static const uint8_t         FRESH = 0x4;
+static Snapshot              s_buf[3];
+static std::atomic<uint8_t>  s_mid{1};
+static uint8_t               s_back = 0, s_front = 2, s_newest = 2;
+static SemaphoreHandle_t     s_write_lock = nullptr;
+
+static TaskHandle_t       s_task  = nullptr;
+static esp_timer_handle_t s_timer = nullptr;
+static uint32_t           s_period_us = 0;
+static volatile bool      s_stop = false;
+
+static Stats    s_stats = {};
+static uint64_t s_jitter_sum = 0, s_render_sum = 0;
+
+static void on_tick(void*) {
+  if (s_task) xTaskNotifyGive(s_task);
+}
+
+// Task side: the newest snapshot, swapped in if a writer published one
+static const Snapshot& take_snapshot() {
+  if (s_mid.load(std::memory_order_relaxed) & FRESH) {
+    s_front = s_mid.exchange(s_front, std::memory_order_acq_rel) & 3;
+    s_stats.taken++;
+  }
+  return s_buf[s_front];
+}
+
+// Layers: only touch slots that changed, setLayer() restarts a cue's phase
+static void apply_layers(const Snapshot& s) {
+  static Layer cur[MAX_LAYERS];
+  for (uint8_t i = 0; i < MAX_LAYERS; ++i) {
+    if (memcmp(&cur[i], &s.layers[i], sizeof(Layer)) == 0) continue;
+    cur[i] = s.layers[i];
+    setLayer(i, cur[i]);
+  }
+}
+
+static void render(const Snapshot& s, uint32_t now) {
+  switch (s.effect) {
+    case Effect::Breath:   renderBreath(now, s.breath); break;
+    case Effect::Flicker:  renderFlickerOnly(now, s.flicker); break;
+    case Effect::Combined: renderCombined(now, s.breath, s.flicker); break;
+    case Effect::Layers:   apply_layers(s); renderLayers(now); break;
+    default: {
+      const BreathCue off{};   // mode 0: level 0 -> black, skipped once the strip is dark
+      renderBreath(now, off);
+      break;
+    }
+  }
+}
+
+static void render_task(void*) {
+  int64_t last_wake = 0;
+  while (!s_stop) {
+    const uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (s_stop) break;
+    const int64_t wake = esp_timer_get_time();
+    if (ticks > 1) s_stats.missed += ticks - 1;
+
+    if (last_wake) {
+      const int64_t dt = wake - last_wake - (int64_t)s_period_us * (ticks ? ticks : 1);
+      const uint32_t j = (uint32_t)(dt < 0 ? -dt : dt);
+      if (j > s_stats.jitter_us_max) s_stats.jitter_us_max = j;
+      s_jitter_sum += j;
+    }
+    last_wake = wake;
+
+    render(take_snapshot(), millis());
+
+    const uint32_t us = (uint32_t)(esp_timer_get_time() - wake);
+    if (us > s_stats.render_us_max) s_stats.render_us_max = us;
+    s_render_sum += us;
+    s_stats.frames++;
+  }
+  s_task = nullptr;
+  vTaskDelete(nullptr);
+}
+
+bool start(uint16_t fps, UBaseType_t prio) {
+  if (s_task) return false;
+  if (!fps) fps = 60;
+  if (!s_write_lock) s_write_lock = xSemaphoreCreateMutex();
+  s_period_us = 1000000UL / fps;
+  s_stop = false;
+  setMaxFps(0);
+
+  if (xTaskCreatePinnedToCore(render_task, "leds", TASK_STACK, nullptr, prio, &s_task, TASK_CORE) != pdPASS) {
+    s_task = nullptr;
+    LOGE("LEDS task: create failed");
+    return false;
+  }
+  esp_timer_create_args_t args{};
+  args.callback = on_tick;
+  args.name     = "leds_frame";
+  if (esp_timer_create(&args, &s_timer) != ESP_OK || esp_timer_start_periodic(s_timer, s_period_us) != ESP_OK) {
+    LOGE("LEDS task: frame timer failed");
+    stop();
+    return false;
+  }
+  return true;
+}
+
+void stop() {
+  if (s_timer) { esp_timer_stop(s_timer); esp_timer_delete(s_timer); s_timer = nullptr; }
+  if (!s_task) return;
+  s_stop = true;
+  xTaskNotifyGive(s_task);
+  while (s_task) vTaskDelay(1);   // the task clears it on exit
+}
+
+bool running() { return s_task != nullptr; }
+
+void publish(const Snapshot& s) {
+  if (s_write_lock) xSemaphoreTake(s_write_lock, portMAX_DELAY);
+  s_buf[s_back] = s;
+  s_newest = s_back;
+  s_back = s_mid.exchange(s_back | FRESH, std::memory_order_acq_rel) & 3;
+  s_stats.published++;
+  if (s_write_lock) xSemaphoreGive(s_write_lock);
+}
+
+// The newest slot is only rewritten by a later publish, which the lock keeps out
+Snapshot published() {
+  if (s_write_lock) xSemaphoreTake(s_write_lock, portMAX_DELAY);
+  const Snapshot s = s_buf[s_newest];
+  if (s_write_lock) xSemaphoreGive(s_write_lock);
+  return s;
+}
+
+Stats stats() {
+  Stats st = s_stats;
+  const uint32_t n = st.frames;
+  st.jitter_us_avg = n > 1 ? (uint32_t)(s_jitter_sum / (n - 1)) : 0;
+  st.render_us_avg = n ? (uint32_t)(s_render_sum / n) : 0;
+  return st;
+}
+
+void resetStats() {
+  const uint32_t pub = s_stats.published;
+  s_stats = {};
+  s_stats.published = pub;
+  s_jitter_sum = s_render_sum = 0;
+}
+
+} // namespace task
+} // namespace leds
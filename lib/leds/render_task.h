@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+#include <stdint.h>
+#include <message.h>
+#include "layers.h"
+
+// LED rendering in its own FreeRTOS task on the app core (1), woken by a
+// periodic esp_timer, so console prints, delay()s and motor ticks in loop()
+// no longer show up as frame jitter.
+//
+// The comms side describes what to show with publish(); the task picks the
+// newest Snapshot up at the start of each frame. The hand-over is a triple
+// buffer: a writer fills its own slot and swaps it into the middle, the task
+// swaps the middle out to render from, so neither side ever waits on or
+// reads a slot the other is writing. Writers are serialized with a mutex, so
+// several tasks may publish.
+//
+// While the task runs it owns the strip: other leds:: calls that show
+// (fill, clear, selfTest, render*) must not be used from other tasks.
+namespace leds {
+namespace task {
+
+enum class Effect : uint8_t { Off, Breath, Flicker, Combined, Layers };
+
+struct Snapshot {
+  Effect     effect  = Effect::Off;
+  BreathCue  breath  = {};
+  FlickerMsg flicker = {};
+  Layer      layers[MAX_LAYERS];   // Effect::Layers
+};
+
+struct Stats {
+  uint32_t frames;
+  uint32_t missed;          // timer ticks that found the previous frame still running
+  uint32_t jitter_us_max;   // |wake interval - frame period|
+  uint32_t jitter_us_avg;
+  uint32_t render_us_max;   // snapshot copy + render + show
+  uint32_t render_us_avg;
+  uint32_t taken;           // frames that picked up a new snapshot
+  uint32_t published;
+};
+
+// Start the task and its frame clock; the renderers' own frame limit is
+// turned off (the timer is the frame clock). Returns false if already running
+// or out of memory.
+bool start(uint16_t fps = 60, UBaseType_t prio = 3);
+void stop();
+bool running();
+
+void publish(const Snapshot& s);
+Snapshot published();   // newest snapshot (copy)
+
+Stats stats();
+void  resetStats();
+
+} // namespace task
+} // namespace leds
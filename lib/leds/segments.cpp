@@ -0,0 +1,171 @@
+#include "segments.h"
+#include "leds.h"
+#include "fixmath.h"
+#include "frame.h"
+#include "dotstar_dma.h"
+#include <new>
+#include <logging.h>
+
+namespace leds {
+namespace seg {
+
+struct Segment {
+  Adafruit_DotStar* strip = nullptr;   // pixel buffer; also the output when bit-banged
+  dma::Port         port;              // SPI segments
+  Bus               bus = Bus::BitBang;
+  uint16_t          count = 0;
+
+  bool        hasBreath = false, hasFlicker = false;
+  BreathCue   breath  = {};
+  FlickerMsg  flicker = {};
+  fx::Breath  fxBreath;
+  fx::Flicker fxFlicker;
+
+  uint8_t  spacing = 1, onCount = 1;
+  uint16_t frame_ms = 0;
+  uint32_t last_show_ms = 0;
+  bool     dirty = true;
+  uint8_t  lastR = 0, lastG = 0, lastB = 0;
+};
+
+static Segment  s_seg[MAX_SEGMENTS];
+static uint8_t  s_n = 0;
+static Stats    s_stats = {};
+static uint8_t  s_defR = DEFAULT_FLICKER_R, s_defG = DEFAULT_FLICKER_G, s_defB = DEFAULT_FLICKER_B;
+
+int add(const Cfg& c) {
+  if (s_n >= MAX_SEGMENTS || !c.count) return -1;
+  if (c.bus != Bus::BitBang) {
+    for (uint8_t i = 0; i < s_n; ++i) {
+      if (s_seg[i].bus == c.bus) { LOGW("LEDS seg: SPI host already has a segment"); return -1; }
+    }
+    if (c.bus == Bus::Hspi && dma::active()) { LOGW("LEDS seg: HSPI held by setupDma()"); return -1; }
+  }
+  Segment& g = s_seg[s_n];
+  g = Segment{};
+  g.bus   = c.bus;
+  g.count = c.count;
+  if (c.bus == Bus::BitBang) {
+    g.strip = new (std::nothrow) Adafruit_DotStar(c.count, c.dataPin, c.clockPin, c.order);
+    if (!g.strip) return -1;
+    g.strip->begin();
+  } else {
+    const spi_host_device_t host = c.bus == Bus::Hspi ? HSPI_HOST : VSPI_HOST;
+    if (!g.port.begin(host, c.count, c.dataPin, c.clockPin, c.clockHz)) return -1;
+    g.strip = new (std::nothrow) Adafruit_DotStar(c.count, c.order);   // pixel buffer only
+    if (!g.strip) { g.port.end(); return -1; }
+  }
+  g.strip->clear();
+  s_stats.pixels += c.count;
+  const uint8_t s = s_n++;
+  setGrouping(s, c.spacing, c.onCount);
+  setMaxFps(s, c.fps);
+  return s;
+}
+
+void removeAll() {
+  for (uint8_t i = 0; i < s_n; ++i) {
+    s_seg[i].port.end();
+    delete s_seg[i].strip;
+    s_seg[i] = Segment{};
+  }
+  s_n = 0;
+  s_stats.pixels = 0;
+}
+
+uint8_t count() { return s_n; }
+
+void setBreath(uint8_t s, const BreathCue& m) {
+  if (s >= s_n) return;
+  s_seg[s].breath = m;
+  s_seg[s].hasBreath = m.mode == MODE_BREATH;
+}
+
+void setFlicker(uint8_t s, const FlickerMsg& m) {
+  if (s >= s_n) return;
+  s_seg[s].flicker = m;
+  s_seg[s].hasFlicker = m.mode == MODE_FLICKER;
+}
+
+void setOff(uint8_t s) {
+  if (s >= s_n) return;
+  s_seg[s].hasBreath = s_seg[s].hasFlicker = false;
+}
+
+void apply(const BreathCue& m) {
+  const uint8_t mask = cue_segments(m.flags);
+  for (uint8_t i = 0; i < s_n; ++i) if (!mask || (mask & (1u << i))) setBreath(i, m);
+}
+
+void apply(const FlickerMsg& m) {
+  const uint8_t mask = cue_segments(m.flags);
+  for (uint8_t i = 0; i < s_n; ++i) if (!mask || (mask & (1u << i))) setFlicker(i, m);
+}
+
+void setBrightness(uint8_t b) {
+  for (uint8_t i = 0; i < s_n; ++i) { s_seg[i].strip->setBrightness(b); s_seg[i].dirty = true; }
+}
+
+void setGrouping(uint8_t s, uint8_t spacing, uint8_t onCount) {
+  if (s >= s_n) return;
+  Segment& g = s_seg[s];
+  g.spacing = spacing ? spacing : 1;
+  g.onCount = onCount ? onCount : 1;
+  if (g.onCount > g.spacing) g.onCount = g.spacing;
+  g.dirty = true;
+}
+
+void setMaxFps(uint8_t s, uint16_t fps) {
+  if (s >= s_n) return;
+  s_seg[s].frame_ms = fps ? (uint16_t)(1000 / fps) : 0;
+}
+
+// Same colour rules as the single-strip renderers
+static frame::Rgb colourOf(Segment& g, uint32_t now) {
+  if (g.hasBreath)  g.fxBreath.prepare(g.breath);
+  if (g.hasFlicker) g.fxFlicker.prepare(g.flicker);
+  return frame::colour(g.hasBreath ? &g.fxBreath : nullptr, g.hasFlicker ? &g.fxFlicker : nullptr,
+                       frame::Rgb{ s_defR, s_defG, s_defB }, gammaEnabled(), now);
+}
+
+void render(uint32_t now) {
+  const uint32_t t = micros();
+  bool changed[MAX_SEGMENTS] = {};
+
+  // 1) compute; only segments whose colour changed and whose frame is due
+  //    are repainted, through their grouping mask
+  for (uint8_t i = 0; i < s_n; ++i) {
+    Segment& g = s_seg[i];
+    const frame::Rgb c = colourOf(g, now);
+    if (!g.dirty && c.r == g.lastR && c.g == g.lastG && c.b == g.lastB) { s_stats.skipped++; continue; }
+    if (g.frame_ms && (now - g.last_show_ms) < g.frame_ms)               { s_stats.throttled++; continue; }
+    for (uint16_t k = 0; k < g.count; ++k) {
+      if (frame::lit(k, g.spacing, g.onCount)) g.strip->setPixelColor(k, c.r, c.g, c.b);
+      else                                     g.strip->setPixelColor(k, 0, 0, 0);
+    }
+    g.last_show_ms = now;
+    g.lastR = c.r; g.lastG = c.g; g.lastB = c.b;
+    g.dirty = false;
+    changed[i] = true;
+    s_stats.shown++;
+  }
+  // 2) start the DMA segments, 3) bit-bang the rest while they transmit
+  for (uint8_t i = 0; i < s_n; ++i) {
+    Segment& g = s_seg[i];
+    if (changed[i] && g.bus != Bus::BitBang) g.port.show(g.strip->getPixels(), g.count, g.strip->getBrightness());
+  }
+  for (uint8_t i = 0; i < s_n; ++i) {
+    Segment& g = s_seg[i];
+    if (changed[i] && g.bus == Bus::BitBang) g.strip->show();
+  }
+
+  const uint32_t us = micros() - t;
+  s_stats.frames++;
+  s_stats.frame_us_last = us;
+  if (us > s_stats.frame_us_max) s_stats.frame_us_max = us;
+}
+
+Stats stats() { return s_stats; }
+
+} // namespace seg
+} // namespace leds
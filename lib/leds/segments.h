@@ -0,0 +1,79 @@
+#pragma once
+#include <Arduino.h>
+#include <stdint.h>
+#include <Adafruit_DotStar.h>
+#include <message.h>
+
+// Several physical strips per node, each a segment with its own effect.
+//
+// A segment is a strip on its own pins: bit-banged, or on one of the two
+// SPI hosts with DMA (dotstar_dma.h). render() computes every segment, then
+// queues the DMA segments and clocks the bit-banged ones out while the DMA
+// transfers run, so frame time follows the longest segment instead of the
+// sum. Put the long strips on HSPI / VSPI.
+//
+// At most two segments use DMA: the ESP32 has two free SPI hosts and a
+// segment owns its host. add() refuses a second segment on a host, and HSPI
+// while the single-strip DMA output (leds::setupDma) holds it; any further
+// strips are bit-banged.
+//
+// Each segment has its own grouping mask and frame governor, like
+// leds::setGrouping() / setMaxFps() on the single strip: a segment is shown
+// at most every 1000/fps ms, and only when its colour changed.
+//
+// Cues pick segments with F_SEG0.. in their flags (message.h); no segment
+// bit means every segment. Segments replace leds::setup() / setupDma() on a
+// node (HSPI is shared with the single-strip DMA output).
+namespace leds {
+namespace seg {
+
+static const uint8_t MAX_SEGMENTS = 4;
+
+enum class Bus : uint8_t { BitBang, Hspi, Vspi };
+
+struct Cfg {
+  uint16_t count    = 0;
+  uint8_t  dataPin  = 0;
+  uint8_t  clockPin = 0;
+  Bus      bus      = Bus::BitBang;
+  uint32_t clockHz  = 8000000;   // SPI buses only
+  uint8_t  order    = DOTSTAR_BRG;
+  uint8_t  spacing  = 1;         // grouping: onCount lit of every spacing pixels
+  uint8_t  onCount  = 1;
+  uint16_t fps      = 60;        // 0 = every changed frame
+};
+
+struct Stats {
+  uint32_t frames;
+  uint32_t frame_us_last;   // render() incl. encode / bit-bang, not the DMA wire time
+  uint32_t frame_us_max;
+  uint32_t pixels;          // over all segments
+  uint32_t shown;           // segment frames put on a strip
+  uint32_t skipped;         // segment colour unchanged
+  uint32_t throttled;       // changed, but the segment's frame interval had not elapsed
+};
+
+// Returns the segment index, -1 if full or the bus could not be set up
+int  add(const Cfg& c);
+void removeAll();
+uint8_t count();
+
+// Effect per segment, like renderBreath / renderFlickerOnly / renderCombined:
+// a breath is gated by the flicker when both are set
+void setBreath(uint8_t s, const BreathCue& m);
+void setFlicker(uint8_t s, const FlickerMsg& m);
+void setOff(uint8_t s);
+
+// Route a received cue to the segments its flags address
+void apply(const BreathCue& m);
+void apply(const FlickerMsg& m);
+
+void setBrightness(uint8_t b);
+void setGrouping(uint8_t s, uint8_t spacing, uint8_t onCount);
+void setMaxFps(uint8_t s, uint16_t fps);
+void render(uint32_t now);
+
+Stats stats();
+
+} // namespace seg
+} // namespace leds
@@ -0,0 +1,101 @@
+#include "logging.h"
+#include <freertos/task.h>
+
+namespace logging {
+
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+static_assert(LOG_MAX_ARGS <= 8, "print_text() passes at most 8 args");
+
+static const uint32_t DRAIN_TASK_STACK = 3072;
+static const uint32_t DRAIN_IDLE_MS    = 10;
+
+// Several tasks log, one drains: the enqueue is a short critical section
+// (a 42-byte copy), the drain runs unlocked on its own slot.
+static Record       s_ring[LOG_RING_SLOTS];
+static volatile uint32_t s_head = 0;   // next write
+static volatile uint32_t s_tail = 0;   // next read
+static portMUX_TYPE s_mux  = portMUX_INITIALIZER_UNLOCKED;
+
+static Print*       s_out  = nullptr;
+static Output       s_mode = Output::Text;
+static TaskHandle_t s_task = nullptr;
+static Stats        s_stats = {};
+
+void write(uint8_t level, const char* fmt, uint8_t nargs, const uint32_t* args) {
+  if (nargs > LOG_MAX_ARGS) nargs = LOG_MAX_ARGS;
+  const uint32_t now = millis();
+
+  portENTER_CRITICAL(&s_mux);
+  const uint32_t depth = s_head - s_tail;
+  if (depth >= LOG_RING_SLOTS) {
+    s_stats.dropped++;
+    portEXIT_CRITICAL(&s_mux);
+    return;
+  }
+  Record& r = s_ring[s_head & (LOG_RING_SLOTS - 1)];
+  r.t_ms  = now;
+  r.fmt   = (uint32_t)(uintptr_t)fmt;
+  r.level = level;
+  r.nargs = nargs;
+  for (uint8_t i = 0; i < nargs; ++i) r.args[i] = args[i];
+  s_head++;
+  s_stats.written++;
+  if (depth + 1 > s_stats.depth_max) s_stats.depth_max = depth + 1;
+  portEXIT_CRITICAL(&s_mux);
+}
+
+static void print_text(Print& out, const Record& r) {
+  static const char LEVEL_CH[] = "-EWIDV";
+  uint32_t a[8] = {};
+  memcpy(a, r.args, sizeof(r.args));
+  char line[192];
+  // Unused trailing args are ignored by the formatter; all args are 32-bit
+  // on the ESP32, so %d/%u/%x/%c/%p/%s/%lu read them correctly.
+  snprintf(line, sizeof(line), (const char*)(uintptr_t)r.fmt,
+           a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+  out.printf("%c %lu.%03lu %s\n", LEVEL_CH[r.level < 6 ? r.level : 0],
+             (unsigned long)(r.t_ms / 1000), (unsigned long)(r.t_ms % 1000), line);
+}
+
+static void print_binary(Print& out, const Record& r) {
+  out.write(BIN_MAGIC0);
+  out.write(BIN_MAGIC1);
+  out.write((const uint8_t*)&r, sizeof(r));
+}
+
+static void drain_task(void*) {
+  for (;;) {
+    if (s_tail == s_head) { vTaskDelay(pdMS_TO_TICKS(DRAIN_IDLE_MS)); continue; }
+
+    // Only this task advances s_tail and writers never touch a slot in
+    // [tail, head), so the record can be printed without the lock.
+    const Record& r = s_ring[s_tail & (LOG_RING_SLOTS - 1)];
+    if (s_mode == Output::Binary) print_binary(*s_out, r);
+    else                          print_text(*s_out, r);
+
+    portENTER_CRITICAL(&s_mux);
+    s_tail++;
+    s_stats.drained++;
+    portEXIT_CRITICAL(&s_mux);
+  }
+}
+
+void begin(Print& out, Output mode, uint8_t task_prio) {
+  s_out  = &out;
+  s_mode = mode;
+  if (!s_task) {
+    xTaskCreatePinnedToCore(drain_task, "log_drain", DRAIN_TASK_STACK, nullptr,
+                            task_prio, &s_task, tskNO_AFFINITY);
+  }
+}
+
+void set_output(Output mode) { s_mode = mode; }
+
+Stats stats() {
+  portENTER_CRITICAL(&s_mux);
+  Stats st = s_stats;
+  portEXIT_CRITICAL(&s_mux);
+  return st;
+}
+
+} // namespace logging
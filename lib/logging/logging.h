@@ -0,0 +1,119 @@
+// lib/logging/logging.h
+#pragma once
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+// Deferred logging: a LOGx() call stores a compact binary record (format
+// pointer + up to LOG_MAX_ARGS 32-bit args) into a RAM ring and returns; a
+// low-priority task formats and prints it later. Levels above LOG_LEVEL are
+// removed at compile time (arguments are not even evaluated).
+//
+// Rules for call sites:
+//  - fmt must be a string literal (its address is the format id)
+//  - args must be integers, enums, chars or pointers (no float/double/64-bit)
+//  - %s args must point to static strings (they are read when drained)
+//  - not for ISRs
+
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_WARN    2
+#define LOG_LEVEL_INFO    3
+#define LOG_LEVEL_DEBUG   4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_MAX_ARGS
+#define LOG_MAX_ARGS 8
+#endif
+
+#ifndef LOG_RING_SLOTS
+#define LOG_RING_SLOTS 128   // power of two
+#endif
+
+namespace logging {
+
+// One record on the wire / in the ring (little endian, packed)
+struct __attribute__((packed)) Record {
+  uint32_t    t_ms;
+  uint32_t    fmt;                 // format string address (format id)
+  uint8_t     level;
+  uint8_t     nargs;
+  uint32_t    args[LOG_MAX_ARGS];
+};
+
+// Binary output framing: BIN_MAGIC0 BIN_MAGIC1 then sizeof(Record) bytes
+static const uint8_t BIN_MAGIC0 = 0xA5;
+static const uint8_t BIN_MAGIC1 = 0x5A;
+
+enum class Output : uint8_t { Text, Binary };
+
+struct Stats {
+  uint32_t written;   // records accepted
+  uint32_t dropped;   // ring full
+  uint32_t drained;   // records printed
+  uint32_t depth_max; // ring high-water mark
+};
+
+// Start the drain task printing to `out`. Records logged before begin()
+// are kept (up to the ring size) and printed once it runs.
+void begin(Print& out, Output mode = Output::Text, uint8_t task_prio = 1);
+void set_output(Output mode);
+Stats stats();
+
+// Enqueue (use the LOGx macros)
+void write(uint8_t level, const char* fmt, uint8_t nargs, const uint32_t* args);
+
+template <class T>
+static inline uint32_t to_arg(T v) {
+  static_assert(!std::is_floating_point<T>::value, "log args: no float/double (scale to an integer)");
+  static_assert(sizeof(T) <= sizeof(long), "log args: no 64-bit values");  // long is 32-bit on the ESP32
+  return (uint32_t)v;
+}
+template <class T>
+static inline uint32_t to_arg(T* p) { return (uint32_t)(uintptr_t)p; }
+
+static inline void emit(uint8_t level, const char* fmt) { write(level, fmt, 0, nullptr); }
+
+template <class... A>
+static inline void emit(uint8_t level, const char* fmt, A... a) {
+  static_assert(sizeof...(A) <= LOG_MAX_ARGS, "too many log args");
+  const uint32_t v[] = { to_arg(a)... };
+  write(level, fmt, (uint8_t)sizeof...(A), v);
+}
+
+} // namespace logging
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOGE(fmt, ...) ::logging::emit(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define LOGE(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOGW(fmt, ...) ::logging::emit(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOGW(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOGI(fmt, ...) ::logging::emit(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOGI(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOGD(fmt, ...) ::logging::emit(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOGD(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOGV(fmt, ...) ::logging::emit(LOG_LEVEL_VERBOSE, fmt, ##__VA_ARGS__)
+#else
+#define LOGV(...) ((void)0)
+#endif
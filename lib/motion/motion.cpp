@@ -2,6 +2,10 @@
 #include "motion.h"
 #include <Arduino.h>
 #include "../hw/pins.h"
+#include <driver/mcpwm.h>
+#include <hal/mcpwm_ll.h>
+#include <soc/mcpwm_struct.h>
+#include <logging.h>
 
 namespace motion {
 
@@ -12,16 +16,40 @@ namespace {
 
   volatile int step_idx = 0;
 
-  unsigned long start_ms = 0;
   int minDelay_us = 12 * 1000;
   int maxDelay_us = 55 * 1000;
-  float rampK = 0.65f;
+
+  // ------- ramp profiles -------
+  profile::Tables tables;
+  profile::Ramp   ramp;
+  volatile bool   ramping  = false;   // blocks the closed-loop handover
+  bool            stopping = false;   // stop() when the ramp ends
+  Curve    spinupCurve = Curve::Exponential;
+  uint32_t spinup_ms   = 7085;
+  uint32_t stop_ms     = 1500;
 
   volatile int currentDelay_us = 3000; // overwritten at start
   volatile bool running = false;
   volatile bool accelerated = false;
 
   uint8_t baseDuty = PWM_DEFAULT_DUTY;
+  Backend out = Backend::Ledc;
+
+  // ------- zero-cross / closed loop -------
+  volatile bool zcEnabled   = false;
+  volatile bool closedLoop  = false;
+  volatile bool lostSync    = false;   // set in the ISR, handled in tick()
+  volatile bool zcSeen      = false;   // crossing accepted in the current step
+  volatile int  applied_idx = 5;       // step currently on the outputs
+  volatile uint32_t lastComm_us = 0;
+  volatile uint32_t lastZc_us   = 0;
+  volatile int  step_us     = 0;       // closed-loop estimate of one 60-degree step
+  volatile int  goodRun     = 0;
+  volatile int  missed      = 0;
+  int handoverSteps = 36;
+  int minStep_us    = 1500;
+  int lostSteps     = 6;
+  ZcStats zc = {};
 
   // 6-step tables (same as before)
   const int8_t HIN[6][3] = {
@@ -30,6 +58,81 @@ namespace {
   const int8_t LIN[6][3] = {
     {0,1,0},{0,0,1},{0,0,1},{1,0,0},{1,0,0},{0,1,0}
   };
+  // Phase left floating in each step: the one whose back-EMF is watched
+  const uint8_t FLOATING[6] = { 2, 1, 0, 2, 1, 0 };
+
+  // MCPWM: phase i is timer/operator i, HIN on generator A, LIN on B.
+  // Per step each phase is chopped (A = PWM, B = complement + dead time),
+  // held low (A forced low -> B on) or floating (one-shot trip: both off).
+  enum PhaseOut : uint8_t { PH_FLOAT, PH_PWM, PH_LOW };
+  PhaseOut PHASE_OUT[6][3];
+
+  void buildPhaseTable() {
+    for (int s = 0; s < 6; ++s)
+      for (int i = 0; i < 3; ++i)
+        PHASE_OUT[s][i] = HIN[s][i] ? PH_PWM : LIN[s][i] ? PH_LOW : PH_FLOAT;
+  }
+
+  inline void IRAM_ATTR mcpwmStep(int s) {
+    for (int i = 0; i < 3; ++i) {
+      switch (PHASE_OUT[s][i]) {
+        case PH_PWM:
+          mcpwm_ll_gen_disable_continue_force_action(&MCPWM0, i, 0);
+          mcpwm_ll_fault_clear_ost(&MCPWM0, i);
+          break;
+        case PH_LOW:
+          mcpwm_ll_gen_set_continue_force_level(&MCPWM0, i, 0, 0);
+          mcpwm_ll_fault_clear_ost(&MCPWM0, i);
+          break;
+        default:
+          mcpwm_ll_fault_trigger_sw_ost(&MCPWM0, i);
+          break;
+      }
+    }
+  }
+
+  inline float dutyPercent(uint8_t d) { return d * 100.0f / 255.0f; }
+
+  bool setupMcpwm(uint32_t hz, uint16_t dead_ns) {
+    static const int HIN_PIN[3] = { HIN1, HIN2, HIN3 };
+    static const int LIN_PIN[3] = { LIN1, LIN2, LIN3 };
+    for (int i = 0; i < 3; ++i) {
+      if (mcpwm_gpio_init(MCPWM_UNIT_0, (mcpwm_io_signals_t)(MCPWM0A + 2 * i), HIN_PIN[i]) != ESP_OK) return false;
+      if (mcpwm_gpio_init(MCPWM_UNIT_0, (mcpwm_io_signals_t)(MCPWM0B + 2 * i), LIN_PIN[i]) != ESP_OK) return false;
+    }
+    mcpwm_config_t pc{};
+    pc.frequency    = hz;
+    pc.cmpr_a       = dutyPercent(baseDuty);
+    pc.cmpr_b       = 0;
+    pc.counter_mode = MCPWM_UP_DOWN_COUNTER;   // centre-aligned
+    pc.duty_mode    = MCPWM_DUTY_MODE_0;
+    const uint32_t dt = (dead_ns + 99) / 100;  // 100 ns ticks
+    for (int i = 0; i < 3; ++i) {
+      const mcpwm_timer_t t = (mcpwm_timer_t)i;
+      if (mcpwm_init(MCPWM_UNIT_0, t, &pc) != ESP_OK) return false;
+      if (mcpwm_deadtime_enable(MCPWM_UNIT_0, t, MCPWM_ACTIVE_HIGH_COMPLIMENT_MODE, dt, dt) != ESP_OK) return false;
+    }
+    // Trip actions last, once mcpwm_init() has programmed the generators and
+    // started the timers: the outputs are low when setup() returns.
+    for (int i = 0; i < 3; ++i) {
+      mcpwm_ll_fault_enable_sw_oneshot_mode(&MCPWM0, i, true);
+      for (int g = 0; g < 2; ++g) {
+        mcpwm_ll_generator_set_action_on_trip_event(&MCPWM0, i, g, MCPWM_TIMER_DIRECTION_UP,   MCPWM_TRIP_TYPE_OST, MCPWM_GEN_ACTION_LOW);
+        mcpwm_ll_generator_set_action_on_trip_event(&MCPWM0, i, g, MCPWM_TIMER_DIRECTION_DOWN, MCPWM_TRIP_TYPE_OST, MCPWM_GEN_ACTION_LOW);
+      }
+      mcpwm_ll_fault_trigger_sw_ost(&MCPWM0, i);
+    }
+    return true;
+  }
+
+  void setupLedc() {
+    ledcSetup(HIN1_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(HIN1, HIN1_CH);
+    ledcSetup(HIN2_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(HIN2, HIN2_CH);
+    ledcSetup(HIN3_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(HIN3, HIN3_CH);
+    ledcSetup(LIN1_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(LIN1, LIN1_CH);
+    ledcSetup(LIN2_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(LIN2, LIN2_CH);
+    ledcSetup(LIN3_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(LIN3, LIN3_CH);
+  }
 
   inline void setHIN_PWM(uint8_t phase, int8_t mode) {
     const uint8_t ch = (phase==0)?HIN1_CH:(phase==1)?HIN2_CH:HIN3_CH;
@@ -43,18 +146,102 @@ namespace {
   // ISR: advances commutation step
   void IRAM_ATTR onPwmISR() {
     portENTER_CRITICAL_ISR(&timerMux);
-    for (int i=0;i<3;i++){
-      setHIN_PWM(i, HIN[step_idx][i]);
-      setLIN_PWM(i, LIN[step_idx][i]);
+    if (out == Backend::Mcpwm) {
+      mcpwmStep(step_idx);
+    } else {
+      for (int i=0;i<3;i++){
+        setHIN_PWM(i, HIN[step_idx][i]);
+        setLIN_PWM(i, LIN[step_idx][i]);
+      }
     }
+    applied_idx = step_idx;
     step_idx = (step_idx + 1) % 6;
+
+    if (closedLoop) {
+      missed = zcSeen ? 0 : missed + 1;
+      if (missed >= lostSteps) lostSync = true;
+      // no crossing yet: the next commutation falls one full step later
+      timerAlarmWrite(timer, step_us, true);
+    } else if (!zcSeen) {
+      goodRun = 0;
+    }
+    zcSeen = false;
+    lastComm_us = micros();
     portEXIT_CRITICAL_ISR(&timerMux);
   }
 
-  inline int smoothDelay_us() {
-    unsigned long t = millis() - start_ms;
-    float df = minDelay_us + (maxDelay_us - minDelay_us) * expf(-rampK * (float)t / 1000.0f);
-    return (int)df;
+  // ISR: comparator edge on a phase. Only the floating phase counts, once
+  // per step, and not in the first quarter step (demagnetisation ringing).
+  void IRAM_ATTR onZeroCrossISR(void* arg) {
+    if (!zcEnabled) return;
+    const uint8_t phase = (uint8_t)(uintptr_t)arg;
+    const uint32_t now = micros();
+
+    portENTER_CRITICAL_ISR(&timerMux);
+    if (zcSeen || phase != FLOATING[applied_idx]) { portEXIT_CRITICAL_ISR(&timerMux); return; }
+    const int step = closedLoop ? step_us : currentDelay_us;
+    const int elapsed = (int)(now - lastComm_us);
+    if (elapsed < step / 4) { zc.rejected++; portEXIT_CRITICAL_ISR(&timerMux); return; }
+    zcSeen = true;
+    zc.crossings++;
+
+    if (!closedLoop) {
+      // stable = the crossing sits near mid-step, where 30 degrees of lead fits
+      goodRun = (elapsed <= 3 * step / 4) ? goodRun + 1 : 0;
+      if (goodRun >= handoverSteps && !ramping) {
+        closedLoop = true;
+        missed = 0;
+        step_us = currentDelay_us;
+        zc.handovers++;
+      }
+    } else {
+      int measured = (int)(now - lastZc_us);
+      if (measured < step_us / 2) measured = step_us / 2;   // clamp single outliers
+      if (measured > step_us * 2) measured = step_us * 2;
+      step_us = (3 * step_us + measured) / 4;
+      if (step_us < minStep_us) step_us = minStep_us;
+    }
+    lastZc_us = now;
+
+    if (closedLoop) {
+      // commutate 30 electrical degrees (half a step) after the crossing
+      timerWrite(timer, 0);
+      timerAlarmWrite(timer, step_us / 2, true);
+    }
+    portEXIT_CRITICAL_ISR(&timerMux);
+  }
+
+  void resetZeroCross() {
+    closedLoop = false;
+    lostSync   = false;
+    zcSeen     = false;
+    goodRun    = 0;
+    missed     = 0;
+    lastComm_us = micros();
+  }
+
+  void startRamp(int to_us, uint32_t ms, Curve c) {
+    ramp.start(millis(), currentDelay_us, to_us, ms, c);
+    ramping = true;
+  }
+
+  void setPeriod(int us) {
+    portENTER_CRITICAL(&timerMux);
+    timerAlarmWrite(timer, us, true);
+    portEXIT_CRITICAL(&timerMux);
+  }
+
+  // Leave the closed loop at the current crossing-driven period
+  void leaveClosedLoop() {
+    portENTER_CRITICAL(&timerMux);
+    lostSync = false;
+    if (closedLoop) {
+      closedLoop = false;
+      goodRun = 0;
+      currentDelay_us = step_us;
+      timerAlarmWrite(timer, currentDelay_us, true);   // drop the half-step rearm
+    }
+    portEXIT_CRITICAL(&timerMux);
   }
 }
 
@@ -62,8 +249,16 @@ namespace {
 void setup(const Config& cfg) {
   minDelay_us = cfg.min_delay_us;
   maxDelay_us = cfg.max_delay_us;
-  rampK       = cfg.ramp_k;
+  spinupCurve = cfg.spinup_curve;
+  spinup_ms   = cfg.spinup_ms ? cfg.spinup_ms
+                              : (uint32_t)(1000.0f * logf(100.0f) / (cfg.ramp_k > 0 ? cfg.ramp_k : 0.65f));
+  stop_ms     = cfg.stop_ms;
+  tables.build();
   baseDuty    = cfg.base_pwm_duty;
+  zcEnabled     = cfg.use_zero_cross;
+  handoverSteps = cfg.handover_steps;
+  minStep_us    = cfg.min_step_us;
+  lostSteps     = cfg.lost_steps;
 
   // Pins
   pinMode(LED_BUILTIN, OUTPUT);
@@ -73,13 +268,25 @@ void setup(const Config& cfg) {
   pinMode(ENABLE, OUTPUT);
   digitalWrite(ENABLE, HIGH);
 
-  // LEDC setup
-  ledcSetup(HIN1_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(HIN1, HIN1_CH);
-  ledcSetup(HIN2_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(HIN2, HIN2_CH);
-  ledcSetup(HIN3_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(HIN3, HIN3_CH);
-  ledcSetup(LIN1_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(LIN1, LIN1_CH);
-  ledcSetup(LIN2_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(LIN2, LIN2_CH);
-  ledcSetup(LIN3_CH, PWM_FREQ, PWM_RESOLUTION); ledcAttachPin(LIN3, LIN3_CH);
+  // Zero-cross comparators (34/35 are input-only, no pull-ups)
+  pinMode(PHASE1_ZC_PIN, INPUT);
+  pinMode(PHASE2_ZC_PIN, INPUT);
+  pinMode(PHASE3_ZC_PIN, INPUT);
+  attachInterruptArg(digitalPinToInterrupt(PHASE1_ZC_PIN), onZeroCrossISR, (void*)0, CHANGE);
+  attachInterruptArg(digitalPinToInterrupt(PHASE2_ZC_PIN), onZeroCrossISR, (void*)1, CHANGE);
+  attachInterruptArg(digitalPinToInterrupt(PHASE3_ZC_PIN), onZeroCrossISR, (void*)2, CHANGE);
+
+  // Output stage
+  buildPhaseTable();
+  out = Backend::Ledc;
+  if (cfg.backend == Backend::Mcpwm) {
+    if (setupMcpwm(cfg.pwm_hz, cfg.dead_time_ns)) out = Backend::Mcpwm;
+    else {
+      LOGW("MOTOR: MCPWM setup failed, using LEDC");
+      for (int i = 0; i < 3; ++i) mcpwm_stop(MCPWM_UNIT_0, (mcpwm_timer_t)i);
+    }
+  }
+  if (out == Backend::Ledc) setupLedc();
 
   // Timer (1us tick: clock/80 prescaler)
   timer = timerBegin(0, 80, true);
@@ -89,10 +296,12 @@ void setup(const Config& cfg) {
 }
 
 void startOpenLoop() {
-  start_ms = millis();
   currentDelay_us = maxDelay_us;
+  stopping = false;
+  startRamp(minDelay_us, spinup_ms, spinupCurve);
 
   portENTER_CRITICAL(&timerMux);
+  resetZeroCross();
   timerAlarmWrite(timer, currentDelay_us, true);
   timerAlarmEnable(timer);
   portEXIT_CRITICAL(&timerMux);
@@ -105,10 +314,18 @@ void stop() {
   if (!timer) return;
   portENTER_CRITICAL(&timerMux);
   timerAlarmDisable(timer);
+  resetZeroCross();
   portEXIT_CRITICAL(&timerMux);
   running = false;
+  ramping = false;
+  ramp.active = false;
+  stopping = false;
 
   // outputs off
+  if (out == Backend::Mcpwm) {
+    for (int i=0;i<3;i++) mcpwm_ll_fault_trigger_sw_ost(&MCPWM0, i);
+    return;
+  }
   for (int i=0;i<3;i++){
     setHIN_PWM(i, 0);
     setLIN_PWM(i, 0);
@@ -118,27 +335,84 @@ void stop() {
 void tick() {
   if (!running) return;
 
-  int newDelay = smoothDelay_us();
+  if (lostSync) {
+    // crossings gone (load step, noise): hold the last step period open
+    // loop, the handover may happen again. Only stop() + startOpenLoop()
+    // restart from standstill.
+    zc.losses++;
+    leaveClosedLoop();
+    return;
+  }
+  if (closedLoop) {
+    currentDelay_us = step_us;   // timer is driven by the crossings now
+    accelerated = true;
+    return;
+  }
+
+  if (!ramping) return;
+  const int newDelay = ramp.at(tables, millis());
   // "accelerated" threshold kept from your sketch logic
   if (newDelay <= (minDelay_us + 2500)) {
     accelerated = true;
   }
 
+  if (!ramp.active) {
+    ramping = false;
+    if (stopping) { stop(); return; }
+    currentDelay_us = newDelay;   // land exactly on the target
+    setPeriod(currentDelay_us);
+    return;
+  }
   if (abs(newDelay - currentDelay_us) > 80) {
     currentDelay_us = newDelay;
-    portENTER_CRITICAL(&timerMux);
-    timerAlarmWrite(timer, currentDelay_us, true);
-    portEXIT_CRITICAL(&timerMux);
+    setPeriod(currentDelay_us);
   }
 }
 
+void rampTo(int delay_us, uint32_t ms, Curve curve) {
+  if (!running || delay_us <= 0) return;
+  // open loop can go as fast as the closed loop when crossings may take over
+  const int floor_us = zcEnabled ? minStep_us : minDelay_us;
+  if (delay_us < floor_us) delay_us = floor_us;
+  leaveClosedLoop();
+  stopping = false;
+  startRamp(delay_us, ms, curve);
+}
+
+void rampStop(uint32_t ms) {
+  if (!running) return;
+  leaveClosedLoop();
+  stopping = true;
+  startRamp(maxDelay_us, ms ? ms : stop_ms, Curve::SCurve);
+}
+
+bool isRamping() { return ramping; }
+int  targetDelayMicros() { return ramping ? ramp.to_us : currentDelay_us; }
+
 void setDuty(uint8_t duty) {
   baseDuty = duty;
+  if (out == Backend::Mcpwm) {
+    for (int i=0;i<3;i++) mcpwm_set_duty(MCPWM_UNIT_0, (mcpwm_timer_t)i, MCPWM_GEN_A, dutyPercent(duty));
+  }
 }
 
 bool isRunning() { return running; }
 bool isAccelerated() { return accelerated; }
+
+void setZeroCross(bool on) {
+  zcEnabled = on;
+  if (!on) leaveClosedLoop();   // hold the current period open loop
+}
+bool isClosedLoop() { return closedLoop; }
+Backend backend() { return out; }
 int  currentDelayMicros(){ return currentDelay_us; }
 int  commutationStep(){ return step_idx; }
 
+ZcStats zcStats() {
+  portENTER_CRITICAL(&timerMux);
+  ZcStats s = zc;
+  portEXIT_CRITICAL(&timerMux);
+  return s;
+}
+
 } // namespace motion
@@ -1,21 +1,57 @@
 // lib/motion/motion.h
 #pragma once
 #include <Arduino.h>
+#include "profile.h"
 
 namespace motion {
 
+// Output stage. Mcpwm: centre-aligned PWM on the high side of the driven
+// phase, complementary low side with hardware dead time, commutation by
+// forcing operator outputs from a table. Ledc: the original six LEDC
+// channels at PWM_FREQ, used when MCPWM setup fails.
+enum class Backend : uint8_t { Mcpwm, Ledc };
+
 struct Config {
   // Ramp (in microseconds)
   int min_delay_us = 12 * 1000;  // your previous minDelay_us
   int max_delay_us = 55 * 1000;  // your previous maxDelay_us
   float ramp_k = 0.65f;          // decay factor
+  Curve spinup_curve = Curve::Exponential;
+  uint32_t spinup_ms = 0;        // 0: ln(100)/ramp_k, where the old e^-kt ramp was within 1%
+  uint32_t stop_ms   = 1500;     // rampStop() default: decelerate to max_delay_us, then stop
   uint8_t base_pwm_duty = 150;   // current-limiting duty (0..255)
-  bool use_zero_cross = false;   // keep false for now
+  Backend backend = Backend::Mcpwm;
+  uint32_t pwm_hz = 20000;       // MCPWM only (centre-aligned)
+  uint16_t dead_time_ns = 500;   // MCPWM only, 100 ns resolution
+  // Sensorless closed loop: once the back-EMF zero-crossings on
+  // PHASEx_ZC_PIN land steadily inside the open-loop steps, commutation
+  // follows them (30 electrical degrees after each crossing) instead of the
+  // ramp. If crossings go missing it holds the last step period open loop
+  // until the handover happens again.
+  bool use_zero_cross = false;
+  int  handover_steps = 36;      // consecutive good crossings before handover (6 e-revs)
+  int  min_step_us    = 1500;    // closed-loop limit for one 60-degree step
+  int  lost_steps     = 6;       // consecutive steps without a crossing -> open loop
+};
+
+struct ZcStats {
+  uint32_t crossings;   // accepted, one per step at most
+  uint32_t rejected;    // edges inside the blanking window after commutation
+  uint32_t handovers;   // open loop -> closed loop
+  uint32_t losses;      // closed loop -> open loop
 };
 
 void setup(const Config& cfg = Config{});  // pins/LEDC/timers
 void startOpenLoop();                      // begin commutation + ramp
-void stop();                               // stop timers / outputs
+void stop();                               // stop timers / outputs (immediately)
+
+// Move to a new commutation period while running (open loop). Leaves the
+// closed loop for the ramp; the handover may happen again after it.
+// delay_us is clamped to min_step_us with zero-cross on, min_delay_us off.
+void rampTo(int delay_us, uint32_t ms, Curve curve = Curve::SCurve);
+void rampStop(uint32_t ms = 0);            // decelerate to max_delay_us, then stop(); 0: Config::stop_ms
+bool isRamping();
+int  targetDelayMicros();
 
 // Call every loop(); adjusts ramp & timer period smoothly
 void tick();
@@ -24,9 +60,13 @@ void tick();
 void setDuty(uint8_t duty);       // change base commutation duty (0..255)
 bool isRunning();
 bool isAccelerated();             // became "fast" according to threshold
+void setZeroCross(bool on);       // allow / leave the closed loop at runtime
+bool isClosedLoop();
+Backend backend();                // what setup() ended up with
 
 // Debug / info
 int  currentDelayMicros();
 int  commutationStep();
+ZcStats zcStats();
 
 } // namespace motion
@@ -0,0 +1,86 @@
+// lib/motion/profile.h
+#pragma once
+#include <stdint.h>
+#include <math.h>
+
+// Commutation-period ramps from precomputed integer tables (pure, no
+// Arduino deps).
+//
+// Each curve is a 65-entry Q16 progress table over normalised ramp time,
+// built once with floats by Tables::build(). Ramp::at() then only does a
+// table lookup, a linear interpolation and one division:
+//   Exponential  the original spin-up: period eases like min + (max-min)e^-kt,
+//                cut off at 1% of the span
+//   Trapezoid    speed (1/period) linear in time: constant acceleration
+//   SCurve       speed follows smoothstep: acceleration ramps in and out
+// Trapezoid and SCurve interpolate speed rather than period, so the motor
+// sees the acceleration the curve promises at both ends of the range.
+namespace motion {
+
+enum class Curve : uint8_t { Exponential, Trapezoid, SCurve };
+
+namespace profile {
+
+static const int SEGMENTS = 64;
+
+struct Tables {
+  uint16_t q[3][SEGMENTS + 1];
+
+  void build() {
+    const float a = logf(100.0f);   // e^-a = 1%: where the exponential ends
+    for (int i = 0; i <= SEGMENTS; ++i) {
+      const float x = (float)i / SEGMENTS;
+      const float p[3] = {
+        (1.0f - expf(-a * x)) / (1.0f - expf(-a)),
+        x,
+        x * x * (3.0f - 2.0f * x),
+      };
+      for (int c = 0; c < 3; ++c) q[c][i] = (uint16_t)lroundf(p[c] * 65535.0f);
+    }
+  }
+
+  // Progress (Q16) at normalised time x (Q16)
+  uint32_t progress(Curve c, uint32_t x_q16) const {
+    if (x_q16 >= 65535) return 65535;
+    const uint16_t* t = q[(int)c];
+    const uint32_t pos  = x_q16 * SEGMENTS;   // segment index in bits 16+
+    const uint32_t i    = pos >> 16;
+    const uint32_t frac = pos & 0xFFFF;
+    return t[i] + (uint32_t)(((int32_t)t[i + 1] - (int32_t)t[i]) * (int32_t)frac >> 16);
+  }
+};
+
+// One ramp from one commutation period to another
+struct Ramp {
+  uint32_t t0_ms  = 0;
+  uint32_t dur_ms = 0;
+  int      from_us = 0;
+  int      to_us   = 0;
+  Curve    curve   = Curve::Exponential;
+  bool     active  = false;
+
+  void start(uint32_t now_ms, int from, int to, uint32_t ms, Curve c) {
+    t0_ms = now_ms; dur_ms = ms; from_us = from; to_us = to; curve = c;
+    active = true;
+  }
+
+  // Period for `now`; clears `active` once the target is reached
+  int at(const Tables& tab, uint32_t now_ms) {
+    if (!active) return to_us;
+    const uint32_t dt = now_ms - t0_ms;
+    if (dur_ms == 0 || dt >= dur_ms) { active = false; return to_us; }
+    const uint32_t x = (uint32_t)(((uint64_t)dt << 16) / dur_ms);
+    const int32_t  p = (int32_t)tab.progress(curve, x);
+    if (curve == Curve::Exponential) {
+      return from_us + (int)(((int64_t)(to_us - from_us) * p) >> 16);
+    }
+    // speed in steps per 1000 s: 1e9 / period_us
+    const int64_t r0 = 1000000000LL / from_us;
+    const int64_t r1 = 1000000000LL / to_us;
+    const int64_t r  = r0 + (((r1 - r0) * p) >> 16);
+    return (int)(1000000000LL / (r > 0 ? r : 1));
+  }
+};
+
+} // namespace profile
+} // namespace motion
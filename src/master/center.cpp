@@ -1,5 +1,6 @@
 #include "center.h"
 #include <actuator.h>
+#include <logging.h>
 
 namespace center {
 
@@ -12,7 +13,7 @@ static uint32_t  s_tmr   = 0;
 
 static inline void set_state(State ns, uint32_t now) {
   if (ns != s_state && s_log) {
-    Serial.printf("CENTER -> %-9s  t=%lu ms\n", state_name(ns), (unsigned long)now);
+    LOGI("CENTER -> %-9s  t=%lu ms", state_name(ns), (unsigned long)now);
   }
   s_state = ns;
 }
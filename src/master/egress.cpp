@@ -0,0 +1,214 @@
+#include "egress.h"
+#include <logging.h>
+
+namespace egress {
+
+static const size_t MAX_FRAME = 250;   // ESP-NOW payload limit
+
+struct Slot {
+  bool     full;
+  uint8_t  len;
+  uint8_t  errors;       // esp_now_send() refusals for this frame
+  uint8_t  retries;      // resends after a failed delivery
+  uint32_t stamp;        // submission order, oldest goes first
+  uint8_t  data[MAX_FRAME];
+};
+
+static const size_t NCH = (size_t)Channel::Count;
+
+static SendFn   s_send = nullptr;
+static Cfg      s_cfg;
+static Slot     s_slot[NCH] = {};
+static uint32_t s_stamp = 0;
+static Stats    s_stats = {};
+
+static uint32_t s_tokens_mt = 0;       // milli-tokens
+static uint32_t s_refill_ms = 0;
+
+// Radio completions still owed (egress + foreign sends). Counting instead
+// of matching keeps it correct whatever order the callbacks arrive in.
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static int          s_outstanding = 0;
+static uint32_t     s_outstanding_ms = 0;
+
+// We only send with nothing outstanding, so the next completion after one of
+// our sends is ours: if it failed, tick() puts the frame back.
+static bool     s_ours = false;          // next completion belongs to s_inflight
+static bool     s_redo = false;          // ...and it failed
+static Slot     s_inflight = {};
+static size_t   s_inflight_ch = 0;
+
+static const char* channel_name(size_t i) {
+  switch ((Channel)i) {
+    case Channel::Breath:  return "breath";
+    case Channel::Flicker: return "flicker";
+    case Channel::Test:    return "test";
+    case Channel::Stats:   return "stats";
+    case Channel::Table:   return "table";
+    case Channel::Scene:   return "scene";
+    default:               return "?";
+  }
+}
+
+void init(SendFn fn, const Cfg& cfg) {
+  s_send = fn;
+  s_cfg  = cfg;
+  s_tokens_mt = (uint32_t)s_cfg.burst * 1000;
+  s_refill_ms = millis();
+}
+
+void set_cfg(const Cfg& c) { s_cfg = c; }
+Cfg  get_cfg()             { return s_cfg; }
+
+bool submit(Channel ch, const void* data, size_t len) {
+  if ((size_t)ch >= NCH || len == 0 || len > MAX_FRAME) return false;
+  Slot& s = s_slot[(size_t)ch];
+  s_stats.submitted++;
+  if (s.full) {
+    s_stats.coalesced++;
+    LOGD("EGRESS %s: unsent frame replaced", channel_name((size_t)ch));
+  }
+  memcpy(s.data, data, len);
+  s.len    = (uint8_t)len;
+  s.errors = 0;
+  s.retries = 0;
+  s.stamp  = ++s_stamp;
+  s.full   = true;
+  tick();   // idle radio + tokens: leave right away
+  return true;
+}
+
+void on_sent(bool ok) {
+  portENTER_CRITICAL(&s_mux);
+  if (s_outstanding > 0) s_outstanding--;
+  s_outstanding_ms = millis();
+  if (s_ours) { s_ours = false; s_redo = !ok; }
+  portEXIT_CRITICAL(&s_mux);
+  if (ok) s_stats.tx_ok++;
+  else    s_stats.tx_fail++;
+}
+
+void note_foreign_send() {
+  portENTER_CRITICAL(&s_mux);
+  s_outstanding++;
+  s_outstanding_ms = millis();
+  portEXIT_CRITICAL(&s_mux);
+}
+
+void cancel_foreign_send() {
+  portENTER_CRITICAL(&s_mux);
+  if (s_outstanding > 0) s_outstanding--;
+  portEXIT_CRITICAL(&s_mux);
+}
+
+void tick() {
+  if (!s_send) return;
+  const uint32_t now = millis();
+
+  // refill
+  const uint32_t cap = (uint32_t)s_cfg.burst * 1000;
+  uint32_t dt = now - s_refill_ms;
+  if (dt > 10000) dt = 10000;   // long idle: bucket is full anyway, avoid overflow
+  s_tokens_mt += dt * s_cfg.rate_per_s;
+  if (s_tokens_mt > cap) s_tokens_mt = cap;
+  s_refill_ms = now;
+
+  // wait for the radio
+  portENTER_CRITICAL(&s_mux);
+  if (s_outstanding > 0 && (now - s_outstanding_ms) >= s_cfg.inflight_timeout_ms) {
+    s_outstanding = 0;
+    s_ours = false;   // outcome unknown
+    s_stats.timeouts++;
+  }
+  const bool redo = s_redo;
+  s_redo = false;
+  const bool busy = s_outstanding > 0;
+  if (!busy) { s_outstanding = 1; s_outstanding_ms = now; }   // reserve before sending
+  portEXIT_CRITICAL(&s_mux);
+
+  if (redo) {
+    Slot& s = s_slot[s_inflight_ch];
+    if (s.full) {
+      // a newer frame replaced it already
+    } else if (s_inflight.retries < s_cfg.max_tx_retries) {
+      s = s_inflight;          // keeps its old stamp: goes out first
+      s.full = true;
+      s.retries++;
+      s_stats.retried++;
+    } else {
+      s_stats.lost++;
+      LOGW("EGRESS %s: frame lost after %u resends", channel_name(s_inflight_ch), (unsigned)s_inflight.retries);
+    }
+  }
+  if (busy) return;
+
+  Slot* pick = nullptr;
+  if (s_tokens_mt >= 1000) {
+    for (size_t i = 0; i < NCH; ++i) {
+      if (s_slot[i].full && (!pick || (int32_t)(s_slot[i].stamp - pick->stamp) < 0)) pick = &s_slot[i];
+    }
+  }
+
+  bool ok = false;
+  if (pick) {
+    // armed before sending: the callback may run before s_send() returns
+    s_inflight    = *pick;
+    s_inflight_ch = (size_t)(pick - s_slot);
+    portENTER_CRITICAL(&s_mux);
+    s_ours = true;
+    portEXIT_CRITICAL(&s_mux);
+    ok = s_send(pick->data, pick->len);
+    if (ok) {
+      pick->full = false;
+      s_tokens_mt -= 1000;
+      s_stats.sent++;
+    } else {
+      s_stats.send_errors++;
+      if (++pick->errors >= s_cfg.max_send_errors) {
+        pick->full = false;
+        s_stats.dropped++;
+        LOGW("EGRESS: frame dropped after %u send errors", (unsigned)pick->errors);
+      }
+    }
+  }
+
+  if (!ok) {   // nothing went out: release the reservation
+    portENTER_CRITICAL(&s_mux);
+    s_ours = false;
+    if (s_outstanding > 0) s_outstanding--;
+    portEXIT_CRITICAL(&s_mux);
+  }
+}
+
+Stats stats() { return s_stats; }
+
+size_t pending() {
+  size_t n = 0;
+  for (size_t i = 0; i < NCH; ++i) n += s_slot[i].full ? 1 : 0;
+  return n;
+}
+
+bool busy(Channel ch) {
+  if ((size_t)ch >= NCH) return false;
+  if (s_slot[(size_t)ch].full) return true;
+  portENTER_CRITICAL(&s_mux);
+  const bool ours = s_inflight_ch == (size_t)ch && (s_ours || s_redo);
+  portEXIT_CRITICAL(&s_mux);
+  return ours;
+}
+
+void status(Print& out) {
+  out.printf("EGRESS rate=%u/s burst=%u pending=%u tokens=%lu.%03lu\n",
+    s_cfg.rate_per_s, s_cfg.burst, (unsigned)pending(),
+    (unsigned long)(s_tokens_mt / 1000), (unsigned long)(s_tokens_mt % 1000));
+  out.printf("  submitted=%lu coalesced=%lu sent=%lu dropped=%lu send_err=%lu\n",
+    (unsigned long)s_stats.submitted, (unsigned long)s_stats.coalesced,
+    (unsigned long)s_stats.sent, (unsigned long)s_stats.dropped,
+    (unsigned long)s_stats.send_errors);
+  out.printf("  tx_ok=%lu tx_fail=%lu timeouts=%lu retried=%lu lost=%lu\n",
+    (unsigned long)s_stats.tx_ok, (unsigned long)s_stats.tx_fail,
+    (unsigned long)s_stats.timeouts, (unsigned long)s_stats.retried,
+    (unsigned long)s_stats.lost);
+}
+
+} // namespace egress
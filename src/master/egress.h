@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+
+// Master egress stage: every chain frame goes through here instead of
+// straight to esp_now_send().
+//  - one pending slot per channel, a newer frame replaces an unsent one
+//  - token bucket (rate/burst) caps frames per second
+//  - one frame in flight; the next leaves after its send callback
+//  - a frame slave 0 did not ack is resent (unless a newer one replaced it)
+namespace egress {
+
+enum class Channel : uint8_t { Breath, Flicker, Test, Stats, Table, Scene, Count };
+
+using SendFn = bool (*)(const void* data, size_t len);   // true if queued by the radio
+
+struct Cfg {
+  uint16_t rate_per_s          = 50;   // sustained frames/s
+  uint8_t  burst               = 8;    // bucket depth
+  uint16_t inflight_timeout_ms = 50;   // give up waiting for a send callback
+  uint8_t  max_send_errors     = 3;    // esp_now_send() errors before a frame is dropped
+  uint8_t  max_tx_retries      = 2;    // resends after a failed delivery
+};
+
+struct Stats {
+  uint32_t submitted;
+  uint32_t coalesced;    // replaced while still pending
+  uint32_t sent;         // handed to the radio
+  uint32_t dropped;      // gave up after max_send_errors
+  uint32_t send_errors;  // esp_now_send() refused (TX buffer full, ...)
+  uint32_t tx_ok;        // send callbacks (all master frames): delivered
+  uint32_t tx_fail;      // send callbacks (all master frames): not acked
+  uint32_t timeouts;     // no send callback within inflight_timeout_ms
+  uint32_t retried;      // resent after a failed delivery
+  uint32_t lost;         // failed, out of retries
+};
+
+// lifecycle
+void init(SendFn fn, const Cfg& cfg = Cfg{});
+void set_cfg(const Cfg& c);
+Cfg  get_cfg();
+
+// queue a frame (copied, <= 250 bytes); latest wins per channel
+bool submit(Channel ch, const void* data, size_t len);
+
+// run each loop(): refill tokens, send the oldest pending frame when allowed
+void tick();
+
+// esp-now send callback: pass every completion here, egress or not
+void on_sent(bool ok);
+// call right before an esp_now_send() made outside egress, so its completion
+// (which may arrive before esp_now_send() returns) is not taken for ours;
+// cancel_foreign_send() if that send was refused
+void note_foreign_send();
+void cancel_foreign_send();
+
+// status
+Stats  stats();
+size_t pending();
+bool   busy(Channel ch);   // a frame of ch is pending, in flight or about to be resent
+void   status(Print& out);
+
+} // namespace egress
@@ -1,6 +1,7 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <esp_now.h>
+#include <esp_timer.h>
 #include <ctype.h>
 
 #include <Adafruit_DotStar.h>
@@ -10,8 +11,17 @@
 #include <motion.h>    // BLDC module
 #include <actuator.h>  // DRV8833 module
 #include <pins.h>      // pin/channel definitions
+#include <logging.h>   // deferred LOGx()
 #include "center.h"
 #include "routine.h"
+#include "egress.h"
+#include <codec.h>
+#include <scene.h>
+#include <linkstats.h>
+#include <registry.h>
+#include <topology.h>
+#include <peercache.h>
+#include <esp_wifi.h>
 
 // -------------------- Local DotStar (optional visual) --------------------
 #define MASTER_NUM_LEDS 30
@@ -131,7 +141,9 @@ static const char* centerName(CenterState s){
 }
 
 // -------------------- ESP-NOW peers --------------------
-static const uint8_t PEERS[][6] = {
+// Factory table: seeds the NVS node registry on first boot. After that the
+// registry (g_nodes) is the source of truth; see "nodes" on the console.
+static const uint8_t DEFAULT_PEERS[][6] = {
   {0xC0,0x5D,0x89,0xDC,0xA9,0xDC}, // Slave 0
   {0xC0,0x5D,0x89,0xDC,0x94,0x2C}, // Slave 1
   {0xC0,0x5D,0x89,0xDC,0xA9,0xC0}, // Slave 2
@@ -162,7 +174,24 @@ static const uint8_t PEERS[][6] = {
   {0x68,0x25,0xDD,0xF1,0xB2,0x34}, // Slave 27
   {0x68,0x25,0xDD,0xFD,0x18,0x90}, // Slave 28
 };
-static const size_t NUM_SLAVES = sizeof(PEERS) / sizeof(PEERS[0]);
+static const size_t NUM_DEFAULT_PEERS = sizeof(DEFAULT_PEERS) / sizeof(DEFAULT_PEERS[0]);
+
+static comms::registry::Table g_nodes = {};
+static bool g_enroll_open = true;   // append unknown announcers
+
+// Announcers seen by the WiFi callback, handled in loop()
+static const size_t ANNOUNCE_QUEUE = 4;
+static uint8_t           g_announce_mac[ANNOUNCE_QUEUE][6];
+static volatile uint8_t  g_announce_n = 0;
+static portMUX_TYPE      g_announce_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// SYNC_REQs seen by the WiFi callback (reply already stamped with t2),
+// answered from loop(): the callback must not touch the peer table
+static const size_t SYNC_QUEUE = 4;
+struct SyncReply { uint8_t mac[6]; SyncMsg m; };
+static SyncReply         g_sync_q[SYNC_QUEUE];
+static volatile uint8_t  g_sync_n = 0;
+static portMUX_TYPE      g_sync_mux = portMUX_INITIALIZER_UNLOCKED;
 
 // -------------------- ESP-NOW helpers --------------------
 static uint32_t g_seq = 1;
@@ -171,15 +200,151 @@ static bool       have_last_breath = false;
 static FlickerMsg last_flicker{};
 static bool       have_last_flicker = false;
 
+// Broadcast delivery: one frame to every slave in range (slaves must run
+// comms::espnow with Delivery::Broadcast). Off = unicast to slave 0.
+static const uint8_t BCAST_MAC[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+static bool g_broadcast = false;
+// F_CRITICAL on breath/flicker: relays also send to the node after next
+static bool g_critical = false;
+// Cue and sweep ttl: deep enough for a chain over a full table. Repeats die
+// in the relays' cue cache, ttl is only the backstop.
+static const uint8_t RELAY_TTL = 255;
+static_assert(RELAY_TTL >= comms::registry::MAX_NODES, "ttl must cover a chain over the whole table");
+
+// Relay layout of the slaves (same COMMS_TREE_FANOUT) and the cue lead it
+// needs: t0 = now + cue_lead_ms() reaches the deepest node. Per-hop and
+// per-frame times come from the last links sweep (ARQ srtt + relay delay
+// p99); until one reports, 1 Mbps figures (frame + ack ~1.3 ms, relay and
+// rx ~0.3 ms).
+#ifndef COMMS_ESPNOW_RATE
+#define COMMS_ESPNOW_RATE WIFI_PHY_RATE_1M_L   // as lib/comms/espnow.h
+#endif
+static const comms::topology::Layout g_layout = comms::topology::build_layout();
+static const uint32_t HOP_RX_US        = 300;   // reception -> rx callback, not in any stat
+static const uint32_t FRAME_DEFAULT_US = 1300;
+static uint32_t g_hop_us   = FRAME_DEFAULT_US + HOP_RX_US;
+static uint32_t g_frame_us = FRAME_DEFAULT_US;
+
+static uint32_t cue_lead_ms() {
+  return comms::topology::lead_ms(g_layout, g_nodes.count, g_hop_us, g_frame_us);
+}
+
+// Wire format: compact codec frames (include/codec.h) once slave 0 reports
+// that everything below it decodes them (SyncMsg.wire_ver); legacy structs
+// until then, or when the report goes stale.
+enum class Wire : uint8_t { Auto, Legacy, Compact };
+static Wire              g_wire = Wire::Auto;
+static volatile uint8_t  g_chain_wire_ver = 0;
+static volatile uint32_t g_chain_wire_ms  = 0;
+static const uint32_t    WIRE_REPORT_MAX_AGE = 5000;
+
+static bool use_compact() {
+  if (g_wire != Wire::Auto) return g_wire == Wire::Compact;
+  return g_chain_wire_ver >= codec::WIRE_VERSION && millis() - g_chain_wire_ms < WIRE_REPORT_MAX_AGE;
+}
+
+// Registered peers: slave 0, broadcast, and whoever announces or asks for
+// sync. LRU-bounded below the driver's ~20. setup() and loop() only, so an
+// eviction never races the egress frame in flight.
+static comms::PeerCache<16> g_peer_cache;
+
 static void addPeer(const uint8_t mac[6]) {
-  esp_now_peer_info_t p{};
-  memcpy(p.peer_addr, mac, 6);
-  p.channel = 0;
-  p.encrypt = false;
-  esp_now_add_peer(&p);
+  const auto r = g_peer_cache.touch(mac, millis());
+  if (!r.hit) {
+    if (r.evicted) esp_now_del_peer(r.victim);
+    esp_now_peer_info_t p{};
+    memcpy(p.peer_addr, mac, 6);
+    p.channel = 0;
+    p.encrypt = false;
+    const esp_err_t e = esp_now_add_peer(&p);
+    if (e != ESP_OK && e != ESP_ERR_ESPNOW_EXIST) g_peer_cache.forget(mac);
+  }
+}
+// Frames that bypass egress (sync replies, tables to one node): announced to
+// egress before the send, so their completion is never taken for an egress frame
+static bool send_direct(const uint8_t* mac, const void* data, size_t len) {
+  egress::note_foreign_send();
+  const esp_err_t e = esp_now_send(mac, (const uint8_t*)data, len);
+  if (e != ESP_OK) { egress::cancel_foreign_send(); LOGW("esp_now_send err=%d", (int)e); }
+  return e == ESP_OK;
 }
 static void onDataSent(const uint8_t*, esp_now_send_status_t s) {
-  Serial.println(s == ESP_NOW_SEND_SUCCESS ? "ESP-NOW send ok" : "ESP-NOW send FAIL");
+  egress::on_sent(s == ESP_NOW_SEND_SUCCESS);
+  LOGD("ESP-NOW send %s", s == ESP_NOW_SEND_SUCCESS ? "ok" : "FAIL");
+}
+// Link telemetry: the sweep's merged report, collected from its STATS_REPORT
+// frames on the WiFi task and handed to loop() for printing once the last
+// one (no STATS_F_MORE) is in.
+static LinkEntry         g_links[comms::registry::MAX_NODES];
+static size_t            g_links_count = 0;
+static uint8_t           g_links_flags = 0;
+static volatile bool     g_links_ready = false;
+static uint32_t          g_links_seq = 0;
+static uint32_t          g_links_sent_ms = 0;
+static uint16_t          g_links_budget_ms = 0;
+static bool              g_links_waiting = false;
+static portMUX_TYPE      g_links_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void onStatsReport(const uint8_t* data, int len) {
+  StatsHdr h; memcpy(&h, data, sizeof(h));
+  const size_t n    = ((size_t)len - sizeof(h)) / sizeof(LinkEntry);
+  const size_t take = h.count < n ? h.count : n;
+  portENTER_CRITICAL(&g_links_mux);
+  if (h.kind == STATS_REPORT && h.seq == g_links_seq && !g_links_ready) {
+    for (size_t i = 0; i < take; ++i) {
+      if (g_links_count >= comms::registry::MAX_NODES) { g_links_flags |= STATS_F_TRUNCATED; break; }
+      memcpy(&g_links[g_links_count++], data + sizeof(h) + i * sizeof(LinkEntry), sizeof(LinkEntry));
+    }
+    g_links_flags |= h.flags & STATS_F_TRUNCATED;
+    if (!(h.flags & STATS_F_MORE)) g_links_ready = true;
+  }
+  portEXIT_CRITICAL(&g_links_mux);
+}
+
+// Clock sync: the master is the time reference. Answer SYNC_REQ from the
+// first slave with its own esp_timer clock (millis() is derived from it);
+// t2 is taken here, t3 when syncTick() sends the reply.
+static void onDataRecv(const uint8_t* mac, const uint8_t* data, int len) {
+  const int64_t t_rx = esp_timer_get_time();
+  if (len >= (int)sizeof(StatsHdr) && data[0] == MODE_STATS) { onStatsReport(data, len); return; }
+  if (len >= (int)sizeof(EnrollHdr) && data[0] == MODE_ENROLL) {
+    if (data[1] != ENROLL_ANNOUNCE) return;
+    portENTER_CRITICAL(&g_announce_mux);
+    if (g_announce_n < ANNOUNCE_QUEUE) memcpy(g_announce_mac[g_announce_n++], mac, 6);
+    portEXIT_CRITICAL(&g_announce_mux);
+    return;
+  }
+  if (len < (int)sizeof(SyncMsg) || data[0] != MODE_SYNC) return;
+  SyncMsg m; memcpy(&m, data, sizeof(m));
+  if (m.kind != SYNC_REQ) return;
+  if (g_nodes.count > 0 && memcmp(mac, g_nodes.mac[0], 6) == 0) {
+    g_chain_wire_ver = m.wire_ver;
+    g_chain_wire_ms  = millis();
+  }
+  m.kind   = SYNC_RESP;
+  m.synced = 1;
+  m.t2_us  = t_rx;
+  portENTER_CRITICAL(&g_sync_mux);
+  if (g_sync_n < SYNC_QUEUE) {   // full: dropped, the node asks again
+    memcpy(g_sync_q[g_sync_n].mac, mac, 6);
+    g_sync_q[g_sync_n++].m = m;
+  }
+  portEXIT_CRITICAL(&g_sync_mux);
+}
+
+static void syncTick() {
+  SyncReply q[SYNC_QUEUE];
+  portENTER_CRITICAL(&g_sync_mux);
+  const uint8_t n = g_sync_n;
+  memcpy(q, g_sync_q, (size_t)n * sizeof(SyncReply));
+  g_sync_n = 0;
+  portEXIT_CRITICAL(&g_sync_mux);
+
+  for (uint8_t i = 0; i < n; ++i) {
+    addPeer(q[i].mac);
+    q[i].m.t3_us = esp_timer_get_time();
+    send_direct(q[i].mac, &q[i].m, sizeof(q[i].m));
+  }
 }
 static void setupESPNow() {
   WiFi.mode(WIFI_STA);
@@ -187,23 +352,123 @@ static void setupESPNow() {
     Serial.println("ESP-NOW init error");
     return;
   }
+  if (esp_wifi_config_espnow_rate(WIFI_IF_STA, COMMS_ESPNOW_RATE) != ESP_OK) {
+    LOGW("ESP-NOW PHY rate %d refused, driver default", (int)COMMS_ESPNOW_RATE);
+  }
   esp_now_register_send_cb(onDataSent);
-  if (NUM_SLAVES > 0) addPeer(PEERS[0]); // first only; slaves forward
+  esp_now_register_recv_cb(onDataRecv);
+  if (g_nodes.count > 0) addPeer(g_nodes.mac[0]); // first only; slaves forward
+  addPeer(BCAST_MAC);
+}
+// Radio hook for egress; commands go through egress::submit()
+static bool send_to_first_slave(const void* data, size_t len) {
+  if (g_nodes.count == 0) return false;
+  const uint8_t* to = g_broadcast ? BCAST_MAC : g_nodes.mac[0];
+  addPeer(to);   // cache hit unless many announcers pushed it out
+  esp_err_t err = esp_now_send(to, (const uint8_t*)data, len);
+  if (err != ESP_OK) LOGW("esp_now_send err=%d", (int)err);
+  return err == ESP_OK;
+}
+
+// -------------------- Node registry / enrollment --------------------
+static void loadNodes() {
+  if (comms::registry::load(g_nodes)) {
+    Serial.printf("NODES: %u from NVS (epoch %lu)\n", g_nodes.count, (unsigned long)g_nodes.epoch);
+    return;
+  }
+  g_nodes.epoch = 1;
+  g_nodes.count = 0;
+  for (size_t i = 0; i < NUM_DEFAULT_PEERS; ++i) comms::registry::append(g_nodes, DEFAULT_PEERS[i]);
+  comms::registry::save(g_nodes);
+  Serial.printf("NODES: seeded %u from the factory table\n", g_nodes.count);
+}
+
+// Table down the chain (slave 0 relays it), and straight to one node. The
+// parts go through egress one at a time (tableTick()), so they do not
+// replace each other in the Table slot. ttl only bounds the depth here:
+// nodes stop relaying a table epoch they already hold.
+static const uint8_t TABLE_TTL = 255;
+static size_t g_table_part = 0, g_table_parts = 0;   // next part to submit
+
+static void tableTick() {
+  if (g_table_part >= g_table_parts || egress::busy(egress::Channel::Table)) return;
+  uint8_t buf[ESP_NOW_MAX_DATA_LEN];
+  const size_t n = comms::registry::encode(g_nodes, g_table_part++, TABLE_TTL, buf, sizeof(buf));
+  if (n) egress::submit(egress::Channel::Table, buf, n);
+}
+
+static void pushNodes(const uint8_t* also_to = nullptr) {
+  if (g_nodes.count > 0) addPeer(g_nodes.mac[0]);
+  g_table_part  = 0;   // a push in progress restarts with the new table
+  g_table_parts = comms::registry::parts(g_nodes);
+  tableTick();
+  if (also_to) {
+    addPeer(also_to);
+    uint8_t buf[ESP_NOW_MAX_DATA_LEN];
+    for (size_t p = 0; p < g_table_parts; ++p) {
+      const size_t n = comms::registry::encode(g_nodes, p, TABLE_TTL, buf, sizeof(buf));
+      if (n) send_direct(also_to, buf, n);
+    }
+  }
+}
+
+static void nodesChanged(const uint8_t* also_to = nullptr) {
+  g_nodes.epoch++;
+  comms::registry::save(g_nodes);
+  pushNodes(also_to);
+}
+
+static void enrollTick() {
+  uint8_t macs[ANNOUNCE_QUEUE][6];
+  portENTER_CRITICAL(&g_announce_mux);
+  const uint8_t n = g_announce_n;
+  memcpy(macs, g_announce_mac, (size_t)n * 6);
+  g_announce_n = 0;
+  portEXIT_CRITICAL(&g_announce_mux);
+
+  for (uint8_t i = 0; i < n; ++i) {
+    const uint8_t* mac = macs[i];
+    const int idx = comms::registry::index_of(g_nodes, mac);
+    if (idx >= 0) {
+      // known node that lost its table: just send it the current one
+      pushNodes(mac);
+      continue;
+    }
+    if (!g_enroll_open) continue;
+    if (!comms::registry::append(g_nodes, mac)) { Serial.println("NODES: table full"); continue; }
+    Serial.printf("NODES: enrolled %02X:%02X:%02X:%02X:%02X:%02X as idx %u\n",
+                  mac[0],mac[1],mac[2],mac[3],mac[4],mac[5], (unsigned)(g_nodes.count - 1));
+    nodesChanged(mac);
+  }
 }
-static inline void send_to_first_slave(const void* data, size_t len) {
-  if (NUM_SLAVES == 0) return;
-  esp_err_t err = esp_now_send(PEERS[0], (const uint8_t*)data, len);
-  if (err != ESP_OK) Serial.printf("esp_now_send err=%d\n", err);
+
+static void printNodes() {
+  Serial.printf("NODES epoch=%lu count=%u enroll=%s\n", (unsigned long)g_nodes.epoch,
+                g_nodes.count, g_enroll_open ? "open" : "closed");
+  for (size_t i = 0; i < g_nodes.count; ++i) {
+    const uint8_t* m = g_nodes.mac[i];
+    Serial.printf("  %2u  %02X:%02X:%02X:%02X:%02X:%02X\n", (unsigned)i, m[0],m[1],m[2],m[3],m[4],m[5]);
+  }
 }
 
 // -------------------- Commands sent by master --------------------
-static void startBreathAll(uint8_t r,uint8_t g,uint8_t b,
+template <class M>
+static void submit_cue(egress::Channel ch, const M& m) {
+  if (use_compact()) {
+    uint8_t buf[codec::MAX_FRAME];
+    const size_t n = codec::encode(m, buf, sizeof(buf));
+    if (n) { egress::submit(ch, buf, n); return; }
+  }
+  egress::submit(ch, &m, sizeof(m));
+}
+
+static BreathMsg makeBreath(uint8_t r,uint8_t g,uint8_t b,
                            float bmin,float bmax,
                            uint32_t up_ms,uint32_t down_ms,
                            uint16_t cycles,
-                           bool interrupt=false,
-                           uint8_t ttl=40,
-                           uint32_t start_offset=500)
+                           bool interrupt,
+                           uint8_t ttl,
+                           uint32_t start_offset)
 {
   BreathMsg m{};
   m.mode  = MODE_BREATH;
@@ -215,23 +480,34 @@ static void startBreathAll(uint8_t r,uint8_t g,uint8_t b,
   m.down_ms = down_ms ? down_ms : 1;
   m.cycles  = cycles;
   m.seq     = g_seq++;
-  m.flags   = interrupt ? F_INTERRUPT : 0;
+  m.flags   = (interrupt ? F_INTERRUPT : 0) | (g_critical ? F_CRITICAL : 0);
   m.ttl     = ttl;
   m.t0_ms   = millis() + start_offset;
+  return m;
+}
 
-  send_to_first_slave(&m, sizeof(m));
+static void startBreathAll(uint8_t r,uint8_t g,uint8_t b,
+                           float bmin,float bmax,
+                           uint32_t up_ms,uint32_t down_ms,
+                           uint16_t cycles,
+                           bool interrupt=false,
+                           uint8_t ttl=RELAY_TTL,
+                           uint32_t start_offset=500)
+{
+  BreathMsg m = makeBreath(r,g,b, bmin,bmax, up_ms,down_ms, cycles, interrupt, ttl, start_offset);
+  submit_cue(egress::Channel::Breath, m);
   last_breath = m;
   have_last_breath = true;
   Serial.println("BREATH: command sent");
 }
 
-static void startFlickerAll(uint32_t on_ms,
-                            uint32_t off_ms,
-                            uint16_t cycles,
-                            bool invert=false,
-                            bool interrupt=false,
-                            uint8_t ttl=40,
-                            uint32_t start_offset=300)
+static FlickerMsg makeFlicker(uint32_t on_ms,
+                             uint32_t off_ms,
+                             uint16_t cycles,
+                             bool invert,
+                             bool interrupt,
+                             uint8_t ttl,
+                             uint32_t start_offset)
 {
   FlickerMsg f{};
   f.mode   = MODE_FLICKER;
@@ -240,19 +516,87 @@ static void startFlickerAll(uint32_t on_ms,
   f.cycles = cycles;
   f.invert = invert ? 1 : 0;
   f.seq    = g_seq++;
-  f.flags  = interrupt ? F_INTERRUPT : 0;
+  f.flags  = (interrupt ? F_INTERRUPT : 0) | (g_critical ? F_CRITICAL : 0);
   f.ttl    = ttl;
   f.t0_ms  = millis() + start_offset;
+  return f;
+}
 
-  send_to_first_slave(&f, sizeof(f));
+static void startFlickerAll(uint32_t on_ms,
+                            uint32_t off_ms,
+                            uint16_t cycles,
+                            bool invert=false,
+                            bool interrupt=false,
+                            uint8_t ttl=RELAY_TTL,
+                            uint32_t start_offset=300)
+{
+  FlickerMsg f = makeFlicker(on_ms, off_ms, cycles, invert, interrupt, ttl, start_offset);
+  submit_cue(egress::Channel::Flicker, f);
   last_flicker = f;
   have_last_flicker = true;
   Serial.println("FLICKER: command sent");
 }
 
+// Flicker + breath in one MODE_SCENE frame: one hop-by-hop relay instead of
+// two, and both start at the same t0 on every node. Records use the same
+// wire format as standalone cues.
+template <class M>
+static bool add_record(scene::Builder& sb, const M& m) {
+  if (use_compact()) {
+    uint8_t buf[codec::MAX_FRAME];
+    const size_t n = codec::encode(m, buf, sizeof(buf));
+    if (n) return sb.add(buf, n);
+  }
+  return sb.add(m);
+}
+
+static void startSceneAll(const FlickerMsg& f, const BreathMsg& m,
+                          uint8_t ttl=RELAY_TTL, uint32_t start_offset=0)   // 0: cue_lead_ms()
+{
+  scene::Builder sb;
+  sb.begin(g_seq++, millis() + (start_offset ? start_offset : cue_lead_ms()), ttl, g_critical ? F_CRITICAL : 0);
+  if (!add_record(sb, f) || !add_record(sb, m)) { Serial.println("SCENE: does not fit"); return; }
+  egress::submit(egress::Channel::Scene, sb.data(), sb.size());
+
+  // refreshTick() keeps refreshing them standalone; nodes match them by seq
+  last_flicker = f;  have_last_flicker = true;
+  last_breath  = m;  have_last_breath  = true;
+  Serial.printf("SCENE: %u cues, %u bytes sent\n", (unsigned)sb.count(), (unsigned)sb.size());
+}
+
+// Refresh start time: the first point on the original cue's period grid at or
+// after `at`. Receivers absorb an unchanged refresh (same seq + params) and
+// only resync phase, so it must not shift the grid.
+static uint32_t phase_aligned_t0(uint32_t t0, uint32_t period, uint32_t at) {
+  if (!period || (int32_t)(at - t0) <= 0) return t0;
+  const uint32_t k = (at - t0 + period - 1) / period;
+  return t0 + k * period;
+}
+
+// Late joiners and nodes that missed a cue: resend the current breath every
+// 2 s and flicker every 1 s, unchanged but for a phase-aligned t0
+static uint32_t g_breath_refresh_ms = 0, g_flicker_refresh_ms = 0;
+
+static void refreshTick(uint32_t now) {
+  if (have_last_breath && now - g_breath_refresh_ms > 2000) {
+    g_breath_refresh_ms = now;
+    BreathMsg m = last_breath;
+    const uint32_t lead = cue_lead_ms() > 200 ? cue_lead_ms() : 200;
+    m.t0_ms = phase_aligned_t0(last_breath.t0_ms, last_breath.up_ms + last_breath.down_ms, now + lead);
+    submit_cue(egress::Channel::Breath, m);
+  }
+  if (have_last_flicker && now - g_flicker_refresh_ms > 1000) {
+    g_flicker_refresh_ms = now;
+    FlickerMsg f = last_flicker;
+    f.t0_ms = phase_aligned_t0(last_flicker.t0_ms, (uint32_t)last_flicker.on_ms + last_flicker.off_ms,
+                               now + cue_lead_ms());
+    submit_cue(egress::Channel::Flicker, f);
+  }
+}
+
 static void startTestChain(uint16_t step_ms,
                            uint8_t r, uint8_t g, uint8_t b,
-                           uint8_t ttl = 60,
+                           uint8_t ttl = RELAY_TTL,
                            uint32_t start_offset = 500)
 {
   TestMsg t{};
@@ -263,16 +607,175 @@ static void startTestChain(uint16_t step_ms,
   t.t0_ms   = millis() + start_offset;
   t.step_ms = step_ms;
   t.r = r; t.g = g; t.b = b;
-  send_to_first_slave(&t, sizeof(t));
+  submit_cue(egress::Channel::Test, t);
   Serial.println("TEST chain kicked off.");
 }
 
+// One sweep down the relay topology; every node merges its children's link
+// entries, so slave 0 answers for the whole table (one frame per
+// STATS_PER_FRAME entries). budget_ms 0: enough for a chain over the whole
+// table, every hop keeps STATS_HOP_MARGIN_MS.
+static void requestLinks(uint16_t budget_ms = 0, uint8_t ttl = RELAY_TTL) {
+  if (!budget_ms) {
+    const uint32_t chain_ms = (uint32_t)(g_nodes.count + 2) * STATS_HOP_MARGIN_MS;
+    budget_ms = chain_ms > 2000 ? (uint16_t)chain_ms : 2000;
+  }
+  StatsHdr q{};
+  q.mode      = MODE_STATS;
+  q.kind      = STATS_REQ;
+  q.ttl       = ttl;
+  q.budget_ms = budget_ms;
+  portENTER_CRITICAL(&g_links_mux);
+  q.seq         = ++g_links_seq;
+  g_links_ready = false;
+  g_links_count = 0;
+  g_links_flags = 0;
+  portEXIT_CRITICAL(&g_links_mux);
+  g_links_sent_ms   = millis();
+  g_links_budget_ms = budget_ms;
+  g_links_waiting   = true;
+  egress::submit(egress::Channel::Stats, &q, sizeof(q));
+  Serial.printf("LINKS: sweep %lu sent (budget %u ms)\n", (unsigned long)q.seq, budget_ms);
+}
+
+static void printBucket(uint8_t b) {
+  const uint32_t us = comms::LatencyHist::bucket_upper_us(b);
+  if (us == UINT32_MAX) Serial.printf(" >%lums", (unsigned long)(comms::LatencyHist::bucket_upper_us(b - 1) / 1000));
+  else if (us < 1000)   Serial.printf("<=%luus", (unsigned long)us);
+  else                  Serial.printf("<=%lums", (unsigned long)(us / 1000));
+}
+
+// Relay delay a fwd_p99 bucket stands for (the open last bucket: its floor)
+static uint32_t bucket_us(uint8_t b) {
+  const uint32_t us = comms::LatencyHist::bucket_upper_us(b);
+  return us == UINT32_MAX ? comms::LatencyHist::bucket_upper_us(b - 1) : us;
+}
+
+// cue_lead_ms()'s times over the nodes that relay: a hop is their mean
+// send->ack (queueing for the channel included) plus relay delay, a frame
+// their fastest send->ack (the channel idle)
+static void updateLead(const LinkEntry* e, size_t cnt) {
+  uint64_t hop = 0;
+  uint32_t frame = UINT32_MAX;
+  size_t n = 0;
+  for (size_t i = 0; i < cnt; ++i) {
+    if (!e[i].srtt_10us) continue;   // a leaf sends nothing
+    const uint32_t srtt = (uint32_t)e[i].srtt_10us * 10;
+    hop += srtt + bucket_us(e[i].fwd_p99);
+    if (srtt < frame) frame = srtt;
+    n++;
+  }
+  if (n) {
+    g_hop_us   = (uint32_t)(hop / n) + HOP_RX_US;
+    g_frame_us = frame;
+  }
+  Serial.printf("  cue lead %lu ms: %u hops x %lu us, %u frames x %lu us\n", (unsigned long)cue_lead_ms(),
+                (unsigned)comms::topology::max_hop_depth(g_layout, g_nodes.count), (unsigned long)g_hop_us,
+                (unsigned)g_nodes.count, (unsigned long)g_frame_us);
+}
+
+static void printLinks(bool complete) {
+  LinkEntry* e = g_links;
+  const size_t cnt = g_links_count;
+
+  // sort by node index (merge order follows the topology)
+  for (size_t i = 1; i < cnt; ++i)
+    for (size_t j = i; j > 0 && e[j - 1].idx > e[j].idx; --j) { LinkEntry t = e[j]; e[j] = e[j - 1]; e[j - 1] = t; }
+
+  const egress::Stats es = egress::stats();
+  Serial.printf("LINKS sweep %lu: %u/%u nodes in %lu ms%s%s\n", (unsigned long)g_links_seq,
+                (unsigned)cnt, (unsigned)g_nodes.count, (unsigned long)(millis() - g_links_sent_ms),
+                (g_links_flags & STATS_F_TRUNCATED) ? " (truncated)" : "",
+                complete ? "" : " (last frames missing)");
+  Serial.printf("  master -> 0: tx_ok=%lu tx_fail=%lu retried=%lu lost=%lu\n",
+                (unsigned long)es.tx_ok, (unsigned long)es.tx_fail,
+                (unsigned long)es.retried, (unsigned long)es.lost);
+  Serial.println("  idx  rssi  loss  gave_up  srtt_ms  fwd_p50  fwd_p99");
+  for (size_t i = 0; i < cnt; ++i) {
+    if (e[i].rssi) Serial.printf("  %3u  %4d", e[i].idx, e[i].rssi);
+    else           Serial.printf("  %3u     ?", e[i].idx);
+    Serial.printf("  %3u%%  %7u  %3u.%02u   ", e[i].loss_pct, e[i].gave_up,
+                  e[i].srtt_10us / 100, e[i].srtt_10us % 100);
+    printBucket(e[i].fwd_p50); Serial.print("   ");
+    printBucket(e[i].fwd_p99); Serial.println();
+  }
+  // nodes that did not make it into the report
+  for (size_t k = 0; k < g_nodes.count; ++k) {
+    bool seen = false;
+    for (size_t i = 0; i < cnt && !seen; ++i) seen = e[i].idx == k;
+    if (!seen) Serial.printf("  %3u  (no report)\n", (unsigned)k);
+  }
+  updateLead(e, cnt);
+}
+
+static void linksTick() {
+  if (!g_links_waiting) return;
+  if (g_links_ready) {
+    g_links_waiting = false;
+    printLinks(true);
+  } else if (millis() - g_links_sent_ms > (uint32_t)g_links_budget_ms + 500) {
+    g_links_waiting = false;
+    portENTER_CRITICAL(&g_links_mux);
+    g_links_ready = true;        // the WiFi task leaves g_links alone from here
+    portEXIT_CRITICAL(&g_links_mux);
+    if (g_links_count) printLinks(false);
+    else Serial.println("LINKS: no report (slave 0 unreachable?)");
+  }
+}
+
 // -------------------- Local DotStar helpers --------------------
 static void fillStrip(uint8_t r,uint8_t g,uint8_t b){
   for (int i=0;i<MASTER_NUM_LEDS;i++) strip.setPixelColor(i, r,g,b);
   strip.show();
 }
 
+// -------------------- Routine hooks --------------------
+// The routine's flicker requests and state changes become chain cues, sent
+// through egress like every other command.
+static void routine_flicker_cb(uint32_t on_ms, uint32_t off_ms, uint16_t cycles,
+                               bool invert, bool interrupt)
+{
+  // While the center dither runs, the LEDs follow its exact pulse/gap
+  if (center::is_on()) {
+    const center::Cfg c = center::get_cfg();
+    startFlickerAll(c.pulse_ms, c.gap_ms, /*cycles*/0, /*invert*/false, /*interrupt*/true, RELAY_TTL, cue_lead_ms());
+  } else {
+    startFlickerAll(on_ms, off_ms, cycles, invert, interrupt, RELAY_TTL, cue_lead_ms());
+  }
+}
+
+static void on_routine_state_change(routine::State ns, routine::State){
+  const center::Cfg c = center::get_cfg();
+  switch (ns){
+    case routine::State::Idle:
+      startSceneAll(makeFlicker(1,0,1, false, true, RELAY_TTL, cue_lead_ms()),   // clear
+                    makeBreath(0,0,64, 0.18f,0.49f, 1000,1200, 0, true, RELAY_TTL, cue_lead_ms()));
+      fillStrip(0,0,20);
+      break;
+    case routine::State::FwdSettle:
+      startFlickerAll(80, 140, /*cycles*/6, false, true, RELAY_TTL, cue_lead_ms());
+      fillStrip(60,60,60);
+      break;
+    case routine::State::FwdCenter:
+      startFlickerAll(c.pulse_ms, c.gap_ms, /*cycles*/0, false, true, RELAY_TTL, cue_lead_ms());   // center cadence
+      fillStrip(0,50,0);
+      break;
+    case routine::State::Coast:
+      startSceneAll(makeFlicker(1,0,1, false, true, RELAY_TTL, cue_lead_ms()),   // clear
+                    makeBreath(0,0,255, 0.26f,0.80f, 1200,1400, 0, true, RELAY_TTL, cue_lead_ms()));
+      fillStrip(0,0,40);
+      break;
+    case routine::State::Brake:
+      startFlickerAll(60, 60, /*cycles*/0, false, true, RELAY_TTL, cue_lead_ms());
+      fillStrip(60,0,0);
+      break;
+    case routine::State::Reverse:
+      startFlickerAll(120, 100, /*cycles*/0, false, true, RELAY_TTL, cue_lead_ms());
+      fillStrip(40,25,0);
+      break;
+  }
+}
+
 // --- BLDC bring-up helpers (manual sweep) ---
 static const int8_t HIN_TAB[6][3] = {
   {1,0,0},{1,0,0},{0,1,0},{0,1,0},{0,0,1},{0,0,1}
@@ -346,6 +849,15 @@ static void printHelp(){
     "  led c\n"
     "  led t [step_ms] [r g b]\n"
     "  mbringup      (manual BLDC 6-step sweep)\n"
+    "  motor | motor zc on|off  (BEMF closed loop status / handover)\n"
+    "  motor ramp US MS [exp|trap|s] | motor stop [MS]\n"
+    "  chain bcast on|off  (broadcast vs unicast to slave 0)\n"
+    "  chain critical on|off  (dual-path relay for breath/flicker)\n"
+    "  log text|bin|stats  (bin: decode with tools/logdecode.py)\n"
+    "  egress status | egress rate N [burst]\n"
+    "  wire auto|legacy|compact|status  (cue frame format)\n"
+    "  links [budget_ms]  (per-link health of the whole chain)\n"
+    "  nodes | nodes enroll on|off | nodes forget N | nodes push | nodes reset\n"
     "  help or ?\n"
   ));
 }
@@ -457,9 +969,9 @@ static void handleActuatorCommand(const String& line){
   if (t[0] == "led"){
     if (n<2){ printHelp(); return; }
     const String& sub = t[1];
-    if (sub=="r"){ startBreathAll(255,0,0, 0.05f,0.6f, 900,1100, 0, true); Serial.println("BREATH: red");   return; }
-    if (sub=="g"){ startBreathAll(0,255,0, 0.05f,0.6f, 900,1100, 0, true); Serial.println("BREATH: green"); return; }
-    if (sub=="b"){ startBreathAll(0,0,255, 0.05f,0.7f, 1000,1200, 0, true);Serial.println("BREATH: blue");  return; }
+    if (sub=="r"){ startBreathAll(255,0,0, 0.26f,0.8f, 900,1100, 0, true); Serial.println("BREATH: red");   return; }
+    if (sub=="g"){ startBreathAll(0,255,0, 0.26f,0.8f, 900,1100, 0, true); Serial.println("BREATH: green"); return; }
+    if (sub=="b"){ startBreathAll(0,0,255, 0.26f,0.85f, 1000,1200, 0, true);Serial.println("BREATH: blue");  return; }
     if (sub=="c"){ startFlickerAll(1,0,1, false, true);                    Serial.println("FLICKER: cleared"); return; }
     if (sub=="f"){
       uint32_t on  = (n>=3)? (uint32_t)toLong(t[2],20) : 20;
@@ -474,7 +986,7 @@ static void handleActuatorCommand(const String& line){
       uint8_t  rr   = (n>=4)? (uint8_t)toLong(t[3],255):255;
       uint8_t  gg   = (n>=5)? (uint8_t)toLong(t[4],0)  :0;
       uint8_t  bb   = (n>=6)? (uint8_t)toLong(t[5],0)  :0;
-      startTestChain(step, rr, gg, bb, 60);
+      startTestChain(step, rr, gg, bb);
       Serial.printf("TEST: step=%u color=(%u,%u,%u)\n", step, rr,gg,bb);
       return;
     }
@@ -482,12 +994,117 @@ static void handleActuatorCommand(const String& line){
     return;
   }
 
+  if (t[0] == "chain" && n>=3 && t[1] == "critical"){
+    g_critical = (t[2] == "on");
+    Serial.printf("CHAIN critical=%s\n", g_critical ? "on" : "off");
+    return;
+  }
+  if (t[0] == "chain" && n>=3 && t[1] == "bcast"){
+    g_broadcast = (t[2] == "on");
+    Serial.printf("CHAIN delivery=%s\n", g_broadcast ? "broadcast" : "unicast");
+    return;
+  }
+
+  if (t[0] == "nodes"){
+    if (n < 2)                { printNodes(); return; }
+    if (t[1] == "enroll" && n>=3){ g_enroll_open = (t[2] == "on"); printNodes(); return; }
+    if (t[1] == "push")       { pushNodes(); Serial.println("NODES: table sent"); return; }
+    if (t[1] == "forget" && n>=3){
+      const long k = toLong(t[2], -1);
+      if (k < 0 || k >= g_nodes.count) { Serial.println("NODES: bad index"); return; }
+      memmove(g_nodes.mac[k], g_nodes.mac[k + 1], (size_t)(g_nodes.count - k - 1) * 6);
+      g_nodes.count--;
+      nodesChanged();
+      printNodes();
+      return;
+    }
+    if (t[1] == "reset"){
+      const uint32_t epoch = g_nodes.epoch;
+      comms::registry::clear();
+      loadNodes();
+      g_nodes.epoch = epoch;   // keep slaves' "newer epoch" check working
+      nodesChanged();
+      printNodes();
+      return;
+    }
+  }
+
+  if (t[0] == "links"){
+    requestLinks(n>=2 ? (uint16_t)constrain((int)toLong(t[1], 2000), 200, 30000) : 0);
+    return;
+  }
+
+  if (t[0] == "wire" && n>=2){
+    if      (t[1] == "auto")    g_wire = Wire::Auto;
+    else if (t[1] == "legacy")  g_wire = Wire::Legacy;
+    else if (t[1] == "compact") g_wire = Wire::Compact;
+    Serial.printf("WIRE mode=%s chain_ver=%u (%lu ms ago) -> %s\n",
+      g_wire == Wire::Auto ? "auto" : (g_wire == Wire::Legacy ? "legacy" : "compact"),
+      (unsigned)g_chain_wire_ver, (unsigned long)(millis() - g_chain_wire_ms),
+      use_compact() ? "compact" : "legacy");
+    return;
+  }
+
+  if (t[0] == "egress" && n>=2){
+    if (t[1] == "status"){ egress::status(Serial); return; }
+    if (t[1] == "rate" && n>=3){
+      egress::Cfg c = egress::get_cfg();
+      c.rate_per_s = (uint16_t)constrain((int)toLong(t[2], c.rate_per_s), 1, 1000);
+      if (n>=4) c.burst = (uint8_t)constrain((int)toLong(t[3], c.burst), 1, 64);
+      egress::set_cfg(c);
+      Serial.printf("EGRESS rate=%u/s burst=%u\n", c.rate_per_s, c.burst);
+      return;
+    }
+  }
+
+  if (t[0] == "log" && n>=2){
+    if (t[1] == "text"){ logging::set_output(logging::Output::Text);   Serial.println("LOG text");   return; }
+    if (t[1] == "bin"){  logging::set_output(logging::Output::Binary); return; }
+    if (t[1] == "stats"){
+      logging::Stats st = logging::stats();
+      Serial.printf("LOG written=%lu dropped=%lu drained=%lu depth_max=%lu\n",
+        (unsigned long)st.written, (unsigned long)st.dropped,
+        (unsigned long)st.drained, (unsigned long)st.depth_max);
+      return;
+    }
+  }
+
   if (t[0] == "mbringup"){
     Serial.println("Manual 6-step bring-up…");
     motorBringUpOnce();
     return;
   }
 
+  if (t[0] == "motor"){
+    if (n>=3 && t[1]=="zc"){
+      motion::setZeroCross(t[2]=="on");
+      Serial.printf("MOTOR: zero-cross closed loop %s\n", t[2]=="on" ? "allowed" : "off");
+      return;
+    }
+    if (n>=4 && t[1]=="ramp"){
+      motion::Curve c = motion::Curve::SCurve;
+      if (n>=5 && t[4]=="exp")  c = motion::Curve::Exponential;
+      if (n>=5 && t[4]=="trap") c = motion::Curve::Trapezoid;
+      motion::rampTo((int)toLong(t[2], 12000), (uint32_t)toLong(t[3], 1000), c);
+      Serial.printf("MOTOR: ramp to %ld us over %ld ms\n", toLong(t[2], 12000), toLong(t[3], 1000));
+      return;
+    }
+    if (n>=2 && t[1]=="stop"){
+      motion::rampStop(n>=3 ? (uint32_t)toLong(t[2], 0) : 0);
+      Serial.println("MOTOR: decelerating to stop");
+      return;
+    }
+    const motion::ZcStats zs = motion::zcStats();
+    Serial.printf("MOTOR: %s %s %s step=%d us%s  zc=%lu rej=%lu handover=%lu lost=%lu\n",
+      motion::isRunning() ? "running" : "stopped",
+      motion::backend() == motion::Backend::Mcpwm ? "mcpwm" : "ledc",
+      motion::isClosedLoop() ? "closed-loop" : "open-loop",
+      motion::currentDelayMicros(), motion::isRamping() ? " (ramping)" : "",
+      (unsigned long)zs.crossings, (unsigned long)zs.rejected,
+      (unsigned long)zs.handovers, (unsigned long)zs.losses);
+    return;
+  }
+
   if (t[0] == "routine") {
     // routine log on|off
 if (n>=3 && t[1]=="log") {
@@ -536,12 +1153,12 @@ if (n>=5 && t[1]=="dur") {
   // Single-letter convenience (still line-based)
   if (t[0].length()==1 && n==1){
     char k = t[0][0];
-    if (k=='b'){ startBreathAll(0,0,255, 0.05f,0.7f, 1000,1200, 0, true); Serial.println("BREATH: blue");  return; }
-    if (k=='r'){ startBreathAll(255,0,0, 0.05f,0.6f,  900,1100, 0, true); Serial.println("BREATH: red");   return; }
-    if (k=='g'){ startBreathAll(0,255,0, 0.05f,0.6f,  900,1100, 0, true); Serial.println("BREATH: green"); return; }
+    if (k=='b'){ startBreathAll(0,0,255, 0.26f,0.85f, 1000,1200, 0, true); Serial.println("BREATH: blue");  return; }
+    if (k=='r'){ startBreathAll(255,0,0, 0.26f,0.8f,  900,1100, 0, true); Serial.println("BREATH: red");   return; }
+    if (k=='g'){ startBreathAll(0,255,0, 0.26f,0.8f,  900,1100, 0, true); Serial.println("BREATH: green"); return; }
     if (k=='f'){ startFlickerAll(20,20, 40, false, true);                 Serial.println("FLICKER: 20/20 x40"); return; }
     if (k=='c'){ startFlickerAll(1,0,1, false, true);                      Serial.println("FLICKER: cleared");    return; }
-    if (k=='t'){ startTestChain(50, 255,0,0, 60);                           Serial.println("TEST chain kicked off."); return; }
+    if (k=='t'){ startTestChain(50, 255,0,0);                               Serial.println("TEST chain kicked off."); return; }
     if (k=='x'){ motion::startOpenLoop();                                   Serial.println("MOTOR: start open-loop"); return; }
     if (k=='X'){ motion::stop();                                            Serial.println("MOTOR: stopped");        return; }
   }
@@ -554,8 +1171,8 @@ static void handleConsoleInput(){
     int ch = Serial.read();
     if (ch < 0) break;
 
-    // echo each byte like your preferred logs
-    Serial.printf("[key] 0x%02X '%c'\n", ch, (ch >= 32 && ch <= 126) ? ch : '.');
+    // echo each byte (build with -D LOG_LEVEL=5 to see it)
+    LOGV("[key] 0x%02X '%c'", ch, (ch >= 32 && ch <= 126) ? ch : '.');
 
     if (ch == '\r') continue;
     if (ch == '\n'){
@@ -570,13 +1187,16 @@ static void handleConsoleInput(){
 // -------------------- Arduino setup/loop --------------------
 void setup() {
   Serial.begin(115200);
+  logging::begin(Serial);
 
   pinMode(LED_BUILTIN, OUTPUT);
 
   strip.begin();
   strip.show();
 
+  loadNodes();
   setupESPNow();
+  egress::init(send_to_first_slave);
   Serial.print("Master MAC: "); Serial.println(WiFi.macAddress());
 
   // --- MOTOR (BLDC) ---
@@ -606,7 +1226,7 @@ void setup() {
   Serial.println("CENTER preset: power=15 pulse=200 gap=1 bias=-2 brake=on(160)");
 
   // Default breath: visual confirmation after boot
-  startBreathAll(0,0,255, 0.05f,0.6f, 1200,1400, 0, true);
+  startBreathAll(0,0,255, 0.26f,0.8f, 1200,1400, 0, true);
 
   fillStrip(0,0,40);
   printHelp();
@@ -633,6 +1253,8 @@ void setup() {
 routine::init();
 routine::set_log(true);     // <= make sure logs are enabled
 // routine::set_random(true);  // optional, if you gate randomness
+routine::set_state_cb(on_routine_state_change);
+routine::set_flicker_cb(routine_flicker_cb);
 routine::start();
 
 }
@@ -649,6 +1271,12 @@ void loop() {
 
   center::tick();
   routine::tick();
+  refreshTick(now);
+  syncTick();
+  egress::tick();
+  linksTick();
+  enrollTick();
+  tableTick();
 
   static uint32_t led_ms = 0;
   if (now - led_ms > 500) {
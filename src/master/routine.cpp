@@ -1,13 +1,14 @@
 #include "routine.h"
 #include "center.h"
 #include <actuator.h>
+#include <logging.h>
 
 namespace routine {
 
 static FlickerFn s_flicker_cb = nullptr;
 void set_flicker_cb(FlickerFn fn){ 
   s_flicker_cb = fn; 
-  Serial.printf("routine: set_flicker_cb stored=%p\n", (void*)s_flicker_cb);
+  LOGD("routine: set_flicker_cb stored=%p", (void*)s_flicker_cb);
 }
 
 static StateCb s_state_cb = nullptr;
@@ -48,7 +49,7 @@ static void enter(State s){
   actuator::enableAuto(false);
   center::off();
 
-  Serial.printf("routine: enter(%s) cb=%p\n", state_name(s), (void*)s_flicker_cb);
+  LOGD("routine: enter(%s) cb=%p", state_name(s), (void*)s_flicker_cb);
 
   switch (s){
     case State::Idle:
@@ -80,7 +81,7 @@ static void enter(State s){
     }
   }
 
-  if (s_log) Serial.printf("ROUTINE -> %-9s dur=%lu ms\n", state_name(s), (unsigned long)s_dur);
+  if (s_log) LOGI("ROUTINE -> %-9s dur=%lu ms", state_name(s), (unsigned long)s_dur);
 
   // >>> fire state-change callback last
   if (s_state_cb) s_state_cb(s, old);
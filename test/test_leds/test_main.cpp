@@ -0,0 +1,281 @@
+// Fixed-point cue math and renderer frames on the host (pio test -e native).
+// The float model below is leds::breathBrightness / flickerGate, the
+// reference the fixed-point path was built against.
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <fixmath.h>
+#include <codec.h>
+#include <frame.h>
+
+using namespace leds;
+
+void setUp() {}
+void tearDown() {}
+
+// ---------- float reference ----------
+static float refLevel(uint32_t now, const BreathMsg& p) {
+  if (p.mode != MODE_BREATH) return 0.0f;
+  if ((int32_t)(now - p.t0_ms) < 0) return p.b_min;
+  const uint32_t period = p.up_ms + p.down_ms;
+  if (!period) return p.b_min;
+  const uint32_t elapsed = now - p.t0_ms;
+  if (p.cycles && elapsed >= (uint32_t)p.cycles * period) return p.b_min;
+  const uint32_t t = elapsed % period;
+  const float x = t < p.up_ms ? (float)t / p.up_ms : 1.0f - (float)(t - p.up_ms) / p.down_ms;
+  return p.b_min + (p.b_max - p.b_min) * 0.5f * (1.0f - cosf(3.1415926f * x));
+}
+
+static uint8_t refGate(uint32_t now, const FlickerMsg& f) {
+  if (f.mode != MODE_FLICKER) return 1;
+  if ((int32_t)(now - f.t0_ms) < 0) return 0;
+  const uint32_t period = (uint32_t)f.on_ms + f.off_ms;
+  if (!period) return 1;
+  if (f.cycles && (now - f.t0_ms) >= (uint32_t)f.cycles * period) return 1;
+  const uint8_t g = ((now - f.t0_ms) % period) < f.on_ms ? 1 : 0;
+  return f.invert ? !g : g;
+}
+
+static const uint16_t TOL = 2 * 257;   // 2/255 in Q16
+
+static BreathMsg wrapBreath() {
+  BreathMsg b{};
+  b.mode = MODE_BREATH; b.r = 255; b.g = 128; b.b = 8;
+  b.b_min = 0.1f; b.b_max = 0.8f; b.up_ms = 700; b.down_ms = 900; b.cycles = 3;
+  b.t0_ms = 0xFFFFFF00u;   // starts 256 ms before the millis() wrap
+  return b;
+}
+
+static FlickerMsg wrapFlicker(uint8_t invert) {
+  FlickerMsg f{};
+  f.mode = MODE_FLICKER; f.on_ms = 30; f.off_ms = 70; f.cycles = 4; f.invert = invert;
+  f.t0_ms = 0xFFFFFFF0u;
+  return f;
+}
+
+// ---------- cue math ----------
+void test_breath_fixed_matches_float_across_wrap() {
+  const BreathMsg b = wrapBreath();
+  const uint32_t period = b.up_ms + b.down_ms;
+  fx::Breath fb;
+  fb.prepare(codec::to_cue(b));
+  for (uint32_t k = 0; k < 3 * period + 500; k += 7) {
+    const uint32_t now = b.t0_ms + k;
+    TEST_ASSERT_UINT_WITHIN(TOL, fx::unit_q16(refLevel(now, b)), fb.level(now));
+  }
+}
+
+void test_breath_cycle_ends() {
+  const BreathMsg b = wrapBreath();
+  const uint32_t period = b.up_ms + b.down_ms;
+  fx::Breath fb;
+  fb.prepare(codec::to_cue(b));
+  TEST_ASSERT_EQUAL(codec::to_q16(b.b_min), fb.level(b.t0_ms - 10));                   // before t0
+  TEST_ASSERT_UINT_WITHIN(TOL, codec::to_q16(b.b_max), fb.level(b.t0_ms + period + b.up_ms));
+  TEST_ASSERT_EQUAL(codec::to_q16(b.b_min), fb.level(b.t0_ms + 3 * period));            // rests at b_min
+}
+
+void test_flicker_gate_matches_reference() {
+  for (uint8_t inv = 0; inv < 2; ++inv) {
+    const FlickerMsg f = wrapFlicker(inv);
+    fx::Flicker ff;
+    ff.prepare(f);
+    for (uint32_t k = 0; k < 4 * 100 + 200; k += 3) {
+      TEST_ASSERT_EQUAL(refGate(f.t0_ms + k, f), ff.gate(f.t0_ms + k));
+    }
+    TEST_ASSERT_EQUAL(inv ? 0 : 1, ff.gate(f.t0_ms + 10));
+    TEST_ASSERT_EQUAL(inv ? 1 : 0, ff.gate(f.t0_ms + 50));
+    TEST_ASSERT_EQUAL(1, ff.gate(f.t0_ms + 400));   // open after the last cycle
+    TEST_ASSERT_EQUAL(0, ff.gate(f.t0_ms - 5));     // closed before t0
+  }
+}
+
+// A compact breath frame decodes to the same Q16 levels the master encoded,
+// and a legacy struct converts to the same cue: the renderer sees no floats.
+void test_compact_breath_keeps_q16() {
+  const BreathMsg b = wrapBreath();
+  uint8_t buf[codec::MAX_FRAME];
+  const size_t n = codec::encode(b, buf, sizeof(buf));
+  TEST_ASSERT_TRUE(n > 0);
+  BreathCue c{};
+  TEST_ASSERT_EQUAL(n, codec::decode(buf, n, c));
+  const BreathCue ref = codec::to_cue(b);
+  TEST_ASSERT_EQUAL(0, memcmp(&ref, &c, sizeof(c)));
+  TEST_ASSERT_EQUAL(codec::to_q16(0.1f), c.b_min);
+  TEST_ASSERT_EQUAL(codec::to_q16(0.8f), c.b_max);
+}
+
+// ---------- golden frames ----------
+// Breath gated by a flicker, through a 3-of-4 grouping mask, at fixed
+// times: the lit colour must match exactly (renderer output on the wire).
+struct Golden { uint32_t at; bool gamma; uint8_t r, g, b; };
+
+static const Golden GOLDEN[] = {
+  {    50, false,   0,   0,   0 },
+  {   100, false,  10,   6,   2 },
+  {   140, false,  11,   6,   2 },
+  {   260, false,   0,   0,   0 },
+  {   350, false,  35,  21,   7 },
+  {   600, false,  95,  57,  19 },
+  {  1100, false, 180, 108,  36 },
+  {  1120, false, 180, 108,  36 },
+  {  1800, false, 104,  62,  21 },
+  {  2590, false,  10,   6,   2 },
+  {  2610, false,  10,   6,   2 },
+  {  5100, false,  10,   6,   2 },
+  {    50, true,    0,   0,   0 },
+  {   100, true,    0,   0,   0 },
+  {   140, true,    0,   0,   0 },
+  {   260, true,    0,   0,   0 },
+  {   350, true,    4,   2,   1 },
+  {   600, true,   37,  22,   7 },
+  {  1100, true,  158,  95,  32 },
+  {  1120, true,  158,  95,  32 },
+  {  1800, true,   46,  27,   9 },
+  {  2590, true,    0,   0,   0 },
+  {  2610, true,    0,   0,   0 },
+  {  5100, true,    0,   0,   0 }
+};
+
+void test_golden_frames() {
+  BreathMsg b{};
+  b.mode = MODE_BREATH; b.r = 200; b.g = 120; b.b = 40;
+  b.b_min = 0.05f; b.b_max = 0.9f; b.up_ms = 1000; b.down_ms = 1500; b.t0_ms = 100;
+  FlickerMsg f{};
+  f.mode = MODE_FLICKER; f.on_ms = 150; f.off_ms = 50; f.t0_ms = 100;
+
+  static const uint16_t N = 12;
+  uint8_t px[N * 3];
+  for (const Golden& gd : GOLDEN) {
+    fx::Breath fb; fx::Flicker ff;
+    fb.prepare(codec::to_cue(b)); ff.prepare(f);
+    const frame::Rgb c = frame::colour(&fb, &ff, frame::Rgb{ 0, 0, 127 }, gd.gamma, gd.at);
+    frame::paint(px, N, c, 4, 3);
+    for (uint16_t i = 0; i < N; ++i) {
+      const bool on = (i % 4) < 3;
+      TEST_ASSERT_EQUAL(on ? gd.r : 0, px[3 * i + 0]);
+      TEST_ASSERT_EQUAL(on ? gd.g : 0, px[3 * i + 1]);
+      TEST_ASSERT_EQUAL(on ? gd.b : 0, px[3 * i + 2]);
+    }
+  }
+}
+
+void test_flicker_alone_gates_default_colour() {
+  FlickerMsg f{};
+  f.mode = MODE_FLICKER; f.on_ms = 10; f.off_ms = 10; f.t0_ms = 0;
+  fx::Flicker ff;
+  ff.prepare(f);
+  const frame::Rgb def{ 0, 0, 127 };
+  const frame::Rgb on  = frame::colour(nullptr, &ff, def, true, 5);
+  const frame::Rgb off = frame::colour(nullptr, &ff, def, true, 15);
+  TEST_ASSERT_EQUAL(127, on.b);
+  TEST_ASSERT_EQUAL(0, off.b);
+  const frame::Rgb none = frame::colour(nullptr, nullptr, def, true, 5);
+  TEST_ASSERT_EQUAL(0, none.r + none.g + none.b);
+}
+
+void test_encode_golden() {
+  const uint8_t px[6] = { 255, 128, 1, 0, 64, 200 };
+  uint8_t out[8];
+  static const uint8_t FULL[8] = { 0xFF, 255, 128, 1, 0xFF, 0, 64, 200 };
+  static const uint8_t HALF[8] = { 0xFF, 127, 64, 0, 0xFF, 0, 32, 100 };
+  frame::encode(out, px, 2, 255);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(FULL, out, 8);
+  frame::encode(out, px, 2, 127);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(HALF, out, 8);
+}
+
+// ---------- cue math cost ----------
+// The old on-device benchMath: breath level + flicker gate per call, the
+// float path the renderers used against fx::Breath / fx::Flicker.
+void test_bench_math_ns() {
+  static const uint32_t CALLS = 200000;
+  BreathMsg b{};
+  b.mode = MODE_BREATH; b.b_min = 0.02f; b.b_max = 0.9f; b.up_ms = 1700; b.down_ms = 2300;
+  FlickerMsg f{};
+  f.mode = MODE_FLICKER; f.on_ms = 60; f.off_ms = 40;
+  volatile float fsink = 0;
+  volatile uint32_t sink = 0;
+  typedef std::chrono::steady_clock clk;
+
+  auto t = clk::now();
+  for (uint32_t i = 0; i < CALLS; ++i) fsink = fsink + refLevel(i * 3, b) * refGate(i * 3, f);
+  const long long floatNs = std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - t).count() * 1000 / CALLS;
+
+  fx::Breath fb; fx::Flicker ff;
+  fb.prepare(codec::to_cue(b)); ff.prepare(f);
+  t = clk::now();
+  for (uint32_t i = 0; i < CALLS; ++i) sink += ff.gate(i * 3) ? fb.level(i * 3) : 0;
+  const long long fixedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - t).count() * 1000 / CALLS;
+
+  char line[96];
+  snprintf(line, sizeof(line), "level+gate: float %lld.%03lld ns, fixed %lld.%03lld ns per call",
+           floatNs / 1000, floatNs % 1000, fixedNs / 1000, fixedNs % 1000);
+  TEST_MESSAGE(line);
+  (void)fsink; (void)sink;
+}
+
+// ---------- per-frame cost ----------
+// colour + grouping mask + APA102 encode, what a renderer does per frame
+// before the wire; the float column is the old per-frame breath math. The
+// colour is computed once per frame, so paint + encode dominate and both
+// columns come out about the same.
+void test_bench_frame_ns() {
+  static const uint16_t SIZES[] = { 30, 144, 300, 1000 };
+  static const uint32_t FRAMES = 2000;
+  static uint8_t px[1000 * 3], wire[1000 * 4];
+  BreathMsg b{};
+  b.mode = MODE_BREATH; b.r = 200; b.g = 120; b.b = 40;
+  b.b_min = 0.02f; b.b_max = 0.9f; b.up_ms = 1700; b.down_ms = 2300;
+  FlickerMsg f{};
+  f.mode = MODE_FLICKER; f.on_ms = 60; f.off_ms = 40;
+  volatile uint32_t sink = 0;
+  typedef std::chrono::steady_clock clk;
+
+  TEST_MESSAGE("pixels  float ns  fixed ns  (colour + mask + encode, per frame)");
+  for (uint16_t n : SIZES) {
+    auto t = clk::now();
+    for (uint32_t i = 0; i < FRAMES; ++i) {
+      const float l = refLevel(i * 16, b) * refGate(i * 16, f);
+      const frame::Rgb c{ (uint8_t)(b.r * l), (uint8_t)(b.g * l), (uint8_t)(b.b * l) };
+      frame::paint(px, n, c, 1, 1);
+      frame::encode(wire, px, n, 255);
+      sink += wire[4 * (i % n) + 1];
+    }
+    const long long floatNs = std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - t).count() / FRAMES;
+
+    const BreathCue cue = codec::to_cue(b);   // what a node receives
+    fx::Breath fb; fx::Flicker ff;
+    t = clk::now();
+    for (uint32_t i = 0; i < FRAMES; ++i) {
+      fb.prepare(cue); ff.prepare(f);
+      const frame::Rgb c = frame::colour(&fb, &ff, frame::Rgb{ 0, 0, 127 }, true, i * 16);
+      frame::paint(px, n, c, 1, 1);
+      frame::encode(wire, px, n, 255);
+      sink += wire[4 * (i % n) + 1];
+    }
+    const long long fixedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - t).count() / FRAMES;
+
+    char line[80];
+    snprintf(line, sizeof(line), "%6u  %8lld  %8lld", (unsigned)n, floatNs, fixedNs);
+    TEST_MESSAGE(line);
+  }
+  (void)sink;
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_breath_fixed_matches_float_across_wrap);
+  RUN_TEST(test_breath_cycle_ends);
+  RUN_TEST(test_flicker_gate_matches_reference);
+  RUN_TEST(test_compact_breath_keeps_q16);
+  RUN_TEST(test_golden_frames);
+  RUN_TEST(test_flicker_alone_gates_default_colour);
+  RUN_TEST(test_encode_golden);
+  RUN_TEST(test_bench_math_ns);
+  RUN_TEST(test_bench_frame_ns);
+  return UNITY_END();
+}
@@ -0,0 +1,127 @@
+// Peer working set on the host (pio test -e native): LRU eviction, the
+// HOLD_MS guard (forced evictions) and re-registration after the driver
+// lost a peer (espnow.cpp's stale path: forget(), then touch() again).
+#include <unity.h>
+#include <string.h>
+#include <peercache.h>
+
+using namespace comms;
+
+void setUp() {}
+void tearDown() {}
+
+typedef PeerCache<4> Cache;
+
+static const uint8_t* mac(uint8_t n) {
+  static uint8_t m[256][6];
+  const uint8_t v[6] = { 0x24, 0x6F, 0x28, 0x00, 0x00, n };
+  memcpy(m[n], v, 6);
+  return m[n];
+}
+
+static void test_hits_and_misses() {
+  Cache c;
+  TEST_ASSERT_FALSE(c.touch(mac(1), 0).hit);
+  TEST_ASSERT_TRUE(c.touch(mac(1), 5).hit);
+  TEST_ASSERT_FALSE(c.touch(mac(2), 5).hit);
+  const Cache::Stats st = c.stats();
+  TEST_ASSERT_EQUAL(1, st.hits);
+  TEST_ASSERT_EQUAL(2, st.misses);
+  TEST_ASSERT_EQUAL(0, st.evictions);
+  TEST_ASSERT_EQUAL(2, st.used);
+  TEST_ASSERT_EQUAL(4, Cache::capacity());
+}
+
+// Full cache, every entry past HOLD_MS: the least recently used one goes
+static void test_evicts_least_recently_used() {
+  Cache c;
+  for (uint8_t n = 1; n <= 4; ++n) c.touch(mac(n), n);
+  c.touch(mac(1), 10);                                  // 2 is now the oldest
+  const Cache::Lookup r = c.touch(mac(5), 1000);
+  TEST_ASSERT_FALSE(r.hit);
+  TEST_ASSERT_TRUE(r.evicted);
+  TEST_ASSERT_EQUAL_MEMORY(mac(2), r.victim, 6);
+  TEST_ASSERT_FALSE(c.contains(mac(2)));
+  TEST_ASSERT_TRUE(c.contains(mac(1)));
+  TEST_ASSERT_TRUE(c.contains(mac(5)));
+  TEST_ASSERT_EQUAL(1, c.stats().evictions);
+  TEST_ASSERT_EQUAL(0, c.stats().forced);
+}
+
+// Entries used within HOLD_MS are skipped while an older one exists
+static void test_hold_protects_fresh_entries() {
+  Cache c;
+  c.touch(mac(1), 0);                                   // LRU, but will be fresh
+  c.touch(mac(2), 0);
+  c.touch(mac(3), 0);
+  c.touch(mac(4), 0);
+  c.touch(mac(1), 950);
+  c.touch(mac(3), 950);
+  c.touch(mac(4), 950);
+  const Cache::Lookup r = c.touch(mac(5), 1000);        // only 2 is past HOLD_MS
+  TEST_ASSERT_TRUE(r.evicted);
+  TEST_ASSERT_EQUAL_MEMORY(mac(2), r.victim, 6);
+  TEST_ASSERT_EQUAL(0, c.stats().forced);
+}
+
+// Every entry fresh: plain LRU, counted as forced
+static void test_forced_eviction() {
+  Cache c;
+  for (uint8_t n = 1; n <= 4; ++n) c.touch(mac(n), 1000 + n);
+  const Cache::Lookup r = c.touch(mac(5), 1000 + Cache::HOLD_MS / 2);
+  TEST_ASSERT_TRUE(r.evicted);
+  TEST_ASSERT_EQUAL_MEMORY(mac(1), r.victim, 6);
+  TEST_ASSERT_EQUAL(1, c.stats().forced);
+
+  // millis() wrap: an entry from just before it is still fresh
+  Cache w;
+  for (uint8_t n = 1; n <= 4; ++n) w.touch(mac(n), 0xFFFFFFF0u + n);
+  w.touch(mac(5), 20);
+  TEST_ASSERT_EQUAL(1, w.stats().forced);
+}
+
+// The driver lost a peer the cache still lists (ESP_ERR_ESPNOW_NOT_FOUND):
+// forget() it and the next touch() registers it again, without evicting
+static void test_stale_entry_is_registered_again() {
+  Cache c;
+  for (uint8_t n = 1; n <= 4; ++n) c.touch(mac(n), n);
+  TEST_ASSERT_TRUE(c.forget(mac(3)));
+  TEST_ASSERT_FALSE(c.forget(mac(3)));
+  TEST_ASSERT_FALSE(c.contains(mac(3)));
+  const Cache::Lookup r = c.touch(mac(3), 2000);
+  TEST_ASSERT_FALSE(r.hit);
+  TEST_ASSERT_FALSE(r.evicted);                         // its slot was free
+  TEST_ASSERT_TRUE(c.touch(mac(3), 2001).hit);
+  TEST_ASSERT_EQUAL(0, c.stats().evictions);
+  TEST_ASSERT_EQUAL(4, c.stats().used);
+
+  c.clear();                                            // fresh esp_now_init()
+  TEST_ASSERT_EQUAL(0, c.stats().used);
+  TEST_ASSERT_FALSE(c.touch(mac(1), 3000).hit);
+}
+
+// More MACs than slots in round robin: every touch misses and evicts
+static void test_working_set_larger_than_cache() {
+  Cache c;
+  uint32_t now = 0;
+  for (int round = 0; round < 3; ++round) {
+    for (uint8_t n = 1; n <= 6; ++n) c.touch(mac(n), now += 200);
+  }
+  const Cache::Stats st = c.stats();
+  TEST_ASSERT_EQUAL(0, st.hits);
+  TEST_ASSERT_EQUAL(18, st.misses);
+  TEST_ASSERT_EQUAL(14, st.evictions);
+  TEST_ASSERT_EQUAL(0, st.forced);
+  TEST_ASSERT_EQUAL(4, st.used);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_hits_and_misses);
+  RUN_TEST(test_evicts_least_recently_used);
+  RUN_TEST(test_hold_protects_fresh_entries);
+  RUN_TEST(test_forced_eviction);
+  RUN_TEST(test_stale_entry_is_registered_again);
+  RUN_TEST(test_working_set_larger_than_cache);
+  return UNITY_END();
+}
@@ -0,0 +1,105 @@
+// Node table frames on the host (pio test -e native): a table split into
+// ENROLL_TABLE parts and put back together by registry::Assembler.
+#include <unity.h>
+#include <string.h>
+#include <registry.h>
+
+using namespace comms;
+
+void setUp() {}
+void tearDown() {}
+
+static registry::Table s_t;
+
+static void fill(registry::Table& t, size_t n, uint32_t epoch) {
+  memset(&t, 0, sizeof(t));
+  t.epoch = epoch;
+  for (size_t i = 0; i < n; ++i) {
+    const uint8_t mac[6] = { 0x24, 0x6F, 0x28, (uint8_t)(i >> 8), (uint8_t)i, (uint8_t)(i * 7) };
+    TEST_ASSERT_TRUE(registry::append(t, mac));
+  }
+}
+
+// Every part in the given order; returns the Complete count
+static int feed(registry::Assembler& a, const registry::Table& t, const size_t* order, size_t n) {
+  int complete = 0;
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t buf[250];
+    const size_t len = registry::encode(t, order[i], 7, buf, sizeof(buf));
+    TEST_ASSERT_TRUE(len > 0);
+    TEST_ASSERT_TRUE(len <= 250);
+    if (a.add(buf, len) == registry::Assembler::Complete) complete++;
+  }
+  return complete;
+}
+
+static void test_round_trip_sizes() {
+  const size_t sizes[] = { 0, 1, registry::PER_FRAME, registry::PER_FRAME + 1, 100, registry::MAX_NODES };
+  for (size_t n : sizes) {
+    fill(s_t, n, 3);
+    const size_t parts = registry::parts(s_t);
+    TEST_ASSERT_EQUAL(n ? (n + registry::PER_FRAME - 1) / registry::PER_FRAME : 1, parts);
+    size_t order[registry::MAX_PARTS];
+    for (size_t p = 0; p < parts; ++p) order[p] = parts - 1 - p;   // reversed
+    static registry::Assembler a;
+    a = registry::Assembler();
+    TEST_ASSERT_EQUAL(1, feed(a, s_t, order, parts));
+    TEST_ASSERT_EQUAL(n, a.table().count);
+    TEST_ASSERT_EQUAL_UINT32(3, a.table().epoch);
+    if (n) TEST_ASSERT_EQUAL_MEMORY(s_t.mac, a.table().mac, n * 6);
+  }
+  TEST_ASSERT_EQUAL(registry::MAX_NODES - 1, registry::index_of(s_t, s_t.mac[registry::MAX_NODES - 1]));
+  uint8_t buf[250];
+  TEST_ASSERT_EQUAL(0, registry::encode(s_t, registry::parts(s_t), 7, buf, sizeof(buf)));
+  TEST_ASSERT_FALSE(registry::append(s_t, s_t.mac[0]));   // full
+}
+
+static void test_duplicates_and_epochs() {
+  static registry::Assembler a;
+  registry::Table t2;
+  fill(s_t, 100, 5);
+  const size_t dup[] = { 0, 0, 1 };
+  TEST_ASSERT_EQUAL(0, feed(a, s_t, dup, 3));
+  const size_t last[] = { 2, 2 };
+  TEST_ASSERT_EQUAL(1, feed(a, s_t, last, 2));   // Complete once
+
+  // older epoch is ignored, newer one starts over
+  fill(t2, 100, 4);
+  uint8_t buf[250];
+  size_t len = registry::encode(t2, 0, 7, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(registry::Assembler::Ignored, a.add(buf, len));
+  fill(t2, 41, 6);
+  len = registry::encode(t2, 1, 7, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(registry::Assembler::Partial, a.add(buf, len));
+  len = registry::encode(t2, 0, 7, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(registry::Assembler::Complete, a.add(buf, len));
+  TEST_ASSERT_EQUAL(41, a.table().count);
+  TEST_ASSERT_EQUAL_MEMORY(t2.mac, a.table().mac, 41 * 6);
+}
+
+static void test_malformed_parts() {
+  static registry::Assembler a;
+  fill(s_t, 100, 9);
+  uint8_t buf[250];
+  const size_t len = registry::encode(s_t, 1, 7, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(registry::Assembler::Ignored, a.add(buf, len - 1));   // truncated
+  uint8_t bad[250];
+  memcpy(bad, buf, len);
+  bad[offsetof(EnrollHdr, offset)] = 41;                                  // off the part grid
+  TEST_ASSERT_EQUAL(registry::Assembler::Ignored, a.add(bad, len));
+  memcpy(bad, buf, len);
+  bad[offsetof(EnrollHdr, total)] = registry::MAX_NODES + 1;
+  TEST_ASSERT_EQUAL(registry::Assembler::Ignored, a.add(bad, len));
+  memcpy(bad, buf, len);
+  bad[offsetof(EnrollHdr, count)] = 39;                                   // short part
+  TEST_ASSERT_EQUAL(registry::Assembler::Ignored, a.add(bad, len));
+  TEST_ASSERT_EQUAL(registry::Assembler::Partial, a.add(buf, len));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip_sizes);
+  RUN_TEST(test_duplicates_and_epochs);
+  RUN_TEST(test_malformed_parts);
+  return UNITY_END();
+}
@@ -0,0 +1,231 @@
+// Relay logic over the simulated medium (pio test -e native): the
+// firmware's cue path, ARQ and clock sync per node (simnet.h), fed compact
+// breath cues by a master. Reports per-node cue latency, channel airtime
+// and the spread of effect start times (each node's rebased t0, mapped
+// back from its own clock) for 29 and 100 nodes, chain and tree, with the
+// cue lead the master derives (topology::lead_ms).
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <simnet.h>
+#include <codec.h>
+
+using namespace comms;
+
+void setUp() {}
+void tearDown() {}
+
+static const int64_t  SPREAD_MAX_US = 2000;   // tree: 1 ms of t0 rounding + sync error
+static const uint32_t WARMUP_LEAD_MS = 1000;
+
+using simnet::Net;
+
+struct Result {
+  std::vector<int64_t> lat_us;   // every (cue, node) delivery
+  int64_t  spread_max_us;        // worst start spread over the cues
+  uint32_t lead_ms;              // t0 - now at the master
+  uint32_t late;                 // deliveries after t0
+  uint32_t missed;
+  uint64_t airtime_us;
+  int64_t  elapsed_us;
+};
+
+static int64_t pct(const std::vector<int64_t>& v, int p) {
+  return v.empty() ? 0 : v[(v.size() - 1) * p / 100];
+}
+
+// One breath cue from the master, then run the medium for window_us.
+// net.got_us / start_us hold the deliveries.
+template <size_t N>
+static void send_cue(Net<N>& net, uint32_t seq, int64_t window_us, uint32_t lead_ms = WARMUP_LEAD_MS) {
+  const int64_t sent_us = net.air.now_us();
+  BreathCue m{};
+  m.mode = MODE_BREATH; m.seq = seq; m.ttl = 255;
+  m.t0_ms = net.master_ms() + lead_ms;
+  m.r = 255; m.b_max = 0xFFFF; m.up_ms = 2000; m.down_ms = 2000;
+  uint8_t f[codec::MAX_FRAME];
+  const size_t len = codec::encode(m, f, sizeof(f));
+  TEST_ASSERT_TRUE(len > 0);
+
+  net.clear_cue();
+  net.master_send(f, len);
+  net.run(sent_us + window_us);
+}
+
+template <size_t N>
+static Result run_cues(topology::Kind k, uint8_t fanout, uint8_t loss_pct, size_t cues,
+                       uint32_t seed) {
+  std::unique_ptr<Net<N>> owner(new Net<N>(seed));   // too big for the stack
+  Net<N>& net = *owner;
+  airsim::LinkCfg link;
+  link.loss_pct = loss_pct;
+  net.air.set_all_links(link);
+  net.setup(k, fanout);
+  TEST_ASSERT_TRUE(net.sync_all(4 * N, 250000) > 0);   // SYNC_FAST_PERIOD_MS until the fit
+
+  // The master's cue lead: one cue to get the relays' send->ack times (its
+  // links sweep), then topology::lead_ms as in src/master/main.cpp. The
+  // link latency stands for the reception delay no stat covers.
+  send_cue(net, 1, 500000);
+  uint64_t srtt = 0;
+  uint32_t frame_us = UINT32_MAX;
+  size_t   relays = 0;
+  for (size_t i = 0; i < N; ++i) {
+    const int32_t s = net.arq_stats(i).srtt_us;
+    if (s <= 0) continue;
+    srtt += (uint64_t)s;
+    if ((uint32_t)s < frame_us) frame_us = (uint32_t)s;
+    relays++;
+  }
+  TEST_ASSERT_TRUE(relays > 0);
+  const uint32_t hop_us = (uint32_t)(srtt / relays) + link.latency_us + link.jitter_us;
+  Result r{};
+  r.lead_ms = topology::lead_ms(net.node[0].layout(), N, hop_us, frame_us);
+
+  for (size_t c = 0; c < cues; ++c) {
+    const int64_t sent_us = net.air.now_us();
+    net.sync_round();
+    send_cue(net, (uint32_t)c + 2, 500000, r.lead_ms);
+
+    // start: the node's rebased t0 on its own clock; a late one keeps the
+    // master's phase, so the spread covers every node
+    airsim::StartSpread spread;
+    for (size_t i = 0; i < N; ++i) {
+      if (net.got_us[i] < 0) { r.missed++; continue; }
+      r.lat_us.push_back(net.got_us[i] - sent_us);
+      if (net.got_us[i] > net.start_us[i]) r.late++;
+      spread.add(net.start_us[i]);
+    }
+    if (spread.spread_us() > r.spread_max_us) r.spread_max_us = spread.spread_us();
+  }
+  std::sort(r.lat_us.begin(), r.lat_us.end());
+  r.airtime_us = net.air.stats().airtime_us;
+  r.elapsed_us = net.air.now_us();
+  return r;
+}
+
+static void report(const char* name, size_t nodes, const Result& r) {
+  char line[192];
+  snprintf(line, sizeof(line),
+           "%-9s %3u  p50 %6lld us  p99 %6lld us  max %6lld us  spread %6lld us  lead %4u ms  late %4u  "
+           "missed %3u  air %5.1f%%",
+           name, (unsigned)nodes, (long long)pct(r.lat_us, 50), (long long)pct(r.lat_us, 99),
+           (long long)(r.lat_us.empty() ? 0 : r.lat_us.back()), (long long)r.spread_max_us,
+           (unsigned)r.lead_ms, (unsigned)r.late, (unsigned)r.missed, 100.0 * r.airtime_us / (r.elapsed_us ? r.elapsed_us : 1));
+  TEST_MESSAGE(line);
+}
+
+static void test_cues_29_nodes() {
+  const Result chain = run_cues<29>(topology::Kind::Chain, 2, 2, 20, 1);
+  const Result tree  = run_cues<29>(topology::Kind::Tree,  2, 2, 20, 1);
+  report("chain", 29, chain);
+  report("tree k=2", 29, tree);
+  TEST_ASSERT_EQUAL(0, chain.missed);
+  TEST_ASSERT_EQUAL(0, tree.missed);
+  TEST_ASSERT_EQUAL(0, chain.late);             // everyone has it before t0
+  TEST_ASSERT_EQUAL(0, tree.late);
+  // starts differ by t0's ms rounding plus each node's sync error; a chain
+  // stacks the error of every hop above it
+  TEST_ASSERT_TRUE(tree.spread_max_us > 0);
+  TEST_ASSERT_TRUE(tree.spread_max_us <= SPREAD_MAX_US);
+  TEST_ASSERT_TRUE(tree.spread_max_us < chain.spread_max_us);
+  TEST_ASSERT_TRUE(pct(tree.lat_us, 99) < pct(chain.lat_us, 99));
+}
+
+// On one channel every unicast relay costs a frame of airtime, so at 1 Mbps
+// and 100 nodes latency follows the node count more than the depth (heap
+// order sends in index order for any k; test_topology shows fanout at a
+// faster rate). The lead derived from it must still cover every node.
+static void test_cues_100_nodes() {
+  const Result chain = run_cues<100>(topology::Kind::Chain, 2, 2, 20, 2);
+  const Result tree2 = run_cues<100>(topology::Kind::Tree,  2, 2, 20, 2);
+  const Result tree4 = run_cues<100>(topology::Kind::Tree,  4, 2, 20, 2);
+  report("chain", 100, chain);
+  report("tree k=2", 100, tree2);
+  report("tree k=4", 100, tree4);
+  TEST_ASSERT_EQUAL(0, chain.missed);
+  TEST_ASSERT_EQUAL(0, tree2.missed);
+  TEST_ASSERT_EQUAL(0, tree4.missed);
+  TEST_ASSERT_EQUAL(0, chain.late);
+  TEST_ASSERT_EQUAL(0, tree2.late);
+  TEST_ASSERT_EQUAL(0, tree4.late);
+  TEST_ASSERT_TRUE(pct(tree2.lat_us, 50) < pct(chain.lat_us, 50));
+  TEST_ASSERT_TRUE(tree2.spread_max_us <= SPREAD_MAX_US);
+  TEST_ASSERT_TRUE(tree2.spread_max_us < chain.spread_max_us);
+}
+
+// Node 60 of a 100-node chain goes dark, then comes back: node 59 must
+// mark it dead within one cue and send around it (no cue lost past it),
+// and a probe must revive it within PROBE_MS of its return.
+static void test_dead_node_detect_and_reroute() {
+  static const size_t   N = 100, DARK = 60;
+  static const int64_t  PERIOD_US = 250000;
+  std::unique_ptr<Net<N>> owner(new Net<N>(3));
+  Net<N>& net = *owner;
+  net.setup(topology::Kind::Chain, 2);
+  airsim::LinkCfg dark;
+  dark.connected = false;
+
+  uint32_t seq = 0;
+  for (int c = 0; c < 3; ++c) send_cue(net, ++seq, PERIOD_US);
+  const int64_t base_us = net.got_us[DARK + 1] - (net.air.now_us() - PERIOD_US);
+
+  for (size_t j = 0; j <= N; ++j) { net.air.set_link((uint8_t)j, DARK, dark); net.air.set_link(DARK, (uint8_t)j, dark); }
+  const int64_t dark_sent_us = net.air.now_us();
+  send_cue(net, ++seq, PERIOD_US);
+  TEST_ASSERT_TRUE(net.node[DARK - 1].dead(DARK));
+  TEST_ASSERT_EQUAL(-1, net.got_us[DARK]);
+  for (size_t i = DARK + 1; i < N; ++i) TEST_ASSERT_TRUE(net.got_us[i] >= 0);   // rerouted, not lost
+  const int64_t around_us = net.got_us[DARK + 1] - dark_sent_us;
+  const uint32_t detect_ms = net.node[DARK - 1].heal().last_detect_ms;
+  TEST_ASSERT_TRUE(detect_ms <= 10);
+
+  // while dead: no resends, straight around it
+  send_cue(net, ++seq, PERIOD_US);
+  const int64_t dead_path_us = net.got_us[DARK + 1] - (net.air.now_us() - PERIOD_US);
+  TEST_ASSERT_TRUE(dead_path_us < around_us);
+
+  const airsim::LinkCfg up;
+  for (size_t j = 0; j <= N; ++j) { net.air.set_link((uint8_t)j, DARK, up); net.air.set_link(DARK, (uint8_t)j, up); }
+  const int64_t back_us = net.air.now_us();
+  net.alive_us = -1;
+  for (int c = 0; c < 8 && net.alive_us < 0; ++c) send_cue(net, ++seq, PERIOD_US);
+  TEST_ASSERT_TRUE(net.alive_us >= 0);
+  TEST_ASSERT_TRUE(net.alive_us - back_us <= (int64_t)relay::Node::PROBE_MS * 1000 + PERIOD_US);
+  send_cue(net, ++seq, PERIOD_US);
+  TEST_ASSERT_TRUE(net.got_us[DARK] >= 0);
+
+  const relay::HealStats h = net.node[DARK - 1].heal();
+  char line[256];
+  snprintf(line, sizeof(line),
+           "idx %u dark: detect %u ms after the first failure, first cue around it %lld us (normal %lld, "
+           "while dead %lld), revived %lld ms after return; rerouted %u probes %u",
+           (unsigned)DARK, (unsigned)detect_ms, (long long)around_us, (long long)base_us,
+           (long long)dead_path_us, (long long)((net.alive_us - back_us) / 1000),
+           (unsigned)h.rerouted, (unsigned)h.probes);
+  TEST_MESSAGE(line);
+}
+
+// Two Nets in one process must not share state
+static void test_instances_are_independent() {
+  static Net<4> a(1), b(1);
+  a.setup(topology::Kind::Chain, 2);
+  b.setup(topology::Kind::Chain, 2);
+  TEST_ASSERT_EQUAL(relay::Seen::New,     a.node[1].classify(MODE_BREATH, 0, 5, 42, 0));
+  TEST_ASSERT_EQUAL(relay::Seen::Refresh, a.node[1].classify(MODE_BREATH, 0, 5, 42, 10));
+  TEST_ASSERT_EQUAL(relay::Seen::New,     b.node[1].classify(MODE_BREATH, 0, 5, 42, 10));
+  TEST_ASSERT_EQUAL(1, a.node[1].dedup().refresh);
+  TEST_ASSERT_EQUAL(0, b.node[1].dedup().refresh);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_instances_are_independent);
+  RUN_TEST(test_cues_29_nodes);
+  RUN_TEST(test_cues_100_nodes);
+  RUN_TEST(test_dead_node_detect_and_reroute);
+  return UNITY_END();
+}
@@ -0,0 +1,193 @@
+// Relay layouts on the host (pio test -e native): hop depth and the
+// parent/children index math of topology.h over 29, 100 and 250 nodes, the
+// cue lead, and end-to-end cue latency of chain vs tree over the simulated
+// medium.
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <topology.h>
+#include <registry.h>
+#include <simnet.h>
+#include <codec.h>
+
+using namespace comms;
+
+void setUp() {}
+void tearDown() {}
+
+static const size_t SIZES[] = { 29, 100, registry::MAX_NODES };
+
+static topology::Layout layout(topology::Kind k, uint8_t fanout) {
+  topology::Layout l;
+  l.kind   = k;
+  l.fanout = fanout;
+  return l;
+}
+
+// Every node but 0 is the child of exactly one parent, its parent lists it
+// among its children, and a child sits one hop below its parent
+static void check_links(const topology::Layout& l, size_t num) {
+  static uint8_t reached[registry::MAX_NODES];
+  memset(reached, 0, sizeof(reached));
+  for (size_t i = 0; i < num; ++i) {
+    const size_t first = topology::first_child(l, i);
+    const size_t n     = topology::child_count(l, i, num);
+    TEST_ASSERT_TRUE(n <= topology::fanout_of(l));
+    for (size_t c = first; c < first + n; ++c) {
+      TEST_ASSERT_TRUE(c < num);
+      TEST_ASSERT_EQUAL(i, topology::parent(l, c));
+      TEST_ASSERT_EQUAL(topology::hop_depth(l, i) + 1, topology::hop_depth(l, c));
+      reached[c]++;
+    }
+  }
+  TEST_ASSERT_EQUAL(SIZE_MAX, topology::parent(l, 0));
+  TEST_ASSERT_EQUAL(0, reached[0]);
+  for (size_t i = 1; i < num; ++i) TEST_ASSERT_EQUAL(1, reached[i]);
+}
+
+// Hops to the deepest node of a k-ary heap: smallest d with
+// 1 + k + ... + k^(d-1) >= num
+static size_t tree_depth(size_t k, size_t num) {
+  size_t d = 0, full = 0, level = 1;
+  while (full < num) { full += level; level *= k; ++d; }
+  return d;
+}
+
+static void test_chain() {
+  const topology::Layout l = layout(topology::Kind::Chain, 4);   // fanout ignored
+  TEST_ASSERT_EQUAL(1, topology::fanout_of(l));
+  for (size_t num : SIZES) {
+    check_links(l, num);
+    TEST_ASSERT_EQUAL(num, topology::max_hop_depth(l, num));
+    TEST_ASSERT_EQUAL(1, topology::hop_depth(l, 0));
+    TEST_ASSERT_EQUAL(0, topology::child_count(l, num - 1, num));   // the end of the chain
+    TEST_ASSERT_EQUAL(1, topology::child_count(l, num - 2, num));
+  }
+}
+
+static void test_tree() {
+  const uint8_t fanouts[] = { 2, 3, 4 };
+  for (uint8_t k : fanouts) {
+    const topology::Layout l = layout(topology::Kind::Tree, k);
+    for (size_t num : SIZES) {
+      check_links(l, num);
+      TEST_ASSERT_EQUAL(tree_depth(k, num), topology::max_hop_depth(l, num));
+      // the last parent may have fewer than k children
+      const size_t last_parent = topology::parent(l, num - 1);
+      const size_t partial     = (num - 1) - topology::first_child(l, last_parent) + 1;
+      TEST_ASSERT_EQUAL(partial, topology::child_count(l, last_parent, num));
+      TEST_ASSERT_EQUAL(0, topology::child_count(l, last_parent + 1, num));
+    }
+  }
+  // 29 / 100 / 250 nodes: 5 / 7 / 8 hops at k=2, 4 / 5 / 5 at k=4
+  const topology::Layout t2 = layout(topology::Kind::Tree, 2);
+  const topology::Layout t4 = layout(topology::Kind::Tree, 4);
+  TEST_ASSERT_EQUAL(5, topology::max_hop_depth(t2, 29));
+  TEST_ASSERT_EQUAL(7, topology::max_hop_depth(t2, 100));
+  TEST_ASSERT_EQUAL(8, topology::max_hop_depth(t2, 250));
+  TEST_ASSERT_EQUAL(4, topology::max_hop_depth(t4, 29));
+  TEST_ASSERT_EQUAL(5, topology::max_hop_depth(t4, 100));
+  TEST_ASSERT_EQUAL(5, topology::max_hop_depth(t4, 250));
+}
+
+static void test_fanout_clamp_and_edges() {
+  const topology::Layout l0 = layout(topology::Kind::Tree, 0);
+  const topology::Layout l1 = layout(topology::Kind::Tree, 1);
+  TEST_ASSERT_EQUAL(2, topology::fanout_of(l0));
+  TEST_ASSERT_EQUAL(2, topology::fanout_of(l1));
+  TEST_ASSERT_EQUAL(8, topology::max_hop_depth(l1, registry::MAX_NODES));
+  TEST_ASSERT_EQUAL(0, topology::max_hop_depth(l1, 0));
+  TEST_ASSERT_EQUAL(1, topology::max_hop_depth(l1, 1));
+  TEST_ASSERT_EQUAL(0, topology::child_count(l1, 0, 1));   // a single node is a leaf
+  TEST_ASSERT_EQUAL(1, topology::child_count(l1, 0, 2));
+}
+
+// Chain: the depth sets the lead; a wide tree: the channel. Clamped.
+static void test_lead_ms() {
+  const topology::Layout chain = layout(topology::Kind::Chain, 2);
+  const topology::Layout t4    = layout(topology::Kind::Tree, 4);
+  TEST_ASSERT_EQUAL(2 * 29 * 1600 / 1000 + topology::LEAD_SLACK_MS, topology::lead_ms(chain, 29, 1600, 1300));
+  TEST_ASSERT_EQUAL(2 * 100 * 1300 / 1000 + topology::LEAD_SLACK_MS, topology::lead_ms(t4, 100, 1600, 1300));
+  TEST_ASSERT_EQUAL(2 * 5 * 30000 / 1000 + topology::LEAD_SLACK_MS, topology::lead_ms(t4, 100, 30000, 1300));
+  TEST_ASSERT_EQUAL(topology::LEAD_MAX_MS, topology::lead_ms(chain, 250, 5000, 1300));
+  TEST_ASSERT_EQUAL(topology::LEAD_SLACK_MS, topology::lead_ms(chain, 0, 1600, 1300));
+}
+
+// ---------- latency over airsim ----------
+// Every relay is a unicast frame on one channel, so the last node waits for
+// about num frames whatever the layout; depth only shows where a hop costs
+// more than its frame. At 1 Mbps (1.2 ms a frame) the channel dominates and
+// k=2 / k=4 send in the same index order; at 24 Mbps with 1 ms from
+// reception to the relayed send, hops dominate.
+static const uint32_t LAT_RATE_MBPS = 24;
+static const uint32_t LAT_HOP_US    = 1000;
+static const size_t   LAT_CUES      = 10;
+
+struct Latency { int64_t p50_us, p99_us; };
+
+template <size_t N>
+static Latency cue_latency(topology::Kind k, uint8_t fanout) {
+  std::unique_ptr<simnet::Net<N>> owner(new simnet::Net<N>(1));   // too big for the stack
+  simnet::Net<N>& net = *owner;
+  airsim::LinkCfg link;
+  link.latency_us = LAT_HOP_US;
+  link.loss_pct   = 2;
+  net.air.set_all_links(link);
+  net.air.set_rate_mbps(LAT_RATE_MBPS);
+  net.setup(k, fanout);
+
+  std::vector<int64_t> lat;
+  for (size_t c = 0; c < LAT_CUES; ++c) {
+    const int64_t sent_us = net.air.now_us();
+    BreathCue m{};
+    m.mode = MODE_BREATH; m.seq = (uint32_t)c + 1; m.ttl = 255;
+    m.t0_ms = net.master_ms() + 1000;
+    m.r = 255; m.b_max = 0xFFFF; m.up_ms = 2000; m.down_ms = 2000;
+    uint8_t f[codec::MAX_FRAME];
+    const size_t len = codec::encode(m, f, sizeof(f));
+    net.clear_cue();
+    net.master_send(f, len);
+    net.run(sent_us + 500000);
+    for (size_t i = 0; i < N; ++i) {
+      TEST_ASSERT_TRUE(net.got_us[i] >= 0);
+      lat.push_back(net.got_us[i] - sent_us);
+    }
+  }
+  std::sort(lat.begin(), lat.end());
+  const Latency r = { lat[(lat.size() - 1) / 2], lat[(lat.size() - 1) * 99 / 100] };
+  return r;
+}
+
+template <size_t N>
+static void check_latency() {
+  const Latency chain = cue_latency<N>(topology::Kind::Chain, 2);
+  const Latency t2    = cue_latency<N>(topology::Kind::Tree, 2);
+  const Latency t4    = cue_latency<N>(topology::Kind::Tree, 4);
+  char line[160];
+  snprintf(line, sizeof(line), "%3u nodes p50/p99 us: chain %lld/%lld  k=2 %lld/%lld  k=4 %lld/%lld",
+           (unsigned)N, (long long)chain.p50_us, (long long)chain.p99_us, (long long)t2.p50_us,
+           (long long)t2.p99_us, (long long)t4.p50_us, (long long)t4.p99_us);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_TRUE(t2.p50_us < chain.p50_us);
+  TEST_ASSERT_TRUE(t2.p99_us < chain.p99_us);
+  // fewer hops must buy at least 5%
+  TEST_ASSERT_TRUE(t4.p50_us * 100 <= t2.p50_us * 95);
+  TEST_ASSERT_TRUE(t4.p99_us < t2.p99_us);
+}
+
+static void test_latency_29()  { check_latency<29>(); }
+static void test_latency_100() { check_latency<100>(); }
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_chain);
+  RUN_TEST(test_tree);
+  RUN_TEST(test_fanout_clamp_and_edges);
+  RUN_TEST(test_lead_ms);
+  RUN_TEST(test_latency_29);
+  RUN_TEST(test_latency_100);
+  return UNITY_END();
+}
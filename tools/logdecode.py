@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Decode binary records from lib/logging (Output::Binary) back into text.
+
+Usage:
+  logdecode.py firmware.elf capture.bin
+  logdecode.py firmware.elf /dev/ttyUSB0 [baud]      (needs pyserial)
+
+Each record is: A5 5A | t_ms u32 | fmt u32 | level u8 | nargs u8 | 8 x u32
+(little endian). The format id is the address of the format string in the
+firmware, so the ELF of the running build is needed (pip install pyelftools).
+"""
+import re
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+MAGIC = b"\xA5\x5A"
+MAX_ARGS = 8                      # LOG_MAX_ARGS
+REC = struct.Struct("<IIBB%dI" % MAX_ARGS)
+LEVELS = "-EWIDV"
+SPEC = re.compile(r"%([-+ 0#]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diouxXcsp%])")
+
+
+class Strings:
+    def __init__(self, path):
+        self.f = open(path, "rb")
+        self.elf = ELFFile(self.f)
+        self.sections = [s for s in self.elf.iter_sections()
+                         if s["sh_addr"] and s["sh_type"] == "SHT_PROGBITS"]
+
+    def at(self, addr):
+        for s in self.sections:
+            lo = s["sh_addr"]
+            if lo <= addr < lo + s["sh_size"]:
+                data = s.data()
+                off = addr - lo
+                end = data.find(b"\0", off)
+                return data[off:end if end >= 0 else None].decode("utf-8", "replace")
+        return None
+
+
+def render(strings, fmt, args):
+    it = iter(args)
+
+    def sub(m):
+        flags, _, conv = m.groups()
+        if conv == "%":
+            return "%"
+        v = next(it, 0)
+        if conv in "di":
+            v = struct.unpack("<i", struct.pack("<I", v))[0]
+            return ("%" + flags + "d") % v
+        if conv in "ouxX":
+            return ("%" + flags + conv) % v
+        if conv == "c":
+            return chr(v & 0xFF)
+        if conv == "p":
+            return "0x%08x" % v
+        s = strings.at(v)                     # %s: static string in flash/rodata
+        return ("%" + flags + "s") % (s if s is not None else "<0x%08x>" % v)
+
+    return SPEC.sub(sub, fmt)
+
+
+def records(stream):
+    buf = b""
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            return
+        buf += chunk
+        while True:
+            i = buf.find(MAGIC)
+            if i < 0 or len(buf) - i - 2 < REC.size:
+                buf = buf[i:] if i >= 0 else buf[-1:]
+                break
+            yield REC.unpack_from(buf, i + 2)
+            buf = buf[i + 2 + REC.size:]
+
+
+def main(argv):
+    if len(argv) < 3:
+        sys.exit(__doc__)
+    strings = Strings(argv[1])
+    src = argv[2]
+    if src.startswith("/dev/"):
+        import serial
+        stream = serial.Serial(src, int(argv[3]) if len(argv) > 3 else 115200)
+    else:
+        stream = open(src, "rb")
+
+    for t_ms, fmt_addr, level, nargs, *args in records(stream):
+        fmt = strings.at(fmt_addr)
+        text = render(strings, fmt, args[:nargs]) if fmt else "<fmt 0x%08x> %s" % (fmt_addr, args[:nargs])
+        print("%s %d.%03d %s" % (LEVELS[level] if level < len(LEVELS) else "-",
+                                 t_ms // 1000, t_ms % 1000, text))
+
+
+if __name__ == "__main__":
+    main(sys.argv)